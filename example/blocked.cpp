@@ -0,0 +1,156 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <vector>
+
+#include "../include/Engine.hpp"
+#include "../include/Parallel.hpp"
+
+// Matrix multiply and 3D stencil split by rows with parallelFor, against
+// blocks of parallelFor2d and parallelFor3d
+
+#define MATRIX_SIZE 1024
+#define MATRIX_TILE 64
+#define GRID_SIZE 192
+#define STENCIL_STEPS 4
+#define ROUNDS 3
+
+using namespace TaskSystem;
+
+template<typename Function>
+double bestSeconds(Engine& engine, Function function) {
+	double best = 1e30;
+
+	for (int round = 0; round < ROUNDS; round++) {
+		// Tasks of the previous round are done, their pool generation can be reused
+		engine.beginFrame();
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		function();
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		best = std::min(best, std::chrono::duration<double>(end - start).count());
+	}
+
+	return best;
+}
+
+void report(const char* name, double work, const char* unit, double rows, double blocks) {
+	std::cout << name << ": rows " << work / rows / 1e9 << " " << unit << ", blocks "
+		<< work / blocks / 1e9 << " " << unit << " (" << rows / blocks << "x)" << std::endl;
+}
+
+// c[i][j] += a[i][k] * b[k][j] over the rows and columns given, k in tiles
+// so the rows of b used stay in the caches
+void multiplyBlock(const float* a, const float* b, float* c, std::size_t rowBegin, std::size_t rowEnd,
+	std::size_t columnBegin, std::size_t columnEnd) {
+	for (std::size_t tile = 0; tile < MATRIX_SIZE; tile += MATRIX_TILE) {
+		for (std::size_t i = rowBegin; i < rowEnd; i++) {
+			for (std::size_t k = tile; k < tile + MATRIX_TILE; k++) {
+				const float scale = a[i * MATRIX_SIZE + k];
+
+				for (std::size_t j = columnBegin; j < columnEnd; j++) {
+					c[i * MATRIX_SIZE + j] += scale * b[k * MATRIX_SIZE + j];
+				}
+			}
+		}
+	}
+}
+
+// Averages each cell of the interior with its six neighbours
+void stencilBlock(const float* in, float* out, const BlockedRange3d& block) {
+	const std::size_t plane = GRID_SIZE * GRID_SIZE;
+
+	for (std::size_t z = block.begin[0]; z < block.end[0]; z++) {
+		for (std::size_t y = block.begin[1]; y < block.end[1]; y++) {
+			for (std::size_t x = block.begin[2]; x < block.end[2]; x++) {
+				const std::size_t cell = z * plane + y * GRID_SIZE + x;
+				out[cell] = (in[cell] + in[cell - 1] + in[cell + 1] + in[cell - GRID_SIZE] + in[cell + GRID_SIZE] +
+					in[cell - plane] + in[cell + plane]) / 7;
+			}
+		}
+	}
+}
+
+int main() {
+	const std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+	Engine engine{ threads, 1 << 16, TaskSize::Bytes64, 2 };
+
+	std::cout << threads << " workers" << std::endl;
+
+	std::vector<float> a(MATRIX_SIZE * MATRIX_SIZE), b(a.size()), rowsResult(a.size()), blocksResult(a.size());
+
+	for (std::size_t i = 0; i < a.size(); i++) {
+		a[i] = static_cast<float>(i % 7) / 7;
+		b[i] = static_cast<float>(i % 11) / 11;
+	}
+
+	const double rowsMultiply = bestSeconds(engine, [&] {
+		std::fill(rowsResult.begin(), rowsResult.end(), 0.0f);
+		parallelFor(engine, 0, MATRIX_SIZE, [&](std::size_t begin, std::size_t end) {
+			multiplyBlock(a.data(), b.data(), rowsResult.data(), begin, end, 0, MATRIX_SIZE);
+		});
+	});
+
+	const double blocksMultiply = bestSeconds(engine, [&] {
+		std::fill(blocksResult.begin(), blocksResult.end(), 0.0f);
+		parallelFor2d(engine, BlockedRange2d{ { 0, 0 }, { MATRIX_SIZE, MATRIX_SIZE } }, { MATRIX_TILE, MATRIX_TILE },
+			[&](const BlockedRange2d& block) {
+				multiplyBlock(a.data(), b.data(), blocksResult.data(), block.begin[0], block.end[0], block.begin[1], block.end[1]);
+			});
+	});
+
+	if (rowsResult != blocksResult) {
+		std::cerr << "Blocked matrix multiply differs from the one by rows" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	report("matrix multiply", 2.0 * MATRIX_SIZE * MATRIX_SIZE * MATRIX_SIZE, "GFlop/s", rowsMultiply, blocksMultiply);
+
+	std::vector<float> grid(GRID_SIZE * GRID_SIZE * GRID_SIZE), next(grid.size()), rowsGrid, blocksGrid;
+
+	for (std::size_t i = 0; i < grid.size(); i++) {
+		grid[i] = static_cast<float>(std::sin(static_cast<double>(i)));
+	}
+
+	const BlockedRange3d interior{ { 1, 1, 1 }, { GRID_SIZE - 1, GRID_SIZE - 1, GRID_SIZE - 1 } };
+
+	const double rowsStencil = bestSeconds(engine, [&] {
+		std::vector<float> in = grid, out = grid;
+
+		for (int step = 0; step < STENCIL_STEPS; step++) {
+			parallelFor(engine, interior.begin[0], interior.end[0], [&](std::size_t begin, std::size_t end) {
+				stencilBlock(in.data(), out.data(), BlockedRange3d{ { begin, interior.begin[1], interior.begin[2] },
+					{ end, interior.end[1], interior.end[2] } });
+			});
+			std::swap(in, out);
+		}
+
+		rowsGrid = in;
+	});
+
+	const double blocksStencil = bestSeconds(engine, [&] {
+		std::vector<float> in = grid, out = grid;
+
+		for (int step = 0; step < STENCIL_STEPS; step++) {
+			// Whole rows along x keep the loads contiguous
+			parallelFor3d(engine, interior, { 16, 16, GRID_SIZE }, [&](const BlockedRange3d& block) {
+				stencilBlock(in.data(), out.data(), block);
+			});
+			std::swap(in, out);
+		}
+
+		blocksGrid = in;
+	});
+
+	if (rowsGrid != blocksGrid) {
+		std::cerr << "Blocked stencil differs from the one by rows" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	report("stencil", 7.0 * interior.end[0] * interior.end[1] * interior.end[2] * STENCIL_STEPS, "GFlop/s",
+		rowsStencil, blocksStencil);
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <iostream>
+#include <random>
+#include <unordered_map>
+#include <vector>
+
+#include "../include/Engine.hpp"
+#include "../include/HashJoin.hpp"
+
+// Hash join and group-by over synthetic tables, uniform and skewed, against
+// a serial std::unordered_map baseline
+
+#define BUILD_ROWS (1 << 20)
+#define PROBE_ROWS (1 << 23)
+#define ROUNDS 3
+#define ZIPF_EXPONENT 1.0
+
+using namespace TaskSystem;
+
+std::vector<Row> uniqueKeys(std::size_t rows, std::mt19937_64& random) {
+	std::vector<Row> table(rows);
+
+	for (std::size_t i = 0; i < rows; i++) {
+		table[i] = Row{ i, random() };
+	}
+
+	std::shuffle(table.begin(), table.end(), random);
+	return table;
+}
+
+// Keys in [0, keys), key k drawn with probability proportional to 1 / (k + 1)^exponent
+std::vector<Row> zipfKeys(std::size_t rows, std::size_t keys, double exponent, std::mt19937_64& random) {
+	std::vector<double> cdf(keys);
+	double total = 0;
+
+	for (std::size_t k = 0; k < keys; k++) {
+		total += 1.0 / std::pow(static_cast<double>(k + 1), exponent);
+		cdf[k] = total;
+	}
+
+	std::uniform_real_distribution<double> uniform{ 0, total };
+	std::vector<Row> table(rows);
+
+	for (std::size_t i = 0; i < rows; i++) {
+		const auto k = std::lower_bound(cdf.begin(), cdf.end(), uniform(random)) - cdf.begin();
+		table[i] = Row{ static_cast<std::uint64_t>(std::min<std::size_t>(k, keys - 1)), random() };
+	}
+
+	return table;
+}
+
+std::vector<Row> uniformKeys(std::size_t rows, std::size_t keys, std::mt19937_64& random) {
+	std::vector<Row> table(rows);
+
+	for (std::size_t i = 0; i < rows; i++) {
+		table[i] = Row{ random() % keys, random() };
+	}
+
+	return table;
+}
+
+std::size_t serialJoin(const std::vector<Row>& build, const std::vector<Row>& probe) {
+	std::unordered_multimap<std::uint64_t, std::uint64_t> table;
+	table.reserve(build.size());
+	std::size_t matches = 0;
+
+	for (const Row& row : build) {
+		table.emplace(row.key, row.payload);
+	}
+
+	for (const Row& row : probe) {
+		matches += table.count(row.key);
+	}
+
+	return matches;
+}
+
+std::size_t serialGroupBy(const std::vector<Row>& rows) {
+	std::unordered_map<std::uint64_t, Group> groups;
+
+	for (const Row& row : rows) {
+		Group& group = groups[row.key];
+		group.key = row.key;
+		group.count++;
+		group.sum += row.payload;
+	}
+
+	return groups.size();
+}
+
+template<typename Function>
+double bestSeconds(Engine& engine, Function function) {
+	double best = 1e30;
+
+	for (int round = 0; round < ROUNDS; round++) {
+		// Tasks of the previous round are done, their pool generation can be reused
+		engine.beginFrame();
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		function();
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		best = std::min(best, std::chrono::duration<double>(end - start).count());
+	}
+
+	return best;
+}
+
+void report(const char* name, std::size_t rows, double serial, double parallel) {
+	std::cout << name << ": serial " << rows / serial / 1e6 << " Mrows/s, parallel "
+		<< rows / parallel / 1e6 << " Mrows/s (" << serial / parallel << "x)" << std::endl;
+}
+
+int main() {
+	const std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+	Engine engine{ threads, 1 << 16, TaskSize::Bytes64, 2 };
+	std::mt19937_64 random{ 42 };
+
+	const std::vector<Row> build = uniqueKeys(BUILD_ROWS, random);
+	const std::vector<Row> uniform = uniformKeys(PROBE_ROWS, BUILD_ROWS, random);
+	const std::vector<Row> skewed = zipfKeys(PROBE_ROWS, BUILD_ROWS, ZIPF_EXPONENT, random);
+
+	std::cout << threads << " workers, " << BUILD_ROWS << " build rows, " << PROBE_ROWS << " probe rows" << std::endl;
+
+	for (const auto& table : { std::make_pair("uniform", &uniform), std::make_pair("zipf", &skewed) }) {
+		const std::vector<Row>& probe = *table.second;
+		std::size_t serialMatches = 0, parallelMatches = 0, serialGroups = 0;
+		std::vector<JoinMatch> matches;
+		std::vector<Group> groups;
+
+		const double serialJoinTime = bestSeconds(engine, [&] { serialMatches = serialJoin(build, probe); });
+		const double joinTime = bestSeconds(engine, [&] { parallelMatches = hashJoin(engine, build, probe, matches); });
+		const double serialGroupTime = bestSeconds(engine, [&] { serialGroups = serialGroupBy(probe); });
+		const double groupTime = bestSeconds(engine, [&] { groupBy(engine, probe, groups); });
+
+		if (serialMatches != parallelMatches || serialGroups != groups.size()) {
+			std::cerr << table.first << ": results differ from the serial baseline" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		std::cout << table.first << " keys" << std::endl;
+		report("  hash join", build.size() + probe.size(), serialJoinTime, joinTime);
+		report("  group by", probe.size(), serialGroupTime, groupTime);
+	}
+
+	return EXIT_SUCCESS;
+}
@@ -17,6 +17,13 @@ long sortSize = 2;
 
 using namespace TaskSystem;
 
+// Sort tasks only carry a SortData, so the smallest cache line sized
+// task class is enough
+Engine& engine() {
+	static Engine _engine{ std::thread::hardware_concurrency(), 100000, TaskSize::Bytes64 };
+	return _engine;
+}
+
 struct SortData {
 	long* list;
 	long lowerBound, upperBound;
@@ -25,15 +32,20 @@ struct SortData {
 void sortTask(Task& task);
 void quickSortTasks(long list[], long lowerBound, long upperBound, Task* parent);
 void quickSortTasks(long list[], long lowerBound, long upperBound, Task* parent) {
-	if (upperBound - lowerBound > sortSize / Engine::Instance().workers().size()) {
+	if (upperBound - lowerBound > sortSize / engine().workers().size()) {
 		SortData d;
 		d.list = list;
 		d.lowerBound = lowerBound;
 		d.upperBound = upperBound;
 
-		auto* worker = Engine::Instance().threadWorker();
+		// Once the queue has enough ranges for thieves the rest are sorted
+		// inline, so deep recursions do not exhaust the pool
+		auto* worker = engine().threadWorker();
 		Task* task = worker->pool().createTaskAsChild(sortTask, d, parent);
-		worker->submit(task);
+
+		if (worker->submit(task, SpawnPolicy::Auto)) {
+			worker->pool().release(task);
+		}
 
 	}
 	else {
@@ -83,7 +95,7 @@ void shuffle(long list[], long size) {
 
 void syncSort(long* list, long size) {
 	sortSize = size;
-	Worker* worker = Engine::Instance().threadWorker();
+	Worker* worker = engine().threadWorker();
 	Task* root = worker->pool().createTask([](Task& task) {});
 	quickSortTasks(list, 0, size - 1, root);
 
@@ -0,0 +1,120 @@
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstdlib>
+#include <iostream>
+#include <thread>
+#include <vector>
+
+// The task counter protocol with the memory orderings Task uses (relaxed
+// increments, acq_rel decrements, acquire loads) against seq_cst everywhere:
+// children are registered, then finish concurrently from every thread, the
+// last one reading what the others wrote, and the counters are polled
+
+#define PARENTS (1 << 16)
+#define ROUNDS 5
+
+struct alignas(64) Counter {
+	std::atomic<std::int32_t> value;
+};
+
+struct Timings {
+	double increment = 1e30;
+	double decrement = 1e30;
+	double load = 1e30;
+	long errors = 0;
+};
+
+double nanoseconds(std::chrono::high_resolution_clock::time_point start, double operations) {
+	return std::chrono::duration<double, std::nano>(std::chrono::high_resolution_clock::now() - start).count() / operations;
+}
+
+template<std::memory_order Increment, std::memory_order Decrement, std::memory_order Load>
+Timings measure(std::size_t threads) {
+	using clock = std::chrono::high_resolution_clock;
+	std::vector<Counter> counters(PARENTS);
+	std::vector<int> payload(PARENTS * threads);
+	std::atomic<long> errors{ 0 };
+	Timings best;
+
+	for (int round = 1; round <= ROUNDS; round++) {
+		// The parent registers one child per thread while it runs, then
+		// finishes its own function
+		auto start = clock::now();
+
+		for (Counter& counter : counters) {
+			counter.value.store(1, std::memory_order_relaxed);
+
+			for (std::size_t child = 0; child < threads; child++) {
+				counter.value.fetch_add(1, Increment);
+			}
+
+			counter.value.fetch_sub(1, Decrement);
+		}
+
+		best.increment = std::min(best.increment, nanoseconds(start, static_cast<double>(PARENTS) * threads));
+
+		// Children write their result and finish, the last one reads all of them
+		start = clock::now();
+		std::vector<std::thread> children;
+
+		for (std::size_t thread = 0; thread < threads; thread++) {
+			children.emplace_back([&, thread] {
+				for (std::size_t i = 0; i < PARENTS; i++) {
+					const std::size_t parent = (i + thread * PARENTS / threads) % PARENTS;
+					payload[parent * threads + thread] = round;
+
+					if (counters[parent].value.fetch_sub(1, Decrement) == 1) {
+						for (std::size_t child = 0; child < threads; child++) {
+							errors.fetch_add(payload[parent * threads + child] != round, std::memory_order_relaxed);
+						}
+					}
+				}
+			});
+		}
+
+		for (std::thread& child : children) {
+			child.join();
+		}
+
+		best.decrement = std::min(best.decrement, nanoseconds(start, static_cast<double>(PARENTS) * threads));
+
+		start = clock::now();
+		long unfinished = 0;
+
+		for (const Counter& counter : counters) {
+			unfinished += counter.value.load(Load) != 0;
+		}
+
+		best.load = std::min(best.load, nanoseconds(start, PARENTS));
+		errors += unfinished;
+	}
+
+	best.errors = errors;
+	return best;
+}
+
+void report(const char* name, const Timings& timings) {
+	std::cout << name << ": increment " << timings.increment << " ns, decrement " << timings.decrement
+		<< " ns, load " << timings.load << " ns" << std::endl;
+}
+
+int main() {
+	const std::size_t threads = std::max(std::thread::hardware_concurrency(), 2u);
+
+	std::cout << threads << " threads, " << PARENTS << " parents, best of " << ROUNDS << " rounds" << std::endl;
+
+	const Timings chosen = measure<std::memory_order_relaxed, std::memory_order_acq_rel, std::memory_order_acquire>(threads);
+	const Timings sequential = measure<std::memory_order_seq_cst, std::memory_order_seq_cst, std::memory_order_seq_cst>(threads);
+
+	if (chosen.errors != 0 || sequential.errors != 0) {
+		std::cerr << "Counters left unfinished or results read before they were handed off" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	report("relaxed/acq_rel/acquire", chosen);
+	report("seq_cst", sequential);
+
+	return EXIT_SUCCESS;
+}
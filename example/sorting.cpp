@@ -0,0 +1,104 @@
+#include <algorithm>
+#include <chrono>
+#include <iostream>
+#include <random>
+#include <vector>
+
+#include "../include/Engine.hpp"
+#include "../include/Parallel.hpp"
+
+// Parallel sorts and selections over synthetic report rows, against their
+// serial std counterparts
+
+#define ROWS (1 << 23)
+#define TOP_K 1000
+#define ROUNDS 3
+
+using namespace TaskSystem;
+
+struct ReportRow {
+	std::uint32_t region;
+	std::uint64_t revenue;
+};
+
+bool byRegion(const ReportRow& first, const ReportRow& second) {
+	return first.region < second.region;
+}
+
+bool byRevenue(const ReportRow& first, const ReportRow& second) {
+	return first.revenue > second.revenue;
+}
+
+template<typename Function>
+double bestSeconds(Engine& engine, const std::vector<ReportRow>& rows, Function function) {
+	double best = 1e30;
+
+	for (int round = 0; round < ROUNDS; round++) {
+		// Tasks of the previous round are done, their pool generation can be reused
+		engine.beginFrame();
+		std::vector<ReportRow> copy = rows;
+
+		const auto start = std::chrono::high_resolution_clock::now();
+		function(copy);
+		const auto end = std::chrono::high_resolution_clock::now();
+
+		best = std::min(best, std::chrono::duration<double>(end - start).count());
+	}
+
+	return best;
+}
+
+void report(const char* name, double serial, double parallel) {
+	std::cout << name << ": serial " << ROWS / serial / 1e6 << " Mrows/s, parallel "
+		<< ROWS / parallel / 1e6 << " Mrows/s (" << serial / parallel << "x)" << std::endl;
+}
+
+int main() {
+	const std::size_t threads = std::max(std::thread::hardware_concurrency(), 1u);
+	Engine engine{ threads, 1 << 16, TaskSize::Bytes64, 2 };
+	std::mt19937_64 random{ 42 };
+	std::vector<ReportRow> rows(ROWS);
+
+	for (ReportRow& row : rows) {
+		row = ReportRow{ static_cast<std::uint32_t>(random() % 1000), random() % 1000000 };
+	}
+
+	std::cout << threads << " workers, " << ROWS << " rows" << std::endl;
+
+	std::vector<ReportRow> expected = rows, actual = rows;
+	std::stable_sort(expected.begin(), expected.end(), byRegion);
+	parallelStableSort(engine, actual.data(), actual.size(), byRegion);
+
+	if (!std::equal(expected.begin(), expected.end(), actual.begin(), [](const ReportRow& first, const ReportRow& second) {
+		return first.region == second.region && first.revenue == second.revenue;
+	})) {
+		std::cerr << "Stable sort differs from std::stable_sort" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	report("stable sort",
+		bestSeconds(engine, rows, [](std::vector<ReportRow>& copy) { std::stable_sort(copy.begin(), copy.end(), byRegion); }),
+		bestSeconds(engine, rows, [&](std::vector<ReportRow>& copy) { parallelStableSort(engine, copy.data(), copy.size(), byRegion); }));
+
+	report("sort",
+		bestSeconds(engine, rows, [](std::vector<ReportRow>& copy) { std::sort(copy.begin(), copy.end(), byRevenue); }),
+		bestSeconds(engine, rows, [&](std::vector<ReportRow>& copy) { parallelSort(engine, copy.data(), copy.size(), byRevenue); }));
+
+	report("top k",
+		bestSeconds(engine, rows, [](std::vector<ReportRow>& copy) {
+			std::partial_sort(copy.begin(), copy.begin() + TOP_K, copy.end(), byRevenue);
+		}),
+		bestSeconds(engine, rows, [&](std::vector<ReportRow>& copy) {
+			parallelPartialSort(engine, copy.data(), copy.size(), TOP_K, byRevenue);
+		}));
+
+	report("median",
+		bestSeconds(engine, rows, [](std::vector<ReportRow>& copy) {
+			std::nth_element(copy.begin(), copy.begin() + ROWS / 2, copy.end(), byRevenue);
+		}),
+		bestSeconds(engine, rows, [&](std::vector<ReportRow>& copy) {
+			parallelNthElement(engine, copy.data(), copy.size(), ROWS / 2, byRevenue);
+		}));
+
+	return EXIT_SUCCESS;
+}
@@ -0,0 +1,134 @@
+#ifndef TASKSYSTEM_BLOCKINGPOOL_HPP
+#define TASKSYSTEM_BLOCKINGPOOL_HPP
+
+#pragma once
+#include "Task.hpp"
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <deque>
+#include <list>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace TaskSystem {
+	/**
+	 * \brief Elastic thread pool running tasks that block
+	 *
+	 * Tasks calling blocking code (synchronous I/O, fsync, DNS lookups, etc)
+	 * would stall a worker and everything queued behind it. Instead, they are
+	 * submitted to this pool (See `Engine::submitBlocking()`), which runs each
+	 * task in one of its threads, spawning a new thread when all of them are
+	 * busy and retiring threads idle for longer than the keep alive time.
+	 *
+	 * When a blocking task is done its continuation (if any) is handed back to
+	 * the engine: workers collect completed continuations when they poll for events
+	 * and submit them to their own queue.
+	 *
+	 * Blocking tasks run outside the engine workers, so they cannot allocate or
+	 * submit tasks themselves (`Engine::threadWorker()` returns nullptr there).
+	 */
+	class BlockingPool
+	{
+	public:
+		/**
+		 * \param maxThreads Maximum number of threads running blocking tasks at the same time
+		 * \param keepAlive Time an idle thread waits for new tasks before exiting
+		 */
+		explicit BlockingPool(std::size_t maxThreads = 64,
+			std::chrono::milliseconds keepAlive = std::chrono::milliseconds(2000));
+		~BlockingPool();
+
+		BlockingPool(const BlockingPool&) = delete;
+		BlockingPool& operator=(const BlockingPool&) = delete;
+
+		/**
+		 * \brief Runs \p task in a pool thread
+		 *
+		 * Thread safe. Tasks are run in submission order, as soon as a thread is available.
+		 *
+		 * \param continuation Task handed back to the engine once \p task is run, can be nullptr
+		 */
+		void submit(Task* task, Task* continuation = nullptr);
+
+		/**
+		 * \brief Collects the continuations of completed blocking tasks
+		 *
+		 * \param callback Invoked as `callback(Task* continuation)` for each continuation
+		 * \returns The number of continuations collected
+		 */
+		template<typename Callback>
+		std::size_t poll(Callback callback)
+		{
+			if (_completedCount.load(std::memory_order_acquire) == 0)
+			{
+				return 0;
+			}
+
+			std::vector<Task*> completed;
+
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+				completed.swap(_completed);
+				_completedCount.store(0, std::memory_order_relaxed);
+			}
+
+			for (Task* continuation : completed)
+			{
+				callback(continuation);
+			}
+
+			return completed.size();
+		}
+
+		/**
+		 * \brief Discards the tasks not picked up by a thread yet, and the
+		 * continuations not collected yet, once the running tasks are done
+		 *
+		 * Called by the engine when it stops its workers (See `Engine::shutdown()`):
+		 * nobody would collect those continuations anymore, so their waiters would
+		 * hang. The pool keeps working afterwards.
+		 *
+		 * \returns The number of tasks and continuations discarded
+		 */
+		std::size_t discardPending();
+
+		/**
+		 * \brief Returns the number of threads currently alive
+		 */
+		std::size_t threads() const;
+
+		/**
+		 * \brief Returns the number of tasks waiting for a thread
+		 */
+		std::size_t pending() const;
+
+	private:
+		struct Job
+		{
+			Task* task;
+			Task* continuation;
+		};
+
+		std::size_t _maxThreads;
+		std::chrono::milliseconds _keepAlive;
+		mutable std::mutex _mutex;
+		std::condition_variable _available;
+		// Notified when the last running task is done
+		std::condition_variable _done;
+		std::deque<Job> _jobs;
+		std::vector<Task*> _completed;
+		std::atomic<std::size_t> _completedCount;
+		std::list<std::thread> _threads;
+		std::vector<std::list<std::thread>::iterator> _retired;
+		std::size_t _idleThreads;
+		std::size_t _runningJobs;
+		bool _stopping;
+
+		void threadLoop(std::list<std::thread>::iterator self);
+		// Moves the threads that retired to \p retired, to be joined without the lock
+		void takeRetired(std::list<std::thread>& retired);
+	};
+}
+#endif
@@ -0,0 +1,172 @@
+#ifndef TASKSYSTEM_BOUNDEDQUEUE_HPP
+#define TASKSYSTEM_BOUNDEDQUEUE_HPP
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+//src: http://www.1024cores.net/home/lock-free-algorithms/queues/bounded-mpmc-queue
+
+namespace TaskSystem {
+	/**
+	 * \brief Lock free first in first out queue, for any number of producer
+	 * and consumer threads
+	 *
+	 * Each cell carries a sequence number telling whether it is ready to be
+	 * written or read for the current lap around the buffer, so producers and
+	 * consumers only contend on their own index. `tryPush()` fails when the queue
+	 * is full and `tryPop()` when it is empty, neither ever blocks: a task finding
+	 * the queue full can do something else and try again.
+	 */
+	template<typename T>
+	class BoundedQueue
+	{
+	public:
+		/**
+		 * \param capacity Rounded up to a power of two
+		 */
+		explicit BoundedQueue(std::size_t capacity) :
+			_mask{ 0 },
+			_enqueuePosition{ 0 },
+			_dequeuePosition{ 0 }
+		{
+			std::size_t size = 2;
+
+			while (size < capacity)
+			{
+				size *= 2;
+			}
+
+			_mask = size - 1;
+			_cells = std::make_unique<Cell[]>(size);
+
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				_cells[i].sequence.store(i, std::memory_order_relaxed);
+			}
+		}
+
+		~BoundedQueue()
+		{
+			const std::size_t end = _enqueuePosition.load(std::memory_order_relaxed);
+
+			for (std::size_t position = _dequeuePosition.load(std::memory_order_relaxed); position != end; ++position)
+			{
+				std::launder(reinterpret_cast<T*>(&_cells[position & _mask].storage))->~T();
+			}
+		}
+
+		BoundedQueue(const BoundedQueue&) = delete;
+		BoundedQueue& operator=(const BoundedQueue&) = delete;
+
+		template<typename U>
+		bool tryPush(U&& value)
+		{
+			std::size_t position = _enqueuePosition.load(std::memory_order_relaxed);
+			Cell* cell;
+
+			while (true)
+			{
+				cell = &_cells[position & _mask];
+				const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				const std::intptr_t difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position);
+
+				if (difference == 0)
+				{
+					if (_enqueuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						break;
+					}
+				}
+				else if (difference < 0)
+				{
+					// The cell was not popped since the last lap
+					return false;
+				}
+				else
+				{
+					position = _enqueuePosition.load(std::memory_order_relaxed);
+				}
+			}
+
+			new(&cell->storage) T(std::forward<U>(value));
+			cell->sequence.store(position + 1, std::memory_order_release);
+			return true;
+		}
+
+		bool tryPop(T& value)
+		{
+			std::size_t position = _dequeuePosition.load(std::memory_order_relaxed);
+			Cell* cell;
+
+			while (true)
+			{
+				cell = &_cells[position & _mask];
+				const std::size_t sequence = cell->sequence.load(std::memory_order_acquire);
+				const std::intptr_t difference = static_cast<std::intptr_t>(sequence) - static_cast<std::intptr_t>(position + 1);
+
+				if (difference == 0)
+				{
+					if (_dequeuePosition.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+					{
+						break;
+					}
+				}
+				else if (difference < 0)
+				{
+					// The cell was not pushed yet
+					return false;
+				}
+				else
+				{
+					position = _dequeuePosition.load(std::memory_order_relaxed);
+				}
+			}
+
+			T* stored = std::launder(reinterpret_cast<T*>(&cell->storage));
+			value = std::move(*stored);
+			stored->~T();
+			cell->sequence.store(position + _mask + 1, std::memory_order_release);
+			return true;
+		}
+
+		std::size_t capacity() const
+		{
+			return _mask + 1;
+		}
+
+		/**
+		 * \brief Returns the number of values queued, only a hint while
+		 * other threads push or pop
+		 */
+		std::size_t size() const
+		{
+			const std::size_t dequeued = _dequeuePosition.load(std::memory_order_relaxed);
+			const std::size_t enqueued = _enqueuePosition.load(std::memory_order_relaxed);
+			return enqueued > dequeued ? enqueued - dequeued : 0;
+		}
+
+		bool empty() const
+		{
+			return size() == 0;
+		}
+
+	private:
+		struct Cell
+		{
+			std::atomic<std::size_t> sequence;
+			std::aligned_storage_t<sizeof(T), alignof(T)> storage;
+		};
+
+		std::unique_ptr<Cell[]> _cells;
+		std::size_t _mask;
+		// Producers and consumers each keep to their own cache line
+		alignas(64) std::atomic<std::size_t> _enqueuePosition;
+		alignas(64) std::atomic<std::size_t> _dequeuePosition;
+	};
+}
+#endif
@@ -2,8 +2,10 @@
 #define TASKSYSTEM_CLOSURE_H
 
 #include "Task.hpp"
+#include <memory>
 
 namespace TaskSystem {
+namespace tasks {
 	template<typename Function>
 	class Closure : public Function
 	{
@@ -19,8 +21,18 @@ namespace TaskSystem {
 		}
 	};
 
+	/**
+	 * \brief Initializes \p task to run \p function, a callable with non-POD state
+	 *
+	 * \param task Task storage, as returned by `Pool::allocate()`. If nullptr the
+	 * function does nothing and returns nullptr.
+	 * \param parent Parent task, if any
+	 * \param maxDataSize Size of the data storage of \p task, see `Pool::maxDataSize()`.
+	 * Closures bigger than that are allocated in the heap.
+	 */
 	template<typename Function>
-	Task* closure(Task* task, Function function, Task* parent = nullptr)
+	Task* closure(Task* task, Function function, Task* parent = nullptr,
+		std::size_t maxDataSize = Task::maxDataSize())
 	{
 		if (task == nullptr)
 		{
@@ -33,56 +45,57 @@ namespace TaskSystem {
 		// as long as there are no other C++ semantics involved (copy, move,
 		// etc) which is true for our preallocated array of POD tasks
 
-		auto taskFunction = [](Task& task)
+		auto inlineTaskFunction = [](Task& task)
 		{
-			if constexpr (sizeof(Closure<Function>) <= Task::maxDataSize())
+			if constexpr (sizeof(Closure<Function>) <= Task::maxDataSize(TaskSize::Largest))
 			{
-				auto& closure = task.getData<Closure<Function>>();
-				closure.run(task);
-
 				// Install a finished callback to destroy the closure
 				// when the task is marked as finished. This allows any child task
-				// to capture references to the parent closure
+				// to capture references to the parent closure. Installed before
+				// running it, so the closure is destroyed even if it throws
 				task.whenFinished([](Task& task)
 					{
-						rt::utils::destroy(task.getData<Closure<Function>>());
+						task.getData<Closure<Function>>().~Closure<Function>();
 					});
-			}
-			else
-			{
-				auto& closure = task.getData<std::unique_ptr<Closure<Function>>>();
-				closure->run(task);
 
-				// Install a finished callback to destroy the closure
-				// when the task is marked as finished. This allows any child task
-				// to capture references to the parent closure
-				task.whenFinished([](Task& task)
-					{
-						rt::utils::destroy(task.getData<std::unique_ptr<Closure<Function>>>());
-					});
+				task.getData<Closure<Function>>().run(task);
 			}
 		};
 
-		// Initialize the allocated task:
-		rt::utils::construct<Task>(task, taskFunction, parent);
-
-		if constexpr (sizeof(Closure<Function>) <= Task::maxDataSize())
+		auto heapTaskFunction = [](Task& task)
 		{
-			// Construct the closure in the task payload:
-			task->constructData<Closure<Function>>(function);
-		}
-		else
+			// See inlineTaskFunction
+			task.whenFinished([](Task& task)
+				{
+					task.getData<std::unique_ptr<Closure<Function>>>().~unique_ptr();
+				});
+
+			task.getData<std::unique_ptr<Closure<Function>>>()->run(task);
+		};
+
+		// The size class of the task is only known at runtime, so is
+		// where the closure is stored
+		if constexpr (sizeof(Closure<Function>) <= Task::maxDataSize(TaskSize::Largest))
 		{
-			static_assert(sizeof(Function) != sizeof(Function));
-			// The closure object does not fit in the task payload,
-			// dynamically allocate it:
-			task->constructData<std::unique_ptr<Closure<Function>>>(std::make_unique<Closure<Function>>(function));
+			if (sizeof(Closure<Function>) <= maxDataSize)
+			{
+				// Construct the closure in the task payload:
+				new(task) Task{ inlineTaskFunction, parent };
+				task->constructData<Closure<Function>>(function);
+				return task;
+			}
 		}
 
+		// The closure object does not fit in the task payload,
+		// dynamically allocate it:
+		new(task) Task{ heapTaskFunction, parent };
+		task->constructData<std::unique_ptr<Closure<Function>>>(std::make_unique<Closure<Function>>(function));
+
 		return task;
 	}
 
 }
+}
 
 
 
@@ -0,0 +1,198 @@
+#ifndef TASKSYSTEM_CONCURRENTHASHMAP_HPP
+#define TASKSYSTEM_CONCURRENTHASHMAP_HPP
+
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+
+namespace TaskSystem {
+	/**
+	 * \brief Hash map shared by tasks, split in independently locked stripes
+	 *
+	 * Each key belongs to one stripe, picked from the high bits of its hash, and
+	 * each stripe is a `std::unordered_map` behind its own spin lock in its own
+	 * cache lines. Tasks touching different stripes never contend, so with enough
+	 * stripes (a few per worker) updates scale with the number of workers.
+	 *
+	 * Critical sections are short: functions passed to `update()` run with the
+	 * stripe locked and must not touch the map. Values are copied out by `find()`,
+	 * references to them are never handed out.
+	 */
+	template<typename Key, typename Value, typename Hash = std::hash<Key>, typename KeyEqual = std::equal_to<Key>>
+	class ConcurrentHashMap
+	{
+	public:
+		/**
+		 * \param stripes Rounded up to a power of two
+		 */
+		explicit ConcurrentHashMap(std::size_t stripes = 64) :
+			_stripeBits{ 0 }
+		{
+			while ((std::size_t{ 1 } << _stripeBits) < stripes)
+			{
+				_stripeBits++;
+			}
+
+			_stripes = std::make_unique<Stripe[]>(std::size_t{ 1 } << _stripeBits);
+		}
+
+		ConcurrentHashMap(const ConcurrentHashMap&) = delete;
+		ConcurrentHashMap& operator=(const ConcurrentHashMap&) = delete;
+
+		/**
+		 * \returns false if the key was already in the map, which is left unchanged
+		 */
+		bool insert(const Key& key, const Value& value)
+		{
+			Stripe& stripe = stripeOf(key);
+			Lock lock{ stripe };
+			return stripe.map.emplace(key, value).second;
+		}
+
+		/**
+		 * \brief Calls \p function with the value of \p key, default constructed
+		 * first if the key is not in the map
+		 *
+		 * The usual way to accumulate: `counts.update(word, [](auto& count) { count++; })`
+		 */
+		template<typename Function>
+		void update(const Key& key, Function function)
+		{
+			Stripe& stripe = stripeOf(key);
+			Lock lock{ stripe };
+			function(stripe.map[key]);
+		}
+
+		/**
+		 * \brief Copies the value of \p key to \p value
+		 *
+		 * \returns false if the key is not in the map
+		 */
+		bool find(const Key& key, Value& value) const
+		{
+			Stripe& stripe = stripeOf(key);
+			Lock lock{ stripe };
+			auto it = stripe.map.find(key);
+
+			if (it == stripe.map.end())
+			{
+				return false;
+			}
+
+			value = it->second;
+			return true;
+		}
+
+		bool contains(const Key& key) const
+		{
+			Stripe& stripe = stripeOf(key);
+			Lock lock{ stripe };
+			return stripe.map.find(key) != stripe.map.end();
+		}
+
+		bool erase(const Key& key)
+		{
+			Stripe& stripe = stripeOf(key);
+			Lock lock{ stripe };
+			return stripe.map.erase(key) != 0;
+		}
+
+		/**
+		 * \brief Counts the keys of all the stripes, locking one at a time, so
+		 * the result is only exact if nobody else modifies the map meanwhile
+		 */
+		std::size_t size() const
+		{
+			std::size_t size = 0;
+
+			for (std::size_t i = 0; i < stripes(); ++i)
+			{
+				Lock lock{ _stripes[i] };
+				size += _stripes[i].map.size();
+			}
+
+			return size;
+		}
+
+		void clear()
+		{
+			for (std::size_t i = 0; i < stripes(); ++i)
+			{
+				Lock lock{ _stripes[i] };
+				_stripes[i].map.clear();
+			}
+		}
+
+		/**
+		 * \brief Calls \p function with each key and value, one stripe
+		 * locked at a time
+		 */
+		template<typename Function>
+		void forEach(Function function) const
+		{
+			for (std::size_t i = 0; i < stripes(); ++i)
+			{
+				Lock lock{ _stripes[i] };
+
+				for (const auto& entry : _stripes[i].map)
+				{
+					function(entry.first, entry.second);
+				}
+			}
+		}
+
+		std::size_t stripes() const
+		{
+			return std::size_t{ 1 } << _stripeBits;
+		}
+
+	private:
+		struct alignas(64) Stripe
+		{
+			std::atomic<bool> locked{ false };
+			std::unordered_map<Key, Value, Hash, KeyEqual> map;
+		};
+
+		class Lock
+		{
+		public:
+			explicit Lock(Stripe& stripe) :
+				_stripe{ stripe }
+			{
+				while (_stripe.locked.exchange(true, std::memory_order_acquire))
+				{
+					while (_stripe.locked.load(std::memory_order_relaxed))
+					{
+						std::this_thread::yield();
+					}
+				}
+			}
+
+			~Lock()
+			{
+				_stripe.locked.store(false, std::memory_order_release);
+			}
+
+		private:
+			Stripe& _stripe;
+		};
+
+		std::size_t _stripeBits;
+		std::unique_ptr<Stripe[]> _stripes;
+		Hash _hash;
+
+		Stripe& stripeOf(const Key& key) const
+		{
+			// The unordered maps use the low bits of the same hash, mix it so
+			// keys of a stripe still spread over the buckets of its map
+			std::uint64_t hash = static_cast<std::uint64_t>(_hash(key)) * 0x9E3779B97F4A7C15ull;
+			return _stripes[_stripeBits == 0 ? 0 : hash >> (64 - _stripeBits)];
+		}
+	};
+}
+#endif
@@ -5,9 +5,51 @@
 
 #include "Worker.hpp"
 #include "StaticVector.hpp"
+#include "Reactor.hpp"
+#include "BlockingPool.hpp"
+#include "Schedule.hpp"
 #include <random>
+#include <limits>
+#include <deque>
+#include <mutex>
 
 namespace TaskSystem {
+	/**
+	 * \brief Bounds and thresholds of the elastic scaling of background workers
+	 *
+	 * See `Engine::setScaling()`.
+	 */
+	struct ScalingOptions
+	{
+		/**
+		 * \brief Workers never parked, the foreground worker included
+		 */
+		std::size_t minWorkers = 1;
+
+		/**
+		 * \brief Workers allowed to run at once, the foreground worker included
+		 */
+		std::size_t maxWorkers = std::numeric_limits<std::size_t>::max();
+
+		/**
+		 * \brief Consecutive cycles without finding a task (failed steals
+		 * included) after which a background worker parks
+		 */
+		std::size_t parkIdleCycles = 4096;
+
+		/**
+		 * \brief Share of the steals of those cycles that must have found the victim
+		 * queue empty. Steals losing races against other thieves mean there is still
+		 * work to take, the worker keeps looking
+		 */
+		float parkStealFailureRate = 0.75f;
+
+		/**
+		 * \brief Queue depth above which submitting a task wakes a parked worker
+		 */
+		std::size_t activateQueueDepth = 0;
+	};
+
 	class Worker;
 	class Engine
 	{
@@ -28,16 +70,138 @@ namespace TaskSystem {
 		 * \param tasksPerThread Maximum number of tasks that can be allocated by
 		 * thread. Once this limit is reached, the worker stops returning storage
 		 * for more tasks, which means no more tasks can be submitted to the worker.
+		 * \param taskSize Size class of the tasks allocated by the workers. See `TaskSize`.
+		 * \param poolGenerations Number of generations of \p tasksPerThread tasks
+		 * each worker pool is split in. See `beginFrame()`.
+		 * \param scheduling Seeding, simulation and record/replay options. See `SchedulingOptions`.
 		 */
 		Engine(
 			const std::size_t               workerThreads,
 			const std::vector<std::size_t>& tasksPerThread,
-			const std::size_t               fallbackTasksPerThread);
+			const std::size_t               fallbackTasksPerThread,
+			const TaskSize                  taskSize = TaskSize::Default,
+			const std::size_t               poolGenerations = 1,
+			const SchedulingOptions&        scheduling = SchedulingOptions{});
 
-		Engine(const std::size_t workerThreads, const std::size_t tasksPerThread);
+		Engine(const std::size_t workerThreads, const std::size_t tasksPerThread,
+			const TaskSize taskSize = TaskSize::Default,
+			const std::size_t poolGenerations = 1,
+			const SchedulingOptions& scheduling = SchedulingOptions{});
 
 		Engine(const Engine&) = delete;
 
+		/**
+		 * \brief Stops all the workers, discarding the tasks left in their queues
+		 *
+		 * Same as `shutdown()` with a deadline already passed: the workers stop
+		 * without taking more tasks, and the tasks left in their queues, in the
+		 * engine and in the blocking pool are discarded in the caller thread (See
+		 * `Task::discard()`), so their parents finish and threads blocked on them
+		 * are released. Draining is not the default because it may never return,
+		 * e.g. with periodic tasks, and the engine may be destroyed while unwinding
+		 * from an exception. Call `drain()` or `shutdown()` with a later deadline
+		 * first to run queued work on the workers.
+		 */
+		~Engine();
+
+		/**
+		 * \brief Runs tasks until all the work queues are empty and no worker is
+		 * running a task
+		 *
+		 * Must be called from the thread that created the engine, outside of any task.
+		 * The caller helps running tasks meanwhile. Tasks submitted to the blocking
+		 * pool count as queued work until a thread picks them up; tasks waiting for a
+		 * timer, an I/O operation or the reactor do not.
+		 */
+		void drain();
+
+		/**
+		 * \brief Like `drain()`, but gives up once \p deadline is reached
+		 *
+		 * \returns true if the engine was drained, false if the deadline was reached first
+		 */
+		bool drainUntil(std::chrono::steady_clock::time_point deadline);
+
+		/**
+		 * \brief Drains the engine until \p deadline and then stops all the workers
+		 *
+		 * Tasks still queued once the workers are stopped are discarded (See
+		 * `Task::discard()`), so their parents finish and waiters are released.
+		 * So are the tasks left in the blocking pool and the continuations of the ones
+		 * running, once they are done (See `BlockingPool::discardPending()`).
+		 * The engine can be started again with `restart()`.
+		 *
+		 * \returns true if all the work was done before the deadline
+		 */
+		bool shutdown(std::chrono::steady_clock::time_point deadline =
+			std::chrono::steady_clock::time_point::max());
+
+		/**
+		 * \brief Drains and stops the engine, then starts \p workerThreads new workers
+		 *
+		 * Must be called from the thread that created the engine, outside of any task,
+		 * while no other thread uses the engine. Workers keep the pool sizes and
+		 * options the engine was created with. Pointers to workers and to tasks allocated
+		 * before the restart are invalidated.
+		 *
+		 * \returns true if all the work was done before restarting
+		 */
+		bool restart(std::size_t workerThreads);
+
+		/**
+		 * \brief Pauses all the background workers once they finish their current task
+		 *
+		 * Returns once all of them are parked. Tasks can still be submitted, and are run
+		 * by the foreground worker while it waits. See `Worker::pause()`.
+		 */
+		void pause();
+
+		/**
+		 * \brief Resumes the workers paused with `pause()`
+		 */
+		void resume();
+
+		/**
+		 * \brief Lets background workers park when there is no work, and wakes them
+		 * when queues fill up again
+		 *
+		 * A background worker parks once it runs `ScalingOptions::parkIdleCycles`
+		 * cycles in a row without finding a task, most of its steals finding the
+		 * victim queue empty (See `ScalingOptions::parkStealFailureRate`), as long
+		 * as more than `minWorkers` workers are active, or as soon as it runs out
+		 * of tasks while more than `maxWorkers` are. Submitting a task
+		 * to a queue deeper than `activateQueueDepth` wakes a parked worker, up to
+		 * `maxWorkers`. Parked workers still wake up every few milliseconds, and when
+		 * their timers are due, to poll events.
+		 *
+		 * By default no worker is ever parked. Not thread safe, call it from the
+		 * thread that created the engine.
+		 */
+		void setScaling(const ScalingOptions& scaling);
+
+		/**
+		 * \brief Sets what happens when a worker pool or queue is full
+		 *
+		 * Applies to the pools of all the workers and to their queues. The default,
+		 * `OverflowPolicy::Discard`, keeps the behavior of bounded pools and queues:
+		 * allocations return nullptr and tasks that do not fit are discarded.
+		 * Thread safe, workers pick the new policy up on their next overflow.
+		 */
+		void setOverflowPolicy(OverflowPolicy policy);
+		OverflowPolicy overflowPolicy() const;
+
+		/**
+		 * \brief Returns the overflow counters of all the workers summed up
+		 *
+		 * Read it once the engine is quiescent, like `totalTasksRun()`.
+		 */
+		OverflowCounters overflowCounters() const;
+
+		/**
+		 * \brief Returns the number of workers not parked, the foreground worker included
+		 */
+		std::size_t activeWorkers() const;
+
 		/**
 		 * \brief Returns one of the workers, randomnly picked from all
 		 * the available workers in the engine
@@ -48,6 +212,11 @@ namespace TaskSystem {
 		 */
 		Worker* randomWorker();
 
+		/**
+		 * \brief Returns the worker with the given index, nullptr if out of range
+		 */
+		Worker* worker(const std::size_t index);
+
 		/**
 		 * \brief Returns the worker associated to a given thread
 		 *
@@ -63,6 +232,81 @@ namespace TaskSystem {
 		 */
 		Worker* threadWorker();
 
+		/**
+		 * \brief Waits until \p task is finished
+		 *
+		 * If the caller thread is a worker thread the worker keeps running tasks
+		 * while waiting (See `Worker::wait()`). Otherwise the caller thread is
+		 * parked until the task finishes (See `Task::blockUntilFinished()`).
+		 *
+		 * \throws The exception thrown by the task, if it failed (See `Task::takeException()`)
+		 */
+		void wait(Task* task);
+
+		/**
+		 * \brief Like `wait()`, but gives up once \p timeout expires
+		 *
+		 * \returns true if the task finished, false if the timeout expired first.
+		 */
+		template<typename Rep, typename Period>
+		bool waitFor(Task* task, const std::chrono::duration<Rep, Period>& timeout)
+		{
+			Worker* worker = threadWorker();
+
+			if (worker != nullptr)
+			{
+				return worker->waitFor(task, timeout);
+			}
+			else
+			{
+				return task->blockUntilFinishedFor(
+					std::chrono::duration_cast<std::chrono::nanoseconds>(timeout));
+			}
+		}
+
+		/**
+		 * \brief Submits \p task from any thread
+		 *
+		 * Worker threads submit it to their own worker (See `Worker::submit()`).
+		 * Other threads queue it in the engine, where the first worker running out
+		 * of tasks takes it, and wake up a parked worker. Thread safe.
+		 */
+		void submit(Task* task);
+
+		/**
+		 * \brief Submits \p task to the caller thread worker once \p delay has elapsed
+		 *
+		 * See `Worker::submitAfter()`. The caller thread must be a worker thread.
+		 *
+		 * \returns The timer id, `TimerWheel::INVALID_TIMER` if the caller is not a worker
+		 */
+		TimerWheel::TimerId submitAfter(TimerWheel::Clock::duration delay, Task* task);
+
+		/**
+		 * \brief Submits \p task to the caller thread worker every \p period
+		 *
+		 * See `Worker::submitEvery()`. The caller thread must be a worker thread.
+		 *
+		 * \returns The timer id, `TimerWheel::INVALID_TIMER` if the caller is not a worker
+		 */
+		TimerWheel::TimerId submitEvery(TimerWheel::Clock::duration period, Task* task);
+
+		/**
+		 * \brief Cancels a timer scheduled from the caller thread worker
+		 */
+		bool cancelTimer(TimerWheel::TimerId id);
+
+		/**
+		 * \brief Runs \p task in the blocking pool instead of in a worker
+		 *
+		 * Use it for tasks calling blocking code, so they do not stall the workers.
+		 * Thread safe. See `BlockingPool`.
+		 *
+		 * \param continuation Task submitted to one of the workers once \p task is run,
+		 * can be nullptr. Waiting for \p task itself (or its parent) also works.
+		 */
+		void submitBlocking(Task* task, Task* continuation = nullptr);
+
 		/**
 		 * \brief Returns the total number of tasks run by the engine
 		 */
@@ -71,10 +315,92 @@ namespace TaskSystem {
 
 		const StaticVector<Worker>& workers() const;
 
+		/**
+		 * \brief Returns the readiness reactor of the engine
+		 *
+		 * Workers poll the reactor when idle, so continuations of ready file
+		 * descriptors run on the engine workers with no extra threads involved.
+		 * See `Reactor::watch()`.
+		 */
+		Reactor& reactor();
+
+		BlockingPool& blockingPool();
+
+		/**
+		 * \brief Returns the scheduling decisions recorded so far
+		 *
+		 * Only filled if `SchedulingOptions::record` was set. Read it once the engine
+		 * is quiescent (e.g. after waiting for the root task), workers append to it
+		 * while running.
+		 */
+		const Schedule& recordedSchedule() const;
+
+		/**
+		 * \brief Starts a new frame
+		 *
+		 * Each worker moves its pool to the next generation the next time it
+		 * accesses it, as soon as all the tasks allocated from that generation
+		 * are finished (See `Pool::beginGeneration()`). With two generations, tasks
+		 * of a frame can be allocated while the ones of the previous frame are still
+		 * running, and no pool has to be cleared by hand.
+		 */
+		void beginFrame();
+
+		/**
+		 * \brief Returns the number of frames begun so far
+		 */
+		std::size_t frame() const;
+
+		/**
+		 * \brief Checks whether the engine runs in simulation mode
+		 */
+		bool simulation() const;
+
 	private:
+		// Declared before the workers so they outlive them
+		Reactor                               _reactor;
+		BlockingPool                          _blockingPool;
+		SchedulingOptions                     _scheduling;
+		Schedule                              _recordedSchedule;
 		StaticVector<Worker>                  _workers;
-		std::default_random_engine                 _randomEngine;
-		std::uniform_int_distribution<std::size_t> _dist;
+		Worker*                               _simulatedWorker;
+		std::uint64_t                         _simulationRandomState;
+		std::size_t                           _replayStep;
+		std::atomic<std::size_t>              _frame;
+
+		std::vector<std::size_t>              _tasksPerThread;
+		std::size_t                           _fallbackTasksPerThread;
+		TaskSize                              _taskSize;
+		std::size_t                           _poolGenerations;
+		std::uint64_t                         _seed;
+		std::size_t                           _workersGeneration;
+		// ScalingOptions, read by the workers while setScaling() may change them
+		struct
+		{
+			std::atomic<std::size_t> minWorkers;
+			std::atomic<std::size_t> maxWorkers;
+			std::atomic<std::size_t> parkIdleCycles;
+			std::atomic<float> parkStealFailureRate;
+			std::atomic<std::size_t> activateQueueDepth;
+		}                                     _scaling;
+		std::atomic<OverflowPolicy>           _overflowPolicy;
+		std::atomic<std::size_t>              _activeWorkers;
+		std::atomic<std::size_t>              _parkedWorkers;
+		// Tasks submitted from threads that are not workers, See `submit()`
+		std::mutex                            _injectedMutex;
+		std::deque<Task*>                     _injected;
+		std::atomic<std::size_t>              _injectedTasks;
+
+		friend class Worker;
+		void simulateStep();
+		void createWorkers(std::size_t workerThreads);
+		std::uint64_t nextSeed();
+		bool idle() const;
+		bool shouldPark(Worker& worker);
+		void unpark(Worker& worker);
+		void activateWorker();
+		Task* takeInjected();
+		std::size_t discardInjected();
 	};
 }
 #endif // !ENGINE_H
@@ -0,0 +1,330 @@
+#ifndef TASKSYSTEM_FLOWGRAPH_HPP
+#define TASKSYSTEM_FLOWGRAPH_HPP
+
+#pragma once
+#include "Task.hpp"
+#include <any>
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <limits>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace TaskSystem {
+	class Engine;
+
+	/**
+	 * \brief Dataflow graph of nodes exchanging messages
+	 *
+	 * Nodes are created by the graph and connected with `connect()`, at any time,
+	 * also while messages flow. Function nodes run their body in a task scheduled
+	 * on the engine workers for each message they accept, the other nodes route
+	 * messages in the thread delivering them.
+	 *
+	 * A node refuses a message it has no room for (`Node::tryPut()` returns false),
+	 * which is how bounded nodes apply backpressure. Nodes holding messages (buffers,
+	 * function node outputs and joins) keep a refused message and offer it again once
+	 * the successor has room, so their own bounds fill up in turn and the refusal
+	 * reaches the producers. Nodes that do not hold messages drop refused ones.
+	 *
+	 * A message held by a node goes to the first successor accepting it, in
+	 * connection order; use a broadcast node to send copies to all of them.
+	 * Graphs must be acyclic.
+	 *
+	 * \code
+	 * FlowGraph graph{ engine };
+	 * auto& input = graph.buffer(64);
+	 * auto& parse = graph.function(4, [](const FlowGraph::Message& m) { return FlowGraph::Message{ parse(m) }; });
+	 * FlowGraph::connect(input, parse);
+	 * graph.put(input, FlowGraph::Message{ line });
+	 * graph.wait();
+	 * \endcode
+	 */
+	class FlowGraph
+	{
+	public:
+		using Message = std::any;
+
+		static constexpr const std::size_t UNBOUNDED = std::numeric_limits<std::size_t>::max();
+
+		class Node
+		{
+		public:
+			virtual ~Node();
+
+			Node(const Node&) = delete;
+			Node& operator=(const Node&) = delete;
+
+			/**
+			 * \brief Offers a message to the node
+			 *
+			 * \returns false if the node has no room for the message, the
+			 * caller keeps it and may try again later (See `FlowGraph::put()`)
+			 */
+			bool tryPut(const Message& message);
+
+			FlowGraph& graph();
+
+		protected:
+			explicit Node(FlowGraph& graph);
+
+			/**
+			 * \brief Accepts or refuses a message. \p from is the predecessor
+			 * offering it, nullptr for producers outside the graph
+			 */
+			virtual bool accept(const Message& message, Node* from) = 0;
+
+			/**
+			 * \brief Called by a successor that refused a message of this
+			 * node and has room again
+			 *
+			 * Nodes holding messages offer them again (See `forward()`), the
+			 * others pass the call on to the predecessors they refused.
+			 */
+			virtual void retry();
+
+			/**
+			 * \brief Offers held messages to the successors until one refuses,
+			 * called by `forward()` in one thread at a time
+			 */
+			virtual void deliver();
+
+			/**
+			 * \brief Runs `deliver()` in the caller thread, unless another thread
+			 * is delivering already, in which case that thread delivers once more
+			 */
+			void forward();
+
+			// Gives the message to the first successor accepting it
+			bool offer(const Message& message);
+			// Gives a copy of the message to every successor
+			void offerAll(const Message& message);
+
+			// Remembers a predecessor refused, so it is retried once there is
+			// room. Called with the node state locked, in the same critical
+			// section deciding the refusal
+			void block(Node* from);
+			// Called once the node made room, wakes the producers parked in put()
+			std::vector<Node*> takeBlocked();
+			static void retryAll(const std::vector<Node*>& nodes);
+
+			FlowGraph& _graph;
+			std::mutex _mutex;
+
+		private:
+			// Copied on write so messages flow while the graph is edited
+			std::shared_ptr<const std::vector<Node*>> _successors;
+			std::vector<Node*> _blocked;
+			std::atomic<std::size_t> _forwardRequests;
+
+			friend class FlowGraph;
+		};
+
+		/**
+		 * \brief Runs a function on each message, up to `concurrency` messages at once
+		 *
+		 * Each accepted message runs in its own task. Messages arriving while all the
+		 * tasks are busy wait in a queue of `capacity` messages, and are refused when
+		 * it is full. The message returned by the body, if not empty, is sent to the
+		 * successors; a task whose result is refused keeps its slot until the result
+		 * is delivered, so a blocked successor throttles the node.
+		 */
+		class FunctionNode : public Node
+		{
+		public:
+			/**
+			 * \brief Returns the message to send to the successors, an empty one to send nothing
+			 */
+			using Body = std::function<Message(const Message&)>;
+
+			FunctionNode(FlowGraph& graph, std::size_t concurrency, Body body, std::size_t capacity);
+			~FunctionNode() override;
+
+		protected:
+			bool accept(const Message& message, Node* from) override;
+			void retry() override;
+			void deliver() override;
+
+		private:
+			struct Slot;
+
+			Body _body;
+			std::size_t _capacity;
+			std::vector<std::unique_ptr<Slot>> _slots;
+			std::vector<Slot*> _freeSlots;
+			std::deque<Message> _queue;
+			// Slots holding a result refused by the successors, in completion order
+			std::deque<Slot*> _results;
+
+			static void slotTask(void* slot);
+			void process(Slot& slot);
+			void release(Slot& slot);
+			void schedule(Slot& slot);
+			bool finished() const;
+			void blockUntilFinished();
+
+			friend class FlowGraph;
+		};
+
+		/**
+		 * \brief Sends a copy of each message to all the successors, dropping the
+		 * copies they refuse. Never refuses messages
+		 */
+		class BroadcastNode : public Node
+		{
+		public:
+			explicit BroadcastNode(FlowGraph& graph);
+
+		protected:
+			bool accept(const Message& message, Node* from) override;
+		};
+
+		/**
+		 * \brief First in first out queue of up to `capacity` messages
+		 */
+		class BufferNode : public Node
+		{
+		public:
+			BufferNode(FlowGraph& graph, std::size_t capacity);
+
+			std::size_t size();
+
+		protected:
+			bool accept(const Message& message, Node* from) override;
+			void retry() override;
+			void deliver() override;
+
+		private:
+			std::size_t _capacity;
+			std::deque<Message> _messages;
+		};
+
+		/**
+		 * \brief Lets at most `threshold` messages through until `release()` is called
+		 *
+		 * Typically released by a node downstream once done with a message, which
+		 * bounds the messages in flight between the limiter and that node.
+		 */
+		class LimiterNode : public Node
+		{
+		public:
+			LimiterNode(FlowGraph& graph, std::size_t threshold);
+
+			/**
+			 * \brief Lets \p count more messages through
+			 */
+			void release(std::size_t count = 1);
+
+		protected:
+			bool accept(const Message& message, Node* from) override;
+			void retry() override;
+
+		private:
+			std::size_t _threshold;
+			std::size_t _passed;
+			// Incremented on retry(), so a refusal racing with a successor
+			// making room is noticed
+			std::atomic<std::uint64_t> _retries;
+		};
+
+		/**
+		 * \brief Waits for a message on each of its inputs and sends them together
+		 *
+		 * Messages are paired in arrival order. The message sent holds a
+		 * `std::vector<Message>` with one message per input, in input order:
+		 * `std::any_cast<const std::vector<FlowGraph::Message>&>(message)`.
+		 * Each input queues up to `capacity` messages.
+		 */
+		class JoinNode : public Node
+		{
+		public:
+			JoinNode(FlowGraph& graph, std::size_t inputs, std::size_t capacity);
+			~JoinNode() override;
+
+			/**
+			 * \brief Returns the node to connect to input \p index
+			 */
+			Node& input(std::size_t index);
+
+		protected:
+			bool accept(const Message& message, Node* from) override;
+			void retry() override;
+			void deliver() override;
+
+		private:
+			class Input;
+
+			std::size_t _capacity;
+			std::vector<std::unique_ptr<Input>> _inputs;
+			std::vector<std::deque<Message>> _queues;
+		};
+
+		explicit FlowGraph(Engine& engine);
+		/**
+		 * \brief Waits for the running tasks, See `wait()`. Exceptions left are dropped
+		 */
+		~FlowGraph();
+
+		FlowGraph(const FlowGraph&) = delete;
+		FlowGraph& operator=(const FlowGraph&) = delete;
+
+		FunctionNode& function(std::size_t concurrency, FunctionNode::Body body, std::size_t capacity = UNBOUNDED);
+		BroadcastNode& broadcast();
+		BufferNode& buffer(std::size_t capacity = UNBOUNDED);
+		LimiterNode& limiter(std::size_t threshold);
+		JoinNode& join(std::size_t inputs, std::size_t capacity = UNBOUNDED);
+
+		/**
+		 * \brief Sends the messages of \p from to \p to, from now on. Thread safe
+		 */
+		static void connect(Node& from, Node& to);
+		static void disconnect(Node& from, Node& to);
+
+		/**
+		 * \brief Offers a message to \p node until it is accepted
+		 *
+		 * A worker thread calling it helps running tasks meanwhile, other threads
+		 * park until a node makes room. Function
+		 * node bodies should call `Node::tryPut()` instead, a task they help
+		 * running could wait for them.
+		 */
+		void put(Node& node, const Message& message);
+
+		/**
+		 * \brief Waits until no task of the graph is running
+		 *
+		 * Messages may still be held by nodes with nowhere to send them.
+		 * A worker thread calling it helps running tasks meanwhile, other
+		 * threads park on the tasks.
+		 *
+		 * \throws The first exception thrown by a function node body since the
+		 * last call, once the tasks are finished. Further ones are dropped
+		 */
+		void wait();
+
+		Engine& engine();
+
+	private:
+		Engine& _engine;
+		std::mutex _nodesMutex;
+		std::vector<std::unique_ptr<Node>> _nodes;
+		std::vector<FunctionNode*> _functionNodes;
+		std::mutex _errorMutex;
+		std::exception_ptr _error;
+		// Bumped each time a node makes room, See `put()`
+		std::atomic<std::int32_t> _progress;
+
+		template<typename T, typename... Args>
+		T& add(Args&& ... args);
+		// Keeps the first exception of a body for wait()
+		void fail(std::exception_ptr error);
+		bool idle();
+		void blockUntilIdle();
+		void progress();
+	};
+}
+#endif
@@ -0,0 +1,119 @@
+#ifndef TASKSYSTEM_FUTEX_HPP
+#define TASKSYSTEM_FUTEX_HPP
+
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace TaskSystem {
+	/**
+	 * \brief Thin wrapper over the OS address-based wait primitive
+	 *
+	 * Used to park threads that are not workers (and so cannot help running
+	 * tasks) until some atomic word changes. On Linux this is a private futex,
+	 * on Windows WaitOnAddress(). Other platforms fall back to yielding.
+	 */
+	namespace futex {
+		/**
+		 * \brief Blocks the caller thread while \p word holds \p expected
+		 *
+		 * May return spuriously, callers must re-check their condition.
+		 */
+		void wait(const std::atomic<std::int32_t>& word, std::int32_t expected);
+
+		/**
+		 * \brief Blocks the caller thread while \p word holds \p expected,
+		 * for at most \p timeout
+		 *
+		 * \returns false if the timeout expired, true otherwise. May return
+		 * spuriously, callers must re-check their condition.
+		 */
+		bool waitFor(const std::atomic<std::int32_t>& word, std::int32_t expected,
+			std::chrono::nanoseconds timeout);
+
+		/**
+		 * \brief Wakes one thread blocked on \p word
+		 */
+		void wakeOne(const std::atomic<std::int32_t>& word);
+
+		/**
+		 * \brief Wakes all the threads blocked on \p word
+		 */
+		void wakeAll(const std::atomic<std::int32_t>& word);
+
+		/**
+		 * \brief Wakes the threads waiting on \p word in `await()`, if there is any
+		 *
+		 * Meant to be called right after changing \p word with a plain store: the
+		 * threads about to wait issue a process wide barrier instead (See `Waiter`),
+		 * so the thread changing the word pays neither a fence nor a system call
+		 * while nobody waits. \p word is not accessed, the call is safe once the
+		 * storage of the word has been reused.
+		 */
+		void notify(const std::atomic<std::int32_t>& word);
+
+		/**
+		 * \brief Registers the caller thread as waiting on \p word for as long as it lives
+		 *
+		 * Registrations are counted in a fixed table of buckets indexed by address,
+		 * which `notify()` checks. See `await()`.
+		 */
+		class Waiter
+		{
+		public:
+			explicit Waiter(const std::atomic<std::int32_t>& word);
+			~Waiter();
+
+			Waiter(const Waiter&) = delete;
+			Waiter& operator=(const Waiter&) = delete;
+
+			/**
+			 * \brief Blocks the caller thread while the word holds \p expected, until
+			 * \p deadline at most
+			 *
+			 * Where the barrier of the registration is not available, the thread
+			 * wakes up every millisecond to re-check, a missed notification costs
+			 * no more than that. May return spuriously.
+			 *
+			 * \returns false if the deadline passed
+			 */
+			bool park(std::int32_t expected, std::chrono::steady_clock::time_point deadline);
+
+		private:
+			const std::atomic<std::int32_t>& _word;
+			bool _fenced;
+		};
+
+		/**
+		 * \brief Blocks the caller thread until \p done returns true, re-checking
+		 * it every time \p word is changed and notified (See `notify()`), or until
+		 * \p deadline
+		 *
+		 * \returns the last result of \p done
+		 */
+		template<typename Condition>
+		bool await(const std::atomic<std::int32_t>& word, Condition done,
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+		{
+			Waiter waiter{ word };
+
+			while (true)
+			{
+				// Loaded before checking, a change in between fails the park
+				const std::int32_t value = word.load(std::memory_order_acquire);
+
+				if (done())
+				{
+					return true;
+				}
+
+				if (!waiter.park(value, deadline))
+				{
+					return done();
+				}
+			}
+		}
+	}
+}
+#endif
@@ -0,0 +1,82 @@
+#ifndef TASKSYSTEM_HASHJOIN_HPP
+#define TASKSYSTEM_HASHJOIN_HPP
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace TaskSystem {
+	class Engine;
+
+	/**
+	 * \brief Row of the tables joined and aggregated, a key and a value
+	 */
+	struct Row
+	{
+		std::uint64_t key;
+		std::uint64_t payload;
+	};
+
+	struct JoinMatch
+	{
+		std::uint64_t key;
+		std::uint64_t buildPayload;
+		std::uint64_t probePayload;
+	};
+
+	struct Group
+	{
+		std::uint64_t key;
+		std::uint64_t count;
+		// Sum of the payloads of the rows of the group
+		std::uint64_t sum;
+	};
+
+	struct PartitionOptions
+	{
+		/**
+		 * \brief Bytes of hash table each partition aims for, the L2 size of the workers
+		 */
+		std::size_t cacheBytes = 1024 * 1024;
+
+		/**
+		 * \brief Partitions made by each pass, as a power of two. Past a few
+		 * hundred, scattering rows thrashes the TLB, so more partitions take a
+		 * second pass over each partition of the first one
+		 */
+		unsigned bitsPerPass = 8;
+
+		unsigned maxPasses = 2;
+	};
+
+	/**
+	 * \brief Joins the rows of \p build and \p probe with the same key, in parallel
+	 *
+	 * Both tables are radix partitioned on the hash of the keys, each pass
+	 * parallelized with `parallelFor()`, so that the hash table of each partition of
+	 * \p build fits in the worker caches. Each partition is then joined by its own
+	 * task, building a hash table from its \p build rows in the worker scratch arena
+	 * and probing it with its \p probe rows. Partitions far bigger than the others
+	 * (skewed keys) are probed by several tasks.
+	 *
+	 * \p build should be the smaller table. Matches are stored in \p matches, grouped
+	 * by partition.
+	 *
+	 * \returns The number of matches
+	 */
+	std::size_t hashJoin(Engine& engine, const std::vector<Row>& build, const std::vector<Row>& probe,
+		std::vector<JoinMatch>& matches, const PartitionOptions& options = {});
+
+	/**
+	 * \brief Counts and sums the payloads of the rows of each key, in parallel
+	 *
+	 * Rows are radix partitioned like in `hashJoin()`, then each partition is
+	 * aggregated by its own task. Partitions far bigger than the others are split in
+	 * chunks aggregated by different tasks, whose partial groups are merged after.
+	 * Groups are stored in \p groups, grouped by partition.
+	 */
+	void groupBy(Engine& engine, const std::vector<Row>& rows, std::vector<Group>& groups,
+		const PartitionOptions& options = {});
+}
+#endif
@@ -0,0 +1,147 @@
+#ifndef TASKSYSTEM_IORING_HPP
+#define TASKSYSTEM_IORING_HPP
+
+#pragma once
+#include "Task.hpp"
+#include <atomic>
+#include <cstdint>
+#include <vector>
+
+//one ring per worker NOT THREAD SAFE
+namespace TaskSystem {
+	/**
+	 * \brief Asynchronous file I/O queue based on Linux io_uring
+	 *
+	 * Tasks submit reads and writes together with a continuation task. The
+	 * continuation is handed back to the worker (See `poll()`) once the kernel
+	 * completes the operation, so no worker thread blocks on disk I/O.
+	 *
+	 * The ring is driven through raw syscalls, no liburing is needed. Requests
+	 * are batched and handed to the kernel on the next `poll()`, which workers call
+	 * from their idle loop (and every few tasks when busy). If io_uring is not
+	 * available (non Linux platforms, old kernels, seccomp filters) operations are
+	 * executed synchronously and their continuations are returned by the next `poll()`,
+	 * so callers do not need a separate code path.
+	 */
+	class IoRing
+	{
+	public:
+		/**
+		 * \param entries Size of the submission queue. Also the maximum number of
+		 * operations in flight.
+		 * \param asynchronous If false, io_uring is not even tried and operations
+		 * always run synchronously, like on platforms without io_uring.
+		 */
+		explicit IoRing(std::uint32_t entries = 256, bool asynchronous = true);
+		~IoRing();
+
+		IoRing(const IoRing&) = delete;
+		IoRing& operator=(const IoRing&) = delete;
+
+		/**
+		 * \brief Reads \p size bytes at \p offset of \p fd into \p buffer
+		 *
+		 * \param continuation Task submitted to the worker when the read completes.
+		 * \param result If not null, receives the number of bytes read, or a negated
+		 * errno value on error, before the continuation is submitted.
+		 *
+		 * \returns false if too many operations are in flight. The continuation is not
+		 * submitted in that case.
+		 */
+		bool read(int fd, void* buffer, std::uint32_t size, std::uint64_t offset,
+			Task* continuation, std::int32_t* result = nullptr);
+
+		/**
+		 * \brief Writes \p size bytes of \p buffer at \p offset of \p fd
+		 *
+		 * See `read()`.
+		 */
+		bool write(int fd, const void* buffer, std::uint32_t size, std::uint64_t offset,
+			Task* continuation, std::int32_t* result = nullptr);
+
+		/**
+		 * \brief Flushes \p fd to disk
+		 *
+		 * See `read()`.
+		 */
+		bool fsync(int fd, Task* continuation, std::int32_t* result = nullptr);
+
+		/**
+		 * \brief Hands queued operations to the kernel and collects completed ones
+		 *
+		 * \param callback Invoked as `callback(Task* continuation)` for each completed operation
+		 * \returns The number of completed operations
+		 */
+		template<typename Callback>
+		std::size_t poll(Callback callback)
+		{
+			if (_inFlight == 0)
+			{
+				return 0;
+			}
+
+			flush();
+
+			std::size_t completed = 0;
+			Task* continuation;
+
+			while ((continuation = nextCompletion()) != nullptr)
+			{
+				callback(continuation);
+				++completed;
+			}
+
+			return completed;
+		}
+
+		/**
+		 * \brief Returns the number of operations submitted and not returned by `poll()` yet
+		 */
+		std::size_t inFlight() const;
+
+		/**
+		 * \brief Checks whether operations go through io_uring or are run synchronously
+		 */
+		bool asynchronous() const;
+
+	private:
+		struct Request
+		{
+			Task* continuation;
+			std::int32_t* result;
+			std::int32_t value;
+			std::uint32_t next;
+		};
+
+		struct Ring
+		{
+			std::atomic<std::uint32_t>* head;
+			std::atomic<std::uint32_t>* tail;
+			std::uint32_t* array;
+			std::uint32_t mask;
+			void* mapping;
+			std::size_t mappingSize;
+		};
+
+		int _fd;
+		Ring _submissions;
+		Ring _completions;
+		void* _submissionEntries;
+		std::size_t _submissionEntriesSize;
+		void* _completionEntries;
+		std::uint32_t _entries;
+		std::uint32_t _unflushed;
+		std::size_t _inFlight;
+		std::vector<Request> _requests;
+		std::uint32_t _freeRequests;
+		std::vector<std::uint32_t> _ready;
+
+		bool submit(std::uint8_t operation, int fd, std::uint64_t address, std::uint32_t size,
+			std::uint64_t offset, Task* continuation, std::int32_t* result);
+		void flush();
+		Task* nextCompletion();
+		Task* complete(std::uint32_t request, std::int32_t result);
+		void setup();
+	};
+}
+#endif
@@ -0,0 +1,88 @@
+#ifndef TASKSYSTEM_OVERFLOW_HPP
+#define TASKSYSTEM_OVERFLOW_HPP
+
+#pragma once
+#include <cstddef>
+#include <stdexcept>
+
+namespace TaskSystem {
+	/**
+	 * \brief What happens when a task pool or a worker queue is full
+	 *
+	 * See `Engine::setOverflowPolicy()`.
+	 */
+	enum class OverflowPolicy
+	{
+		/**
+		 * \brief Full pools return nullptr, which `Worker::submit()` ignores, and
+		 * tasks submitted to a full queue are discarded (See `Task::discard()`).
+		 * The default, work is lost but waiters are released
+		 */
+		Discard,
+		/**
+		 * \brief Tasks submitted to a full queue run right away in the caller.
+		 * Full pools spill like under `Spill`: a pool does not know how its tasks
+		 * are run, returning nullptr would lose the ones submitted
+		 */
+		RunInline,
+		/**
+		 * \brief Submitting to a full queue runs queued tasks until the task fits.
+		 * Pool storage is only reclaimed a whole generation at a time, which running
+		 * tasks may keep alive, so the engine has full pools spill instead. Pools
+		 * reject it (See `Pool::setOverflowPolicy()`)
+		 */
+		HelpUntilSpace,
+		/**
+		 * \brief Full pools allocate tasks from overflow blocks, reclaimed with their
+		 * generation. Tasks submitted to a full queue go to the worker mailbox
+		 */
+		Spill,
+		/**
+		 * \brief Throws `OverflowError`. A task that does not fit the queue is
+		 * discarded first, so its parent and waiters are not left hanging. Tasks
+		 * submitted by the worker itself, as timers fire and I/O completes, have
+		 * nobody to throw to and spill instead
+		 */
+		Fail
+	};
+
+	/**
+	 * \brief Thrown when a pool or a queue is full under `OverflowPolicy::Fail`
+	 */
+	class OverflowError : public std::runtime_error
+	{
+	public:
+		using std::runtime_error::runtime_error;
+	};
+
+	/**
+	 * \brief Times pools and queues were full, and what was done about it
+	 */
+	struct OverflowCounters
+	{
+		// Allocations that found the pool full
+		std::size_t poolExhausted = 0;
+		// Submissions that found the worker queue full
+		std::size_t queueFull = 0;
+		// Null tasks submitted, usually failed allocations, and tasks discarded
+		std::size_t discarded = 0;
+		std::size_t ranInline = 0;
+		std::size_t helped = 0;
+		// Tasks allocated from overflow blocks or sent to the worker mailbox
+		std::size_t spilled = 0;
+		std::size_t failed = 0;
+
+		OverflowCounters& operator+=(const OverflowCounters& other)
+		{
+			poolExhausted += other.poolExhausted;
+			queueFull += other.queueFull;
+			discarded += other.discarded;
+			ranInline += other.ranInline;
+			helped += other.helped;
+			spilled += other.spilled;
+			failed += other.failed;
+			return *this;
+		}
+	};
+}
+#endif
@@ -0,0 +1,978 @@
+#ifndef TASKSYSTEM_PARALLEL_HPP
+#define TASKSYSTEM_PARALLEL_HPP
+
+#pragma once
+#include "Engine.hpp"
+#include "Scratch.hpp"
+#include "Simd.hpp"
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <array>
+#include <cassert>
+#include <functional>
+#include <iterator>
+#include <numeric>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+namespace TaskSystem {
+	/**
+	 * \brief Box of indices [begin[d], end[d]) along each dimension d
+	 */
+	template<std::size_t Dimensions>
+	struct BlockedRange
+	{
+		std::array<std::size_t, Dimensions> begin;
+		std::array<std::size_t, Dimensions> end;
+	};
+
+	using BlockedRange2d = BlockedRange<2>;
+	using BlockedRange3d = BlockedRange<3>;
+
+	namespace detail {
+		// Spawns a child nobody refers to once submitted, one finished
+		// inline is given back so deep splits do not exhaust the pool
+		inline void spawn(Worker* worker, Task* child)
+		{
+			if (worker->submit(child, SpawnPolicy::Auto))
+			{
+				worker->pool().release(child);
+			}
+		}
+
+		// Creates a task calling `Function(task, data)`. The data is stored in the
+		// task, or in the heap when the pool size class has no room for it (See
+		// `tasks::closure()`), so the algorithms still split on pools of small tasks
+		template<typename Data, void(*Function)(Task&, Data)>
+		Task* createTask(Worker* worker, const Data& data, Task* parent = nullptr)
+		{
+			Pool& pool = worker->pool();
+
+			if (sizeof(Data) <= pool.maxDataSize())
+			{
+				return pool.createTaskAsChild([](Task& task) { Function(task, task.getData<Data>()); }, data, parent);
+			}
+
+			return pool.createClosureTaskAsChild([data](Task& task) { Function(task, data); }, parent);
+		}
+
+		template<typename Body>
+		struct Loop
+		{
+			Engine* engine;
+			const Body* body;
+			std::size_t grain;
+		};
+
+		template<typename Body>
+		struct LoopRange
+		{
+			const Loop<Body>* loop;
+			std::size_t begin;
+			std::size_t end;
+		};
+
+		// Splits the range in halves, spawning the upper ones, until the
+		// lower one is no bigger than the grain and runs it
+		template<typename Body>
+		void loopTask(Task& task, LoopRange<Body> range)
+		{
+			const Loop<Body>& loop = *range.loop;
+			Worker* worker = loop.engine->threadWorker();
+
+			while (range.end - range.begin > loop.grain)
+			{
+				const std::size_t middle = range.begin + (range.end - range.begin) / 2;
+				Task* child = createTask<LoopRange<Body>, loopTask<Body>>(worker,
+					LoopRange<Body>{ &loop, middle, range.end }, &task);
+
+				if (child == nullptr)
+				{
+					// Out of tasks, the rest runs here
+					break;
+				}
+
+				spawn(worker, child);
+				range.end = middle;
+			}
+
+			(*loop.body)(range.begin, range.end);
+		}
+
+		inline std::size_t defaultGrain(Engine& engine, std::size_t size)
+		{
+			// A few chunks per worker, so thieves find work left when chunks
+			// take uneven time
+			return std::max<std::size_t>(size / (engine.workers().size() * 8), 1);
+		}
+
+		template<std::size_t Dimensions, typename Body>
+		struct Blocks
+		{
+			Engine* engine;
+			const Body* body;
+			BlockedRange<Dimensions> range;
+			std::array<std::size_t, Dimensions> grain;
+		};
+
+		// Offsets from the beginning of the whole range, 32 bits so a 3D block
+		// still fits the data of 64 byte tasks
+		template<std::size_t Dimensions, typename Body>
+		struct Block
+		{
+			const Blocks<Dimensions, Body>* blocks;
+			std::array<std::uint32_t, Dimensions> begin;
+			std::array<std::uint32_t, Dimensions> end;
+		};
+
+		// Dimension of the block furthest above its grain, or Dimensions when
+		// the block is no bigger than the grain along all of them
+		template<std::size_t Dimensions>
+		std::size_t longestDimension(const std::array<std::uint32_t, Dimensions>& begin,
+			const std::array<std::uint32_t, Dimensions>& end, const std::array<std::size_t, Dimensions>& grain)
+		{
+			std::size_t longest = Dimensions;
+
+			for (std::size_t dimension = 0; dimension < Dimensions; dimension++)
+			{
+				const std::size_t extent = end[dimension] - begin[dimension];
+
+				if (extent > grain[dimension] && (longest == Dimensions ||
+					extent * grain[longest] > (end[longest] - begin[longest]) * grain[dimension]))
+				{
+					longest = dimension;
+				}
+			}
+
+			return longest;
+		}
+
+		// Halves the longest dimension, spawning the upper halves, until the
+		// lower block is within the grain and runs it. The lower halves are run
+		// first and the last upper one spawned is popped next, so blocks run in
+		// Z-order and neighbours share the caches
+		template<std::size_t Dimensions, typename Body>
+		void blockTask(Task& task, Block<Dimensions, Body> block)
+		{
+			const Blocks<Dimensions, Body>& blocks = *block.blocks;
+			Worker* worker = blocks.engine->threadWorker();
+
+			for (std::size_t dimension = longestDimension(block.begin, block.end, blocks.grain); dimension < Dimensions;
+				dimension = longestDimension(block.begin, block.end, blocks.grain))
+			{
+				Block<Dimensions, Body> upper = block;
+				upper.begin[dimension] = block.begin[dimension] + (block.end[dimension] - block.begin[dimension]) / 2;
+				Task* child = createTask<Block<Dimensions, Body>, blockTask<Dimensions, Body>>(worker, upper, &task);
+
+				if (child == nullptr)
+				{
+					// Out of tasks, the rest runs here
+					break;
+				}
+
+				spawn(worker, child);
+				block.end[dimension] = upper.begin[dimension];
+			}
+
+			BlockedRange<Dimensions> range;
+
+			for (std::size_t dimension = 0; dimension < Dimensions; dimension++)
+			{
+				range.begin[dimension] = blocks.range.begin[dimension] + block.begin[dimension];
+				range.end[dimension] = blocks.range.begin[dimension] + block.end[dimension];
+			}
+
+			(*blocks.body)(range);
+		}
+
+		// Halves the largest grain until there are a few blocks per worker
+		template<std::size_t Dimensions>
+		std::array<std::size_t, Dimensions> defaultGrain(Engine& engine, const BlockedRange<Dimensions>& range)
+		{
+			std::array<std::size_t, Dimensions> grain;
+
+			for (std::size_t dimension = 0; dimension < Dimensions; dimension++)
+			{
+				grain[dimension] = std::max<std::size_t>(range.end[dimension] - range.begin[dimension], 1);
+			}
+
+			for (std::size_t blocks = 1; blocks < engine.workers().size() * 8; blocks *= 2)
+			{
+				std::size_t& largest = *std::max_element(grain.begin(), grain.end());
+
+				if (largest == 1)
+				{
+					break;
+				}
+
+				largest = (largest + 1) / 2;
+			}
+
+			return grain;
+		}
+
+		template<std::size_t Dimensions, typename Body>
+		void parallelForBlocks(Engine& engine, const BlockedRange<Dimensions>& range,
+			std::array<std::size_t, Dimensions> grain, const Body& body)
+		{
+			Block<Dimensions, Body> rootBlock{};
+			bool split = false;
+
+			for (std::size_t dimension = 0; dimension < Dimensions; dimension++)
+			{
+				if (range.begin[dimension] >= range.end[dimension])
+				{
+					return;
+				}
+
+				assert(range.end[dimension] - range.begin[dimension] <= UINT32_MAX);
+				rootBlock.end[dimension] = static_cast<std::uint32_t>(range.end[dimension] - range.begin[dimension]);
+				grain[dimension] = std::max<std::size_t>(grain[dimension], 1);
+				split = split || rootBlock.end[dimension] > grain[dimension];
+			}
+
+			Worker* worker = engine.threadWorker();
+			const Blocks<Dimensions, Body> blocks{ &engine, &body, range, grain };
+			Task* root = nullptr;
+
+			if (worker != nullptr && split)
+			{
+				rootBlock.blocks = &blocks;
+				root = createTask<Block<Dimensions, Body>, blockTask<Dimensions, Body>>(worker, rootBlock);
+			}
+
+			if (root == nullptr)
+			{
+				body(range);
+				return;
+			}
+
+			worker->submit(root);
+			worker->wait(root);
+		}
+
+		template<typename T>
+		constexpr bool vectorReducible = std::is_same_v<T, std::int32_t> || std::is_same_v<T, float> ||
+			std::is_same_v<T, double>;
+
+		template<typename T, typename Compare>
+		constexpr bool vectorSortable = std::is_same_v<Compare, std::less<T>> &&
+			(std::is_same_v<T, std::int32_t> || std::is_same_v<T, float>);
+
+		template<typename T>
+		auto leafSum(const T* data, std::size_t size)
+		{
+			if constexpr (vectorReducible<T>)
+			{
+				return simd::sum(data, size);
+			}
+			else
+			{
+				return std::accumulate(data, data + size, T{});
+			}
+		}
+
+		template<typename T>
+		T leafMin(const T* data, std::size_t size)
+		{
+			if constexpr (vectorReducible<T>)
+			{
+				return simd::min(data, size);
+			}
+			else
+			{
+				return *std::min_element(data, data + size);
+			}
+		}
+
+		template<typename T>
+		T leafMax(const T* data, std::size_t size)
+		{
+			if constexpr (vectorReducible<T>)
+			{
+				return simd::max(data, size);
+			}
+			else
+			{
+				return *std::max_element(data, data + size);
+			}
+		}
+
+		template<typename T, typename Compare>
+		struct Sort
+		{
+			Engine* engine;
+			const Compare* compare;
+			std::size_t grain;
+		};
+
+		template<typename T, typename Compare>
+		struct SortRange
+		{
+			const Sort<T, Compare>* sort;
+			T* data;
+			std::size_t size;
+			// Splits left before falling back to std::sort, against pivots
+			// picked badly over and over
+			unsigned depth;
+		};
+
+		// Smallest range sorted by tasks of their own, below it splitting costs
+		// more than sorting
+		constexpr const std::size_t SORT_GRAIN = 2048;
+
+		inline unsigned sortDepth(std::size_t size)
+		{
+			unsigned depth = 0;
+
+			for (; size > 1; size >>= 1)
+			{
+				depth += 2;
+			}
+
+			return depth;
+		}
+
+		template<typename T, typename Compare>
+		T medianOfThree(const T* data, std::size_t size, const Compare& compare)
+		{
+			T first = data[0], middle = data[size / 2], last = data[size - 1];
+
+			if (compare(middle, first))
+			{
+				std::swap(first, middle);
+			}
+
+			if (compare(last, middle))
+			{
+				std::swap(middle, last);
+
+				if (compare(middle, first))
+				{
+					std::swap(first, middle);
+				}
+			}
+
+			return middle;
+		}
+
+		// Partitions around a median of three. Returns the size of the lower
+		// part and where the upper part begins, after the elements equal to
+		// the pivot when none is less than it
+		template<typename T, typename Compare>
+		std::pair<std::size_t, std::size_t> splitAround(T* data, std::size_t size, const Compare& compare)
+		{
+			const T pivot = medianOfThree(data, size, compare);
+			std::size_t less;
+
+			if constexpr (vectorSortable<T, Compare>)
+			{
+				less = simd::partition(data, size, pivot);
+			}
+			else
+			{
+				less = std::partition(data, data + size, [&](const T& value) { return compare(value, pivot); }) - data;
+			}
+
+			if (less != 0)
+			{
+				return { less, less };
+			}
+
+			// The pivot is one of the elements, so at least it is skipped
+			const std::size_t equal = std::partition(data, data + size,
+				[&](const T& value) { return !compare(pivot, value); }) - data;
+			return { 0, equal };
+		}
+
+		template<typename T, typename Compare>
+		void sortLeaf(T* data, std::size_t size, const Compare& compare, unsigned depth)
+		{
+			if constexpr (vectorSortable<T, Compare>)
+			{
+				while (size > simd::SMALL_SORT_SIZE)
+				{
+					if (depth == 0)
+					{
+						std::sort(data, data + size, compare);
+						return;
+					}
+
+					const auto [lower, upper] = splitAround(data, size, compare);
+					depth--;
+
+					// Recursing into the smaller part bounds the stack depth
+					if (lower < size - upper)
+					{
+						sortLeaf(data, lower, compare, depth);
+						data += upper;
+						size -= upper;
+					}
+					else
+					{
+						sortLeaf(data + upper, size - upper, compare, depth);
+						size = lower;
+					}
+				}
+
+				simd::sortSmall(data, size);
+			}
+			else
+			{
+				std::sort(data, data + size, compare);
+			}
+		}
+
+		// Partitions the range, spawning the upper parts, until the lower one
+		// is no bigger than the grain and sorts it
+		template<typename T, typename Compare>
+		void sortTask(Task& task, SortRange<T, Compare> range)
+		{
+			const Sort<T, Compare>& sort = *range.sort;
+			Worker* worker = sort.engine->threadWorker();
+
+			while (range.size > sort.grain && range.depth > 0)
+			{
+				const auto [lower, upper] = splitAround(range.data, range.size, *sort.compare);
+				range.depth--;
+
+				if (upper < range.size)
+				{
+					const SortRange<T, Compare> upperRange{ &sort, range.data + upper, range.size - upper, range.depth };
+					Task* child = createTask<SortRange<T, Compare>, sortTask<T, Compare>>(worker, upperRange, &task);
+
+					if (child != nullptr)
+					{
+						spawn(worker, child);
+					}
+					else
+					{
+						// Out of tasks, the upper part is sorted here
+						sortLeaf(upperRange.data, upperRange.size, *sort.compare, upperRange.depth);
+					}
+				}
+
+				range.size = lower;
+			}
+
+			sortLeaf(range.data, range.size, *sort.compare, range.depth);
+		}
+
+		// Smallest run merged or partitioned by a chunk of its own
+		constexpr const std::size_t MERGE_GRAIN = 4096;
+
+		/**
+		 * \brief Co-ranking: returns how many of the first \p rank elements of
+		 * the stable merge of \p first and \p second come from \p first
+		 */
+		template<typename T, typename Compare>
+		std::size_t coRank(std::size_t rank, const T* first, std::size_t firstSize,
+			const T* second, std::size_t secondSize, const Compare& compare)
+		{
+			std::size_t low = rank > secondSize ? rank - secondSize : 0;
+			std::size_t high = std::min(rank, firstSize);
+
+			while (low < high)
+			{
+				const std::size_t taken = low + (high - low) / 2;
+
+				// Ties come from the first run, so first[taken] still belongs
+				// in the merge when it is not greater than second[rank - taken - 1]
+				if (!compare(second[rank - taken - 1], first[taken]))
+				{
+					low = taken + 1;
+				}
+				else
+				{
+					high = taken;
+				}
+			}
+
+			return low;
+		}
+
+		// Merges the runs of \p width of \p source into runs twice as wide in
+		// \p destination, each chunk of the output co-ranked and merged on its own
+		template<typename T, typename Compare>
+		void mergeRuns(Engine& engine, T* source, T* destination, std::size_t size, std::size_t width,
+			std::size_t chunk, const Compare& compare)
+		{
+			parallelFor(engine, 0, (size + chunk - 1) / chunk, 1, [&](std::size_t firstChunk, std::size_t lastChunk) {
+				for (std::size_t index = firstChunk; index < lastChunk; index++)
+				{
+					// Runs are multiples of the chunk, so a chunk never spans two merges
+					const std::size_t begin = index * chunk, end = std::min(begin + chunk, size);
+					const std::size_t base = begin / (2 * width) * (2 * width);
+					const T* first = source + base;
+					const std::size_t firstSize = std::min(width, size - base);
+					const T* second = first + firstSize;
+					const std::size_t secondSize = std::min(width, size - base - firstSize);
+
+					const std::size_t firstBegin = coRank(begin - base, first, firstSize, second, secondSize, compare);
+					const std::size_t firstEnd = coRank(end - base, first, firstSize, second, secondSize, compare);
+
+					std::merge(std::make_move_iterator(source + base + firstBegin),
+						std::make_move_iterator(source + base + firstEnd),
+						std::make_move_iterator(source + base + firstSize + (begin - base - firstBegin)),
+						std::make_move_iterator(source + base + firstSize + (end - base - firstEnd)),
+						destination + begin, compare);
+				}
+			});
+		}
+
+		template<typename T, typename Compare>
+		T pseudoMedian(const T* data, std::size_t size, const Compare& compare)
+		{
+			// Median of the medians of three spread samples, the ninther
+			const std::size_t step = size / 9;
+			const T samples[3] = {
+				medianOfThree(data, 3 * step, compare),
+				medianOfThree(data + 3 * step, 3 * step, compare),
+				medianOfThree(data + 6 * step, size - 6 * step, compare)
+			};
+
+			return medianOfThree(samples, 3, compare);
+		}
+	}
+
+	/**
+	 * \brief Calls `body(chunkBegin, chunkEnd)` on chunks covering [begin, end)
+	 * in parallel, returning once all of them are done
+	 *
+	 * The range is split in halves recursively, as tasks of the worker calling
+	 * it, down to chunks of at most \p grain indices (0 picks a few chunks per
+	 * worker). The calling worker helps running chunks meanwhile. Called outside
+	 * the engine workers, or with pools too small, chunks run in the caller thread.
+	 *
+	 * Chunks are run by tasks, so `Scratch::current()` can be used for their
+	 * temporaries. Ranges take three pointers of data, pools of tasks smaller than
+	 * `TaskSize::Bytes64` keep them in the heap.
+	 */
+	template<typename Body>
+	void parallelFor(Engine& engine, std::size_t begin, std::size_t end, std::size_t grain, const Body& body)
+	{
+		if (begin >= end)
+		{
+			return;
+		}
+
+		if (grain == 0)
+		{
+			grain = detail::defaultGrain(engine, end - begin);
+		}
+
+		Worker* worker = engine.threadWorker();
+		const detail::Loop<Body> loop{ &engine, &body, grain };
+		Task* root = nullptr;
+
+		if (worker != nullptr && end - begin > grain)
+		{
+			root = detail::createTask<detail::LoopRange<Body>, detail::loopTask<Body>>(worker,
+				detail::LoopRange<Body>{ &loop, begin, end });
+		}
+
+		if (root == nullptr)
+		{
+			body(begin, end);
+			return;
+		}
+
+		worker->submit(root);
+		worker->wait(root);
+	}
+
+	template<typename Body>
+	void parallelFor(Engine& engine, std::size_t begin, std::size_t end, const Body& body)
+	{
+		parallelFor(engine, begin, end, 0, body);
+	}
+
+	/**
+	 * \brief Calls `body(block)` on blocks of at most \p grain indices along each
+	 * dimension covering \p range in parallel, returning once all of them are done
+	 *
+	 * Blocks are halved along the dimension furthest above its grain, recursively
+	 * like `parallelFor()` halves ranges, which keeps them close to square and runs
+	 * neighbouring blocks one after the other, so tiles of images and matrices are
+	 * reused from the caches instead of streamed row by row. Without \p grain, the
+	 * range is split in a few blocks per worker. Each dimension must be less than
+	 * 2^32 indices long.
+	 */
+	template<typename Body>
+	void parallelFor2d(Engine& engine, const BlockedRange2d& range, const std::array<std::size_t, 2>& grain, const Body& body)
+	{
+		detail::parallelForBlocks(engine, range, grain, body);
+	}
+
+	template<typename Body>
+	void parallelFor2d(Engine& engine, const BlockedRange2d& range, const Body& body)
+	{
+		detail::parallelForBlocks(engine, range, detail::defaultGrain(engine, range), body);
+	}
+
+	template<typename Body>
+	void parallelFor3d(Engine& engine, const BlockedRange3d& range, const std::array<std::size_t, 3>& grain, const Body& body)
+	{
+		detail::parallelForBlocks(engine, range, grain, body);
+	}
+
+	template<typename Body>
+	void parallelFor3d(Engine& engine, const BlockedRange3d& range, const Body& body)
+	{
+		detail::parallelForBlocks(engine, range, detail::defaultGrain(engine, range), body);
+	}
+
+	/**
+	 * \brief Reduces [begin, end) in parallel: `body(chunkBegin, chunkEnd)` returns
+	 * the result of each chunk, which are folded with `combine(result, chunkResult)`
+	 * starting from \p identity
+	 *
+	 * Chunks are made and run like in `parallelFor()`, their results are combined
+	 * in order by the caller, so the result does not depend on the scheduling even
+	 * when \p combine is not associative (floating point sums).
+	 */
+	template<typename T, typename Body, typename Combine>
+	T parallelReduce(Engine& engine, std::size_t begin, std::size_t end, std::size_t grain, const T& identity,
+		const Body& body, const Combine& combine)
+	{
+		if (begin >= end)
+		{
+			return identity;
+		}
+
+		if (grain == 0)
+		{
+			grain = detail::defaultGrain(engine, end - begin);
+		}
+
+		std::vector<T> results((end - begin + grain - 1) / grain, identity);
+
+		parallelFor(engine, 0, results.size(), 1, [&](std::size_t first, std::size_t last) {
+			for (std::size_t chunk = first; chunk < last; chunk++)
+			{
+				const std::size_t chunkBegin = begin + chunk * grain;
+				results[chunk] = body(chunkBegin, std::min(chunkBegin + grain, end));
+			}
+		});
+
+		T result = identity;
+
+		for (const T& chunkResult : results)
+		{
+			result = combine(result, chunkResult);
+		}
+
+		return result;
+	}
+
+	/**
+	 * \brief Sums \p data in parallel. 32 bit integers are summed in 64 bits,
+	 * and integers, floats and doubles by the vectorized kernels of `simd`
+	 */
+	template<typename T>
+	auto parallelSum(Engine& engine, const T* data, std::size_t size)
+	{
+		using Sum = decltype(detail::leafSum(data, size));
+
+		return parallelReduce(engine, 0, size, 0, Sum{},
+			[data](std::size_t begin, std::size_t end) { return detail::leafSum(data + begin, end - begin); },
+			std::plus<Sum>{});
+	}
+
+	/**
+	 * \brief Returns the smallest element of \p data, which must not be empty
+	 */
+	template<typename T>
+	T parallelMin(Engine& engine, const T* data, std::size_t size)
+	{
+		return parallelReduce(engine, 0, size, 0, data[0],
+			[data](std::size_t begin, std::size_t end) { return detail::leafMin(data + begin, end - begin); },
+			[](const T& first, const T& second) { return std::min(first, second); });
+	}
+
+	/**
+	 * \brief Returns the largest element of \p data, which must not be empty
+	 */
+	template<typename T>
+	T parallelMax(Engine& engine, const T* data, std::size_t size)
+	{
+		return parallelReduce(engine, 0, size, 0, data[0],
+			[data](std::size_t begin, std::size_t end) { return detail::leafMax(data + begin, end - begin); },
+			[](const T& first, const T& second) { return std::max(first, second); });
+	}
+
+	/**
+	 * \brief Sorts \p data in parallel with \p compare, not stable
+	 *
+	 * A quicksort whose upper partitions are spawned as tasks, like the chunks of
+	 * `parallelFor()`. Integers and floats sorted with `std::less` are partitioned
+	 * by `simd::partition()` and finish with `simd::sortSmall()`, other types use
+	 * `std::partition()` and `std::sort()`. Partitioning is in place, apart from
+	 * the vectorized one which uses the scratch arena of the worker.
+	 */
+	template<typename T, typename Compare = std::less<T>>
+	void parallelSort(Engine& engine, T* data, std::size_t size, Compare compare = Compare{})
+	{
+		if (size < 2)
+		{
+			return;
+		}
+
+		const std::size_t grain = std::max(detail::defaultGrain(engine, size), detail::SORT_GRAIN);
+		const unsigned depth = detail::sortDepth(size);
+		Worker* worker = engine.threadWorker();
+		const detail::Sort<T, Compare> sort{ &engine, &compare, grain };
+		Task* root = nullptr;
+
+		if (worker != nullptr && size > grain)
+		{
+			root = detail::createTask<detail::SortRange<T, Compare>, detail::sortTask<T, Compare>>(worker,
+				detail::SortRange<T, Compare>{ &sort, data, size, depth });
+		}
+
+		if (root == nullptr)
+		{
+			detail::sortLeaf(data, size, compare, depth);
+			return;
+		}
+
+		worker->submit(root);
+		worker->wait(root);
+	}
+
+	/**
+	 * \brief Sorts \p data in parallel with \p compare, keeping the order of
+	 * equal elements
+	 *
+	 * A bottom-up merge sort: chunks of a few per worker are sorted by
+	 * `std::stable_sort()` in parallel, then runs are merged pairwise, level by
+	 * level, into a buffer of \p size elements and back. Every level is split in
+	 * chunks of output, each finding the inputs it merges by co-ranking, so the
+	 * last merges use all the workers too. \p T must be default constructible.
+	 *
+	 * The buffer of trivially copyable elements is left uninitialized in the
+	 * scratch arena of the caller (See `Scratch::current()`), which keeps it for
+	 * the next sorts, other elements are constructed in a vector.
+	 */
+	template<typename T, typename Compare = std::less<T>>
+	void parallelStableSort(Engine& engine, T* data, std::size_t size, Compare compare = Compare{})
+	{
+		const std::size_t chunk = std::max(detail::defaultGrain(engine, size), detail::MERGE_GRAIN);
+
+		// Runs start at multiples of the chunk, which halving the range would not keep
+		parallelFor(engine, 0, (size + chunk - 1) / chunk, 1, [&](std::size_t firstRun, std::size_t lastRun) {
+			for (std::size_t run = firstRun; run < lastRun; run++)
+			{
+				std::stable_sort(data + run * chunk, data + std::min((run + 1) * chunk, size), compare);
+			}
+		});
+
+		if (size <= chunk)
+		{
+			return;
+		}
+
+		Scratch& scratch = Scratch::current();
+		const Scratch::Marker marker = scratch.mark();
+		std::vector<T> constructed;
+		T* buffer = nullptr;
+
+		if constexpr (std::is_trivially_copyable<T>::value)
+		{
+			buffer = scratch.allocate<T>(size);
+		}
+		else
+		{
+			constructed.resize(size);
+			buffer = constructed.data();
+		}
+
+		T* source = data;
+		T* destination = buffer;
+
+		for (std::size_t width = chunk; width < size; width *= 2)
+		{
+			detail::mergeRuns(engine, source, destination, size, width, chunk, compare);
+			std::swap(source, destination);
+		}
+
+		if (source != data)
+		{
+			parallelFor(engine, 0, size, chunk, [&](std::size_t begin, std::size_t end) {
+				std::move(source + begin, source + end, data + begin);
+			});
+		}
+
+		scratch.rewind(marker);
+	}
+
+	/**
+	 * \brief Reorders \p data so that the element at \p nth is the one that
+	 * would be there sorted, no greater element before it and no smaller one after
+	 *
+	 * A quickselect whose partitions are parallel: chunks count the elements less
+	 * than, equal to and greater than a pseudo median pivot, then move them to
+	 * their places in a buffer of \p size elements, which is copied back. Only the
+	 * part holding \p nth is partitioned again, and once small enough it is
+	 * finished by `std::nth_element()`. \p T must be default constructible.
+	 */
+	template<typename T, typename Compare = std::less<T>>
+	void parallelNthElement(Engine& engine, T* data, std::size_t size, std::size_t nth, Compare compare = Compare{})
+	{
+		if (nth >= size)
+		{
+			return;
+		}
+
+		const std::size_t chunk = std::max(detail::defaultGrain(engine, size), detail::MERGE_GRAIN);
+		std::size_t begin = 0, end = size;
+		std::vector<T> buffer;
+		// Rounds left before giving up on pivots picked badly over and over
+		unsigned depth = detail::sortDepth(size);
+
+		while (end - begin > chunk && depth > 0)
+		{
+			const T pivot = detail::pseudoMedian(data + begin, end - begin, compare);
+			const std::size_t chunks = (end - begin + chunk - 1) / chunk;
+			// Elements less than, equal to and greater than the pivot of each chunk,
+			// then where the chunk moves them
+			std::vector<std::array<std::size_t, 3>> counts(chunks);
+			buffer.resize(size);
+			depth--;
+
+			parallelFor(engine, 0, chunks, 1, [&](std::size_t firstChunk, std::size_t lastChunk) {
+				for (std::size_t index = firstChunk; index < lastChunk; index++)
+				{
+					const std::size_t chunkBegin = begin + index * chunk, chunkEnd = std::min(chunkBegin + chunk, end);
+					std::array<std::size_t, 3> count{};
+
+					for (std::size_t i = chunkBegin; i < chunkEnd; i++)
+					{
+						count[compare(data[i], pivot) ? 0 : compare(pivot, data[i]) ? 2 : 1]++;
+					}
+
+					counts[index] = count;
+				}
+			});
+
+			std::array<std::size_t, 3> totals{};
+
+			for (const std::array<std::size_t, 3>& count : counts)
+			{
+				for (std::size_t part = 0; part < 3; part++)
+				{
+					totals[part] += count[part];
+				}
+			}
+
+			std::array<std::size_t, 3> offsets{ begin, begin + totals[0], begin + totals[0] + totals[1] };
+
+			for (std::array<std::size_t, 3>& count : counts)
+			{
+				for (std::size_t part = 0; part < 3; part++)
+				{
+					offsets[part] += count[part];
+					count[part] = offsets[part] - count[part];
+				}
+			}
+
+			parallelFor(engine, 0, chunks, 1, [&](std::size_t firstChunk, std::size_t lastChunk) {
+				for (std::size_t index = firstChunk; index < lastChunk; index++)
+				{
+					const std::size_t chunkBegin = begin + index * chunk, chunkEnd = std::min(chunkBegin + chunk, end);
+					std::array<std::size_t, 3> next = counts[index];
+
+					for (std::size_t i = chunkBegin; i < chunkEnd; i++)
+					{
+						buffer[next[compare(data[i], pivot) ? 0 : compare(pivot, data[i]) ? 2 : 1]++] = std::move(data[i]);
+					}
+				}
+			});
+
+			parallelFor(engine, begin, end, chunk, [&](std::size_t first, std::size_t last) {
+				std::move(buffer.begin() + first, buffer.begin() + last, data + first);
+			});
+
+			const std::size_t lessEnd = begin + totals[0], equalEnd = lessEnd + totals[1];
+
+			if (nth < lessEnd)
+			{
+				end = lessEnd;
+			}
+			else if (nth < equalEnd)
+			{
+				return;
+			}
+			else
+			{
+				begin = equalEnd;
+			}
+		}
+
+		std::nth_element(data + begin, data + nth, data + end, compare);
+	}
+
+	/**
+	 * \brief Sorts the \p middle smallest elements of \p data into its
+	 * beginning, the rest is left in no particular order
+	 *
+	 * When \p middle is small next to the chunks of a few per worker, each chunk
+	 * moves its own \p middle smallest elements to its beginning with
+	 * `std::partial_sort()`, in parallel, and the smallest of these candidates are
+	 * selected by a recursive call, so top-k queries read the rows once. Otherwise
+	 * they are selected by `parallelNthElement()` and sorted by `parallelSort()`.
+	 * \p T must be default constructible.
+	 */
+	template<typename T, typename Compare = std::less<T>>
+	void parallelPartialSort(Engine& engine, T* data, std::size_t size, std::size_t middle, Compare compare = Compare{})
+	{
+		middle = std::min(middle, size);
+		const std::size_t chunk = std::max(detail::defaultGrain(engine, size), detail::MERGE_GRAIN);
+
+		// Candidates are at most a sixteenth of the rows, otherwise chunks
+		// prune too little to pay for their second selection
+		if (middle == 0 || size <= chunk || middle * 16 > chunk)
+		{
+			parallelNthElement(engine, data, size, middle, compare);
+			parallelSort(engine, data, middle, compare);
+			return;
+		}
+
+		const std::size_t chunks = (size + chunk - 1) / chunk;
+
+		parallelFor(engine, 0, chunks, 1, [&](std::size_t firstChunk, std::size_t lastChunk) {
+			for (std::size_t index = firstChunk; index < lastChunk; index++)
+			{
+				T* begin = data + index * chunk;
+				T* end = data + std::min((index + 1) * chunk, size);
+				std::partial_sort(begin, begin + std::min<std::size_t>(middle, end - begin), end, compare);
+			}
+		});
+
+		std::vector<T> candidates;
+		candidates.reserve(chunks * middle);
+
+		for (std::size_t index = 0; index < chunks; index++)
+		{
+			T* begin = data + index * chunk;
+			std::move(begin, begin + std::min(middle, size - index * chunk), std::back_inserter(candidates));
+		}
+
+		parallelPartialSort(engine, candidates.data(), candidates.size(), middle, compare);
+
+		// The selected candidates go to the beginning of the first chunk, the
+		// others fill the beginnings of the next ones
+		std::move(candidates.begin(), candidates.begin() + middle, data);
+		auto next = candidates.begin() + middle;
+
+		for (std::size_t index = 1; index < chunks; index++)
+		{
+			const std::size_t count = std::min(middle, size - index * chunk);
+			std::move(next, next + count, data + index * chunk);
+			next += count;
+		}
+	}
+}
+#endif
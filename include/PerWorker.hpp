@@ -0,0 +1,117 @@
+#ifndef TASKSYSTEM_PERWORKER_HPP
+#define TASKSYSTEM_PERWORKER_HPP
+
+#pragma once
+#include "Engine.hpp"
+#include <memory>
+#include <stdexcept>
+#include <utility>
+
+namespace TaskSystem {
+	/**
+	 * \brief One instance of T per engine worker, indexed by `Worker::id()`
+	 *
+	 * Tasks accumulate into the instance of the worker running them with no
+	 * synchronization, and the partial results are combined once the tasks are
+	 * done. Each instance lives in its own cache lines.
+	 *
+	 * \code
+	 * PerWorker<std::size_t> matches{ engine };
+	 * // In the tasks
+	 * matches.local() += count(chunk);
+	 * // Once they are done
+	 * std::size_t total = matches.combine(std::size_t{ 0 }, std::plus<>{});
+	 * \endcode
+	 *
+	 * `local()` must be called from the engine workers, and is sized for the
+	 * workers the engine had when the object was constructed.
+	 */
+	template<typename T>
+	class PerWorker
+	{
+	public:
+		template<typename... Args>
+		explicit PerWorker(Engine& engine, const Args& ... args) :
+			_engine{ engine },
+			_size{ engine.workers().size() },
+			_slots{ std::make_unique<Slot[]>(_size) }
+		{
+			for (std::size_t i = 0; i < _size; ++i)
+			{
+				_slots[i].value = T{ args... };
+			}
+		}
+
+		PerWorker(const PerWorker&) = delete;
+		PerWorker& operator=(const PerWorker&) = delete;
+
+		/**
+		 * \brief Returns the instance of the worker calling it
+		 *
+		 * \throws std::logic_error if the caller is not one of the workers the
+		 * object was sized for
+		 */
+		T& local()
+		{
+			Worker* worker = _engine.threadWorker();
+
+			if (worker == nullptr || worker->id() >= _size)
+			{
+				throw std::logic_error{ "PerWorker::local() called outside the engine workers" };
+			}
+
+			return _slots[worker->id()].value;
+		}
+
+		T& operator[](std::size_t workerId)
+		{
+			return _slots[workerId].value;
+		}
+
+		const T& operator[](std::size_t workerId) const
+		{
+			return _slots[workerId].value;
+		}
+
+		std::size_t size() const
+		{
+			return _size;
+		}
+
+		/**
+		 * \brief Folds all the instances into \p init with \p op, in worker order
+		 *
+		 * Not synchronized with `local()`, call it once the tasks are done.
+		 */
+		template<typename Result, typename Op>
+		Result combine(Result init, Op op) const
+		{
+			for (std::size_t i = 0; i < _size; ++i)
+			{
+				init = op(std::move(init), _slots[i].value);
+			}
+
+			return init;
+		}
+
+		template<typename Function>
+		void forEach(Function function)
+		{
+			for (std::size_t i = 0; i < _size; ++i)
+			{
+				function(_slots[i].value);
+			}
+		}
+
+	private:
+		struct alignas(64) Slot
+		{
+			T value;
+		};
+
+		Engine& _engine;
+		std::size_t _size;
+		std::unique_ptr<Slot[]> _slots;
+	};
+}
+#endif
@@ -0,0 +1,135 @@
+#ifndef TASKSYSTEM_PIPELINE_HPP
+#define TASKSYSTEM_PIPELINE_HPP
+
+#pragma once
+#include "Task.hpp"
+#include <atomic>
+#include <cstdint>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+namespace TaskSystem {
+	class Engine;
+
+	/**
+	 * \brief Runs a stream of items through a sequence of stages
+	 *
+	 * Items are read by a serial input stage and then flow through the stages
+	 * in the order they were added. At most `maxTokens` items are in flight at once:
+	 * once an item leaves the last stage its token goes back to the input stage, so
+	 * memory is bounded by the token limit no matter how long the stream is.
+	 *
+	 * Each token is processed by a task scheduled on the engine workers. Parallel
+	 * stages run items concurrently, serial stages run one item at a time, either
+	 * in input order or in any order. An item waiting for a serial stage does not
+	 * block a worker, it is resumed in a new task by the item leaving the stage.
+	 *
+	 * \code
+	 * Pipeline pipeline{ engine, 16 };
+	 * pipeline.input([&](Pipeline::Item& item) { return parse(buffers[item.token]); })
+	 *     .stage(Pipeline::Mode::Parallel, [&](Pipeline::Item& item) { transform(buffers[item.token]); })
+	 *     .stage(Pipeline::Mode::SerialInOrder, [&](Pipeline::Item& item) { emit(buffers[item.token]); });
+	 * pipeline.run();
+	 * \endcode
+	 */
+	class Pipeline
+	{
+	public:
+		enum class Mode
+		{
+			// Any number of items at once
+			Parallel,
+			// One item at a time, in the order the input stage read them
+			SerialInOrder,
+			// One item at a time, in any order
+			SerialOutOfOrder
+		};
+
+		/**
+		 * \brief An item flowing through the pipeline
+		 */
+		struct Item
+		{
+			// Position of the item in the input, starting from 0
+			std::uint64_t sequence;
+			// Token carrying the item, in [0, maxTokens). Handy to index per token buffers
+			std::size_t token;
+			// Free for the stages to use, kept from one stage to the next
+			void* data;
+		};
+
+		/**
+		 * \brief Reads the next item. Returns false once there is no more input
+		 */
+		using InputFunction = std::function<bool(Item&)>;
+		using StageFunction = std::function<void(Item&)>;
+
+		Pipeline(Engine& engine, std::size_t maxTokens);
+		~Pipeline();
+
+		Pipeline(const Pipeline&) = delete;
+		Pipeline& operator=(const Pipeline&) = delete;
+
+		Pipeline& input(InputFunction function);
+		Pipeline& stage(Mode mode, StageFunction function);
+
+		/**
+		 * \brief Runs the pipeline until the input is exhausted and all the items
+		 * went through all the stages
+		 *
+		 * A worker thread calling it helps running stages meanwhile, other
+		 * threads hand the tokens to the workers and wait.
+		 *
+		 * \throws The first exception thrown by the input or a stage. No more items
+		 * are read then, and the items in flight skip the stages left
+		 */
+		void run();
+
+		std::size_t maxTokens() const;
+
+	private:
+		struct Stage
+		{
+			Mode mode;
+			StageFunction function;
+			std::mutex mutex;
+			bool busy;
+			// Next sequence allowed in, for SerialInOrder stages
+			std::uint64_t next;
+			// Items waiting, indexed by sequence for SerialInOrder
+			// stages, in arrival order for SerialOutOfOrder ones
+			std::vector<Item*> waitingInOrder;
+			std::deque<Item*> waiting;
+		};
+
+		struct Token;
+
+		Engine& _engine;
+		std::size_t _maxTokens;
+		InputFunction _input;
+		// The first stage is the input, serial out of order
+		std::vector<std::unique_ptr<Stage>> _stages;
+		std::vector<std::unique_ptr<Token>> _tokens;
+		std::uint64_t _nextSequence;
+		bool _exhausted;
+		// Notified as tokens retire, waited on by run() off the workers
+		std::atomic<std::int32_t> _retiredTokens;
+		std::atomic<bool> _failed;
+		std::exception_ptr _error;
+
+		static void tokenTask(void* token);
+		void advance(Token& token);
+		void schedule(Token& token);
+		bool enter(Stage& stage, Token& token);
+		Token* leave(Stage& stage);
+		// Keeps the first exception for run()
+		void fail(std::exception_ptr error);
+		bool allRetired() const;
+		bool finished() const;
+	};
+}
+#endif
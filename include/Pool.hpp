@@ -1,25 +1,57 @@
 #ifndef TASKSYSTEM_POOL_HPP
 #define TASKSYSTEM_POOL_HPP
 #pragma once
+#include <atomic>
+#include <cassert>
+#include <memory>
 #include <vector>
 #include "Task.hpp"
+#include "Closure.hpp"
+#include "Overflow.hpp"
 
 //one pool per worker NOT THREAD SAFE
 namespace TaskSystem {
+	/**
+	 * \brief Linear allocator of tasks of a given size class
+	 *
+	 * Tasks are laid out contiguously, each one taking the size of the pool
+	 * size class (See `TaskSize`). The storage is cache line aligned, so tasks
+	 * of 64 bytes or more never straddle cache lines.
+	 *
+	 * The storage can be split in several generations of \p maxTasks tasks each,
+	 * allocating from one generation at a time. `beginGeneration()` moves to the
+	 * next one only once every task allocated from it in the previous round is
+	 * finished, so tasks of a frame can be recycled a few frames later without
+	 * tracking them one by one.
+	 */
 	class Pool
 	{
 	public:
-		Pool(std::size_t maxTasks);
+		Pool(std::size_t maxTasks, TaskSize taskSize = TaskSize::Default, std::size_t generations = 1);
 
+		/**
+		 * \brief Returns storage for a task, or what the overflow policy says once
+		 * the current generation is full: nullptr, a task from the overflow blocks
+		 * of the generation, or an `OverflowError` (See `OverflowPolicy`)
+		 */
 		Task* allocate();
 
 		Task* createTask(TaskFunction taskFunction);
 		Task* createTaskAsChild(TaskFunction taskFunction, Task* parent);
 
+		/**
+		 * \brief Creates a task holding \p data, which must fit in the tasks of the
+		 * pool (See `maxDataSize()`). Debug builds assert it, release builds return
+		 * nullptr for data that does not fit
+		 */
 		template<typename Data>
 		Task* createTask(TaskFunction taskFunction, const Data& data)
 		{
-			auto* taskStorage = allocate();
+			static_assert(sizeof(Data) <= Task::TASK_MAX_DATA_SIZE, "Objects of that type do not fit in "
+				"the task data storage");
+			assert(sizeof(Data) <= maxDataSize() && "Objects of that type do not fit in the tasks of the pool");
+
+			auto* taskStorage = sizeof(Data) <= maxDataSize() ? allocate() : nullptr;
 
 			if (taskStorage != nullptr)
 			{
@@ -34,7 +66,11 @@ namespace TaskSystem {
 		template<typename Data>
 		Task* createTaskAsChild(TaskFunction taskFunction, const Data& data, Task* parent)
 		{
-			auto* taskStorage = allocate();
+			static_assert(sizeof(Data) <= Task::TASK_MAX_DATA_SIZE, "Objects of that type do not fit in "
+				"the task data storage");
+			assert(sizeof(Data) <= maxDataSize() && "Objects of that type do not fit in the tasks of the pool");
+
+			auto* taskStorage = sizeof(Data) <= maxDataSize() ? allocate() : nullptr;
 
 			if (taskStorage != nullptr)
 			{
@@ -49,29 +85,161 @@ namespace TaskSystem {
 		template<typename Function>
 		Task* createClosureTask(Function function)
 		{
-			return tasks::closure(allocate(), function);
+			return tasks::closure(allocate(), function, nullptr, maxDataSize());
 		}
 
 		template<typename Function>
 		Task* createClosureTaskAsChild(Function function, Task* parent)
 		{
-			return tasks::closure(allocate(), function, parent);
+			return tasks::closure(allocate(), function, parent, maxDataSize());
 		}
 
+		/**
+		 * \brief Returns the storage the next call to `allocate()` will return
+		 */
 		Task* next() {
-			return &_storage[_head];
+			return at(_generations[_currentGeneration].allocatedTasks);
 		}
 
+		/**
+		 * \brief Gives back the storage of \p task if it is the last task allocated
+		 *
+		 * The task must be finished and not referenced anymore (See `Task::runInline()`).
+		 * Releasing tasks in the reverse order they were allocated keeps pool usage
+		 * proportional to the nesting depth of tasks run inline.
+		 *
+		 * \returns true if the storage was released
+		 */
+		bool release(Task* task);
+
+		/**
+		 * \brief Resets every generation, even if their tasks are still queued or running
+		 *
+		 * Only safe when no task allocated from the pool is alive. See `beginGeneration()`.
+		 */
 		void clear();
+
+		/**
+		 * \brief Starts allocating from the next generation, reset beforehand
+		 *
+		 * The next generation is only reused if all the tasks previously allocated
+		 * from it are finished. Otherwise the pool keeps allocating from the
+		 * current generation and the call can be retried later. With a single
+		 * generation this resets the pool once all its tasks are finished.
+		 * Periodic tasks are rearmed after finishing (See `Task::rearm()`), so they
+		 * must not be allocated from generations that are going to be reused.
+		 *
+		 * \returns true if the pool switched generations
+		 */
+		bool beginGeneration();
+
+		/**
+		 * \brief Returns the number of generations of the pool
+		 */
+		std::size_t generations() const;
+
+		/**
+		 * \brief Returns the index of the generation tasks are allocated from
+		 */
+		std::size_t currentGeneration() const;
+
 		std::size_t tasks() const;
 		std::size_t maxTasks() const;
 		float tasksFactor() const;
 		bool full() const;
 
+		/**
+		 * \brief Sets what `allocate()` does once the pool is full. Can be
+		 * called from any thread
+		 *
+		 * `OverflowPolicy::RunInline` spills like `OverflowPolicy::Spill`, the
+		 * pool cannot tell how the task would be run.
+		 *
+		 * \throws std::invalid_argument for `OverflowPolicy::HelpUntilSpace`:
+		 * storage comes back a whole generation at a time, running tasks would
+		 * not make room (See `Engine::setOverflowPolicy()`)
+		 */
+		void setOverflowPolicy(OverflowPolicy policy);
+		OverflowPolicy overflowPolicy() const;
+
+		/**
+		 * \brief Returns the times the pool was full since it was created.
+		 * Only the pool fields are filled
+		 */
+		OverflowCounters overflowCounters() const;
+
+		/**
+		 * \brief Returns the number of tasks of the current generation allocated
+		 * from overflow blocks
+		 */
+		std::size_t spilledTasks() const;
+
+		/**
+		 * \brief Returns the size class of the tasks allocated by the pool
+		 */
+		TaskSize taskSize() const;
+
+		/**
+		 * \brief Returns the maximum size of the data that can be associated with
+		 * tasks allocated by the pool
+		 */
+		std::size_t maxDataSize() const;
+
 	private:
-		std::vector<Task> _storage;
-		std::size_t _allocatedTasks;
-		std::size_t _head;
+		struct alignas(64) CacheLine
+		{
+			unsigned char bytes[64];
+		};
+
+		struct Generation
+		{
+			std::size_t allocatedTasks = 0;
+			// Tasks before this index are known to be finished, so
+			// retries of beginGeneration() do not scan them again
+			std::size_t finishedTasks = 0;
+			// Tasks allocated once the generation was full, under
+			// OverflowPolicy::Spill. Blocks are kept for the next rounds
+			std::vector<std::unique_ptr<CacheLine[]>> spillBlocks;
+			std::size_t spilledTasks = 0;
+			std::size_t finishedSpilledTasks = 0;
+
+			void reset()
+			{
+				allocatedTasks = finishedTasks = spilledTasks = finishedSpilledTasks = 0;
+			}
+		};
+
+		std::vector<CacheLine> _storage;
+		std::size_t _taskSize;
+		std::size_t _maxTasks;
+		std::vector<Generation> _generations;
+		std::size_t _currentGeneration;
+		std::atomic<OverflowPolicy> _overflowPolicy;
+		OverflowCounters _overflows;
+
+		Task* at(std::size_t index)
+		{
+			return at(_currentGeneration, index);
+		}
+
+		Task* at(std::size_t generation, std::size_t index)
+		{
+			return reinterpret_cast<Task*>(
+				_storage.data()->bytes + (generation * _maxTasks + index) * _taskSize);
+		}
+
+		Task* spilled(std::size_t generation, std::size_t index)
+		{
+			const std::size_t blockTasks = SPILL_BLOCK_TASKS;
+			return reinterpret_cast<Task*>(_generations[generation].spillBlocks[index / blockTasks][0].bytes +
+				(index % blockTasks) * _taskSize);
+		}
+
+		// Tasks per overflow block
+		static constexpr const std::size_t SPILL_BLOCK_TASKS = 256;
+
+		Task* spill();
+		bool finished(std::size_t generation);
 	};
 }
 #endif
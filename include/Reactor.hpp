@@ -0,0 +1,174 @@
+#ifndef TASKSYSTEM_REACTOR_HPP
+#define TASKSYSTEM_REACTOR_HPP
+
+#pragma once
+#include "Task.hpp"
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <unordered_map>
+
+namespace TaskSystem {
+	/**
+	 * \brief File descriptor readiness notifications delivered as tasks
+	 *
+	 * Tasks register interest in a file descriptor together with a continuation
+	 * task, which is submitted once the descriptor becomes ready. There is no
+	 * reactor thread: idle workers poll the reactor in leader/follower fashion, only
+	 * one of them polls the OS at a time and the rest keep running (or stealing) tasks,
+	 * including the continuations just submitted by the polling worker. A parked worker
+	 * becomes the leader by blocking in `wait()`, so readiness wakes it up.
+	 *
+	 * Registrations are one shot: after a notification the file descriptor must be
+	 * watched again to get the next one. Each file descriptor has at most one
+	 * registration at a time, watching it again replaces the previous one.
+	 *
+	 * Linux only (epoll), on other platforms `watch()` always fails.
+	 */
+	class Reactor
+	{
+	public:
+		enum Events : std::uint32_t
+		{
+			Readable = 1 << 0,
+			Writable = 1 << 1,
+			Error    = 1 << 2,
+			HangUp   = 1 << 3
+		};
+
+		Reactor();
+		~Reactor();
+
+		Reactor(const Reactor&) = delete;
+		Reactor& operator=(const Reactor&) = delete;
+
+		/**
+		 * \brief Submits \p continuation once \p fd is ready for \p events
+		 *
+		 * Thread safe, can be called from any thread.
+		 *
+		 * \param events Combination of `Events` the caller is interested in. Errors and
+		 * hang ups are always reported.
+		 * \param continuation Task submitted to the polling worker on readiness
+		 * \param readyEvents If not null, receives the `Events` that triggered the
+		 * notification before the continuation is submitted.
+		 *
+		 * \returns false if the file descriptor cannot be watched
+		 */
+		bool watch(int fd, std::uint32_t events, Task* continuation, std::uint32_t* readyEvents = nullptr);
+
+		/**
+		 * \brief Removes the registration of \p fd
+		 *
+		 * \returns The continuation of the registration if it was not notified yet,
+		 * nullptr otherwise. The caller owns that task (e.g. discard it).
+		 */
+		Task* unwatch(int fd);
+
+		/**
+		 * \brief Polls the OS for ready file descriptors without blocking
+		 *
+		 * If another thread is already polling the call returns immediately.
+		 *
+		 * \param callback Invoked as `callback(Task* continuation)` for each notification
+		 * \returns The number of notifications delivered
+		 */
+		template<typename Callback>
+		std::size_t poll(Callback callback)
+		{
+			if (_watching.load(std::memory_order_relaxed) == 0 ||
+				_polling.exchange(true, std::memory_order_acquire))
+			{
+				return 0;
+			}
+
+			Task* continuations[MAX_EVENTS];
+			const std::size_t count = collect(continuations, 0);
+
+			_polling.store(false, std::memory_order_release);
+
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				callback(continuations[i]);
+			}
+
+			return count;
+		}
+
+		/**
+		 * \brief Like `poll()`, but blocks until a file descriptor is ready,
+		 * \p timeout expires or `interrupt()` is called
+		 *
+		 * Only one thread blocks at a time. Once the caller is the leader,
+		 * \p block is checked again: if it returns false the OS is polled without
+		 * blocking. Pair it with whatever `interrupt()` is called after, so a wake up
+		 * issued right before blocking is not missed.
+		 *
+		 * \returns false, without polling, if nothing is watched or another thread is
+		 * polling. The caller has to sleep some other way then
+		 */
+		template<typename Callback, typename Condition>
+		bool wait(std::chrono::nanoseconds timeout, Callback callback, Condition block)
+		{
+			if (_watching.load(std::memory_order_relaxed) == 0 ||
+				_polling.exchange(true, std::memory_order_acquire))
+			{
+				return false;
+			}
+
+			// Sequentially consistent, like the store of whatever block() reads before
+			// calling interrupt(): either interrupt() sees the flag or we see the change
+			_blocked.store(true);
+
+			const int milliseconds = !block() ? 0 : static_cast<int>(std::min<std::chrono::nanoseconds::rep>(
+				std::chrono::ceil<std::chrono::milliseconds>(timeout).count(), std::numeric_limits<int>::max()));
+
+			Task* continuations[MAX_EVENTS];
+			const std::size_t count = collect(continuations, milliseconds);
+
+			_blocked.store(false, std::memory_order_relaxed);
+			_polling.store(false, std::memory_order_release);
+
+			for (std::size_t i = 0; i < count; ++i)
+			{
+				callback(continuations[i]);
+			}
+
+			return true;
+		}
+
+		/**
+		 * \brief Wakes up the thread blocked in `wait()`, if any. Thread safe
+		 */
+		void interrupt();
+
+		/**
+		 * \brief Returns the number of registrations waiting for a notification
+		 */
+		std::size_t watching() const;
+
+	private:
+		static constexpr const std::size_t MAX_EVENTS = 64;
+
+		struct Registration
+		{
+			Task* continuation;
+			std::uint32_t* readyEvents;
+		};
+
+		int _fd;
+		// Signaled by interrupt(), watched by the epoll instance
+		int _eventFd;
+		std::atomic<bool> _polling;
+		// Set while the leader may block in epoll
+		std::atomic<bool> _blocked;
+		std::atomic<std::size_t> _watching;
+		std::mutex _mutex;
+		std::unordered_map<int, Registration> _registrations;
+
+		std::size_t collect(Task** continuations, int timeout);
+	};
+}
+#endif
@@ -0,0 +1,83 @@
+#ifndef TASKSYSTEM_SCHEDULE_HPP
+#define TASKSYSTEM_SCHEDULE_HPP
+
+#pragma once
+#include <cstdint>
+#include <iosfwd>
+#include <vector>
+
+namespace TaskSystem {
+	/**
+	 * \brief Scheduling decisions taken by an engine, recorded to be replayed later
+	 *
+	 * Workers record the victim picked on every steal attempt. In simulation mode
+	 * the engine also records which worker runs each step. Replaying a schedule
+	 * recorded in simulation mode with the same task tree reproduces exactly the
+	 * same execution. On threaded engines replay only reproduces victim choices,
+	 * thread timing still varies between runs.
+	 *
+	 * See `SchedulingOptions`.
+	 */
+	class Schedule
+	{
+	public:
+		/**
+		 * \brief Workers stepped by the simulation, in order
+		 */
+		std::vector<std::uint32_t> steps;
+
+		/**
+		 * \brief Victims picked by each worker on steal attempts, in order
+		 */
+		std::vector<std::vector<std::uint32_t>> victims;
+
+		void clear();
+
+		/**
+		 * \brief Writes the schedule in a simple text format
+		 */
+		void save(std::ostream& os) const;
+
+		/**
+		 * \brief Reads a schedule written by `save()`
+		 *
+		 * \returns false if the input is not a valid schedule
+		 */
+		bool load(std::istream& is);
+	};
+
+	/**
+	 * \brief Options controlling how an engine schedules tasks
+	 */
+	struct SchedulingOptions
+	{
+		/**
+		 * \brief Seed of the victim selection generators. Zero seeds them from
+		 * `std::random_device`, giving a different schedule on every run
+		 */
+		std::uint64_t seed = 0;
+
+		/**
+		 * \brief Runs every worker in the caller thread
+		 *
+		 * No background threads are created. Each time the caller waits, the engine
+		 * picks a worker (with the seeded generator, or from the replayed schedule)
+		 * and makes it run (or steal) one task, with `Engine::threadWorker()` returning
+		 * that worker. With a fixed seed the whole execution is reproducible.
+		 * Timers, I/O and the reactor depend on wall clock time and are not.
+		 */
+		bool simulation = false;
+
+		/**
+		 * \brief Records scheduling decisions, see `Engine::recordedSchedule()`
+		 */
+		bool record = false;
+
+		/**
+		 * \brief Schedule to replay, must outlive the engine. Once the schedule
+		 * is exhausted the seeded generators take over
+		 */
+		const Schedule* replay = nullptr;
+	};
+}
+#endif
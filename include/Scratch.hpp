@@ -0,0 +1,99 @@
+#ifndef TASKSYSTEM_SCRATCH_HPP
+#define TASKSYSTEM_SCRATCH_HPP
+
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <type_traits>
+#include <vector>
+
+namespace TaskSystem {
+	/**
+	 * \brief Linear allocator for temporary buffers of tasks
+	 *
+	 * Each worker owns one arena (See `Task::scratch()`). Allocating is a pointer
+	 * bump, and everything a task allocates is released at once when its task
+	 * function returns. When the current block is exhausted the arena chains a
+	 * bigger one, kept around for later tasks, so steady workloads stop touching the
+	 * global allocator after the first few tasks.
+	 *
+	 * Nothing allocated from the arena is destroyed, only trivially destructible
+	 * types can be allocated. NOT THREAD SAFE, one arena per worker.
+	 */
+	class Scratch
+	{
+	public:
+		/**
+		 * \brief Position of the arena, to go back to with `rewind()`
+		 */
+		struct Marker
+		{
+			std::size_t block;
+			std::size_t offset;
+		};
+
+		explicit Scratch(std::size_t blockSize = 64 * 1024);
+
+		/**
+		 * \brief Returns uninitialized storage of \p bytes bytes aligned to \p alignment
+		 */
+		void* allocate(std::size_t bytes, std::size_t alignment = alignof(std::max_align_t));
+
+		/**
+		 * \brief Returns uninitialized storage for \p count objects of type \p T
+		 */
+		template<typename T>
+		T* allocate(std::size_t count)
+		{
+			static_assert(std::is_trivially_destructible<T>::value,
+				"Scratch storage is never destroyed, T must be trivially destructible");
+			return static_cast<T*>(allocate(count * sizeof(T), alignof(T)));
+		}
+
+		Marker mark() const
+		{
+			return Marker{ _block, _offset };
+		}
+
+		/**
+		 * \brief Releases everything allocated after \p marker was taken
+		 */
+		void rewind(const Marker& marker)
+		{
+			_block = marker.block;
+			_offset = marker.offset;
+		}
+
+		/**
+		 * \brief Returns the total size of the blocks of the arena
+		 */
+		std::size_t capacity() const;
+
+		/**
+		 * \brief Returns the arena of the worker running in the caller thread
+		 *
+		 * Threads not running a worker get an arena of their own.
+		 */
+		static Scratch& current();
+
+		/**
+		 * \brief Makes \p scratch the arena of the caller thread
+		 *
+		 * \returns The previous arena of the thread, nullptr if it had none
+		 */
+		static Scratch* makeCurrent(Scratch* scratch);
+
+	private:
+		struct Block
+		{
+			std::unique_ptr<unsigned char[]> bytes;
+			std::size_t size;
+		};
+
+		std::vector<Block> _blocks;
+		std::size_t _blockSize;
+		std::size_t _block;
+		std::size_t _offset;
+	};
+}
+#endif
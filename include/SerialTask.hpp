@@ -0,0 +1,83 @@
+#ifndef TASKSYSTEM_SERIALTASK_HPP
+#define TASKSYSTEM_SERIALTASK_HPP
+
+#pragma once
+#include "Task.hpp"
+#include <atomic>
+#include <cstdint>
+#include <type_traits>
+
+namespace TaskSystem {
+	class Engine;
+
+	/**
+	 * \brief Runs a function in a task each time it is scheduled, one run at a time
+	 *
+	 * Scheduling it while it runs has the running task call the function once more
+	 * before returning, so runs are neither lost nor concurrent. The task is
+	 * embedded in the object, nothing is allocated from the worker pools. A run
+	 * goes idle at the end of its task function, right before the task finishes:
+	 * the next run waits for the task to be finished before reusing its storage,
+	 * which is a matter of a few instructions.
+	 *
+	 * Used for the tokens of `Pipeline` and the slots of `FlowGraph` function nodes.
+	 */
+	class SerialTask
+	{
+	public:
+		using Function = void(*)(void* context);
+
+		SerialTask(Engine& engine, Function function, void* context);
+
+		SerialTask(const SerialTask&) = delete;
+		SerialTask& operator=(const SerialTask&) = delete;
+
+		/**
+		 * \brief Submits a run (See `Engine::submit()`), or has the running one
+		 * run again. Thread safe
+		 */
+		void schedule();
+
+		/**
+		 * \brief Checks whether no run is pending and the tasks are done with
+		 * the object, which can then be destroyed
+		 */
+		bool idle() const;
+
+		/**
+		 * \brief Blocks the caller thread until the object is idle, parking it while
+		 * a run is pending (See `Task::blockUntilFinished()`)
+		 *
+		 * Meant for threads that are not workers, once nothing schedules it anymore.
+		 */
+		void blockUntilIdle();
+
+	private:
+		enum class State : std::uint32_t
+		{
+			Idle,
+			Running,
+			// Scheduled while running
+			RunAgain
+		};
+
+		// The object follows the task, so it needs no data (See `Task`)
+		struct Link
+		{
+			Task task;
+			SerialTask* owner;
+		};
+
+		static_assert(std::is_standard_layout<Link>::value, "The task must be the first member");
+
+		Link _run;
+		Engine& _engine;
+		Function _function;
+		void* _context;
+		std::atomic<State> _state;
+
+		void submit();
+		static void runTask(Task& task);
+	};
+}
+#endif
@@ -0,0 +1,96 @@
+#ifndef TASKSYSTEM_SIMD_HPP
+#define TASKSYSTEM_SIMD_HPP
+
+#pragma once
+#include <cstddef>
+#include <cstdint>
+
+namespace TaskSystem {
+	/**
+	 * \brief Vectorized leaf kernels of the parallel algorithms (See `Parallel.hpp`)
+	 *
+	 * Kernels are picked at runtime from what the CPU supports, so the library
+	 * builds for the x86-64 baseline and still uses the widest vectors available:
+	 *
+	 * - `sum()`, `min()` and `max()` have AVX-512, AVX2 and SSE2 versions
+	 * - `sortSmall()` and `partition()` have AVX-512 and AVX2 versions only, they
+	 *   rely on lane permutes and masked compression SSE2 lacks, and run the
+	 *   scalar versions on SSE2 CPUs
+	 *
+	 * Other architectures and compilers without target attributes get the scalar
+	 * versions.
+	 *
+	 * Floating point kernels assume there are no NaNs. Sums are accumulated in
+	 * several lanes, so float and double results may differ from a sequential sum
+	 * by rounding.
+	 */
+	namespace simd {
+		enum class Isa
+		{
+			Scalar,
+			Sse2,
+			Avx2,
+			Avx512
+		};
+
+		/**
+		 * \brief Returns the widest instruction set supported by the CPU
+		 */
+		Isa supportedIsa();
+
+		/**
+		 * \brief Returns the instruction set the kernels use, the supported one
+		 * unless changed by `setIsa()`
+		 */
+		Isa isa();
+
+		/**
+		 * \brief Makes the kernels use \p isa, or the supported one if narrower.
+		 * Meant for tests and benchmarks, not thread safe with running kernels
+		 */
+		void setIsa(Isa isa);
+
+		std::int64_t sum(const std::int32_t* data, std::size_t size);
+		float sum(const float* data, std::size_t size);
+		double sum(const double* data, std::size_t size);
+
+		/**
+		 * \brief Returns the smallest element, the largest value of the type if \p size is 0
+		 */
+		std::int32_t min(const std::int32_t* data, std::size_t size);
+		float min(const float* data, std::size_t size);
+		double min(const double* data, std::size_t size);
+
+		/**
+		 * \brief Returns the largest element, the lowest value of the type if \p size is 0
+		 */
+		std::int32_t max(const std::int32_t* data, std::size_t size);
+		float max(const float* data, std::size_t size);
+		double max(const double* data, std::size_t size);
+
+		/**
+		 * \brief Largest size sorted by `sortSmall()`
+		 */
+		constexpr const std::size_t SMALL_SORT_SIZE = 16;
+
+		/**
+		 * \brief Sorts up to `SMALL_SORT_SIZE` elements with a bitonic sorting network
+		 * held in vector registers, or an insertion sort in the scalar version
+		 */
+		void sortSmall(std::int32_t* data, std::size_t size);
+		void sortSmall(float* data, std::size_t size);
+
+		/**
+		 * \brief Reorders \p data so the elements less than \p pivot come first
+		 *
+		 * The vector versions compress the elements into two temporary buffers in
+		 * the scratch arena of the caller (See `Scratch::current()`) and copy them
+		 * back, the scalar one swaps in place. Not stable.
+		 *
+		 * \returns The number of elements less than \p pivot
+		 */
+		std::size_t partition(std::int32_t* data, std::size_t size, std::int32_t pivot);
+		std::size_t partition(float* data, std::size_t size, float pivot);
+	}
+}
+#endif
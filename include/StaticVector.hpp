@@ -169,12 +169,28 @@ namespace TaskSystem {
 			return *reinterpret_cast<T*>(&_storage[i]);
 		}
 
-		~StaticVector()
+		/**
+		 * \brief Destroys all the elements and makes room for \p maxSize new ones
+		 */
+		void reset(std::size_t maxSize)
+		{
+			clear();
+			_storage = vector(maxSize);
+		}
+
+		void clear()
 		{
 			for (std::size_t i = 0; i < _size; ++i)
 			{
 				reinterpret_cast<T*>(&_storage[i])->~T();
 			}
+
+			_size = 0;
+		}
+
+		~StaticVector()
+		{
+			clear();
 		}
 
 	private:
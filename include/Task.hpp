@@ -9,6 +9,9 @@
 #include <cstring>
 #include <thread>
 #include <new>
+#include <chrono>
+#include <exception>
+#include "Scratch.hpp"
 
 //src: https://blog.molecular-matters.com/2015/08/24/task-system-2-0-lock-free-work-stealing-part-1-basics/
 
@@ -20,6 +23,110 @@ namespace TaskSystem {
 
 	using TaskFunction = void(*)(Task& task);
 
+	/**
+	 * \brief Size classes of tasks, in bytes, including the task header
+	 *
+	 * Each pool stores tasks of a single size class (See `Pool`). Smaller classes
+	 * leave less room for task data but halve memory traffic and pool footprint for
+	 * workloads with small payloads. Tasks of 64 bytes or more start on a cache line.
+	 */
+	enum class TaskSize : std::size_t
+	{
+		Bytes32  = 32,
+		Bytes64  = 64,
+		Bytes128 = 128,
+		Bytes256 = 256,
+
+		Default  = Bytes128,
+		Largest  = Bytes256
+	};
+
+
+	/**
+	 * \brief Where a task may run
+	 *
+	 * Tasks with an affinity other than `any()` are pinned: they are routed to the
+	 * matching worker when submitted, and a worker stealing a task pinned somewhere
+	 * else forwards it instead of running it (See `Worker::submit()`).
+	 */
+	class Affinity
+	{
+	public:
+		enum class Kind : std::uint32_t
+		{
+			// Runs anywhere, the default
+			Any,
+			// Runs on the worker with the given id
+			Worker,
+			// Runs on workers of the given NUMA node, See `Worker::setNode()`
+			Node,
+			// Runs on the worker it is submitted to, it is never stolen
+			Local
+		};
+
+		constexpr Affinity() :
+			_bits{ 0 }
+		{}
+
+		static constexpr Affinity any()
+		{
+			return Affinity{ Kind::Any, 0 };
+		}
+
+		static constexpr Affinity worker(std::uint32_t id)
+		{
+			return Affinity{ Kind::Worker, id };
+		}
+
+		static constexpr Affinity node(std::uint32_t node)
+		{
+			return Affinity{ Kind::Node, node };
+		}
+
+		static constexpr Affinity local()
+		{
+			return Affinity{ Kind::Local, 0 };
+		}
+
+		constexpr Kind kind() const
+		{
+			return static_cast<Kind>(_bits >> INDEX_BITS);
+		}
+
+		/**
+		 * \brief Returns the worker id or node of the affinity
+		 */
+		constexpr std::uint32_t index() const
+		{
+			return _bits & INDEX_MASK;
+		}
+
+		constexpr bool pinned() const
+		{
+			return kind() != Kind::Any;
+		}
+
+		friend constexpr bool operator==(Affinity lhs, Affinity rhs)
+		{
+			return lhs._bits == rhs._bits;
+		}
+
+		friend constexpr bool operator!=(Affinity lhs, Affinity rhs)
+		{
+			return lhs._bits != rhs._bits;
+		}
+
+	private:
+		// Kept in 32 bits so it fits next to the task counter
+		static constexpr const std::uint32_t INDEX_BITS = 30;
+		static constexpr const std::uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+		std::uint32_t _bits;
+
+		constexpr Affinity(Kind kind, std::uint32_t index) :
+			_bits{ (static_cast<std::uint32_t>(kind) << INDEX_BITS) | (index & INDEX_MASK) }
+		{}
+	};
 
 	/**
 	 Represents a unit of work to be executed by the system
@@ -34,6 +141,10 @@ namespace TaskSystem {
 	 
 	 Finally, user defined POD data can be associated to the task during its construction,
 	 which is available later by calling `Task::getData()`. For non-POD data, see `tasks::closure()`.
+	 
+	 The Task object itself is only the header of the task. Task data is stored right
+	 after the header, in the rest of the storage of the task size class (See `TaskSize`),
+	 so tasks with data can only be created by a pool (See `Pool::createTask()`).
 	 */
 
 	class Task
@@ -56,24 +167,6 @@ namespace TaskSystem {
 		 */
 		Task(TaskFunction taskFunction, Task* parent = nullptr);
 
-		/**
-		 * \brief Initializes a task given a function to execute, data associated with the task, and
-		 * a parent task
-		 *
-		 * \tparam Data Must be a POD type
-		 * \param taskFunction Function to be executed when the task is processed
-		 * \param data Data associated with the task. The data is memcpy-ed into the
-		 * task, and can be accessed later using `Task::getData()`
-		 * \param parent Parent task. If nullptr the ob has no associated parent task
-		 */
-		template<typename Data>
-		Task(TaskFunction taskFunction, const Data& data, Task* parent = nullptr) :
-			Task{ taskFunction, parent }
-		{
-			static_assert(std::is_pod<Data>::value, "Data must be POD");
-			setData(data);
-		}
-
 		/**
 		 * \brief Executes the task function in the caller thread.
 		 *
@@ -82,11 +175,64 @@ namespace TaskSystem {
 		 */
 		bool run();
 
+		/**
+		 * \brief Runs the task like `run()`, reporting whether it finished within the call
+		 *
+		 * \returns true if the task and all its children finished, and the caller
+		 * thread marked it as finished (running its `whenFinished()` callback). Its
+		 * storage can then be reused right away. false if the task was already finished
+		 * or children still running elsewhere will finish it later.
+		 */
+		bool runInline();
+
 		/**
 		 * \brief Checks whether the task and all its child tasks have been run
 		 */
 		bool finished() const;
 
+		/**
+		 * \brief Blocks the caller thread until the task is finished
+		 *
+		 * Unlike `Worker::wait()`, the caller does not help running other tasks
+		 * while waiting, it parks on the task counter instead (See `futex`).
+		 * This is the way threads not owned by the engine should wait for tasks.
+		 */
+		void blockUntilFinished();
+
+		/**
+		 * \brief Blocks the caller thread until the task is finished or
+		 * \p timeout expires
+		 *
+		 * \returns true if the task finished, false if the timeout expired first.
+		 */
+		bool blockUntilFinishedFor(std::chrono::nanoseconds timeout);
+
+		/**
+		 * \brief Checks whether the task function, the one of a descendant or a
+		 * `whenFinished()` callback threw an exception
+		 */
+		bool failed() const;
+
+		/**
+		 * \brief Returns the first exception thrown by the task function or by the
+		 * one of a descendant, nullptr if none threw
+		 *
+		 * Exceptions are kept out of line, in a table indexed by task, so running
+		 * tasks that do not throw costs nothing more. The exception stays there after
+		 * being read, until a wait rethrows it (See `takeException()`), or the task
+		 * is discarded or rearmed. The task stays `failed()` after that.
+		 */
+		std::exception_ptr exception() const;
+
+		/**
+		 * \brief Returns the exception like `exception()` and erases it from the table,
+		 * so it is handed over once
+		 *
+		 * The waits rethrowing the exception of a task take it (See `Worker::wait()`),
+		 * tasks on the stack never reused leave nothing behind.
+		 */
+		std::exception_ptr takeException();
+
 		/**
 		 * \brief Returns the number of children unfinished tasks left
 		 */
@@ -115,37 +261,123 @@ namespace TaskSystem {
 		 * task is marked as finished. Invoking this method outside the task function
 		 * has undefined behavior.
 		 *
+		 * The callback runs once the task and its children are done, right before the
+		 * task is seen finished, so waiters of the task see everything it did. The
+		 * storage of the task is still in use then, it must not be reused from the
+		 * callback.
+		 *
 		 * \param taskFunction Function that will be invoked when the task finishes
 		 */
 		void whenFinished(TaskFunction taskFunction);
 
+		/**
+		 * \brief Re-initializes a finished task with no parent so it can be submitted
+		 * again, keeping the data associated with the task
+		 *
+		 * Used to run the same task multiple times (See `Worker::submitEvery()`).
+		 * Rearming a task that is not finished has undefined behavior.
+		 *
+		 * \param taskFunction Function to be executed when the task is processed
+		 */
+		void rearm(TaskFunction taskFunction);
+
+		/**
+		 * \brief Sets where the task may run. Must be called before submitting the task
+		 */
+		void setAffinity(Affinity affinity);
+
+		Affinity affinity() const;
+
+		/**
+		 * \brief Returns the scratch arena of the worker running the task
+		 *
+		 * Meant for temporary buffers of the task function, e.g.
+		 * `task.scratch().allocate<int>(n)`. Everything allocated is released when
+		 * the task function returns, so it must not be used by children or by the
+		 * `whenFinished()` callback. See `Scratch`.
+		 */
+		Scratch& scratch();
+
 		std::uintptr_t id() const;
 		struct Payload
 		{
+			// The counter is the only field written by other threads (children
+			// finishing), the rest of the header and the task data are written once
+			// and then only read. It shares a cache line with the start of the data:
+			// whole tasks of 32 and 64 bytes, giving it a line of its own would
+			// double their size. In a 128 byte task a line of its own leaves 48 bytes
+			// of data, and spawn/complete was not faster with it (105-111 ns/task
+			// against 100-108, release build on a single core, which cannot show
+			// false sharing between workers)
+			std::atomic<std::int32_t> unfinishedChildrenTasks;
+			// Fills the padding after the counter, the header stays 24 bytes
+			Affinity affinity;
 			TaskFunction function;
 			Task* parent;
-			std::atomic<std::int32_t> unfinishedChildrenTasks;
 		};
 	private:
 
 		Payload _payload;
 
-		static constexpr const std::size_t TASK_PAYLOAD_SIZE = sizeof(Payload);
-		static constexpr const std::size_t TASK_MAX_PADDING_SIZE = 64 * 2;
-		static constexpr const std::size_t TASK_PADDING_SIZE = TASK_MAX_PADDING_SIZE - TASK_PAYLOAD_SIZE;
-		static_assert(TASK_PAYLOAD_SIZE < TASK_MAX_PADDING_SIZE, "Task payload does not fit in a cache line");
+		static constexpr const std::size_t TASK_HEADER_SIZE = sizeof(Payload);
+		static constexpr const std::size_t TASK_MAX_DATA_SIZE =
+			static_cast<std::size_t>(TaskSize::Largest) - TASK_HEADER_SIZE;
+
+		// The highest bits of the counter are flags, not children. Set once
+		// the task or a descendant threw, its exception is in the exceptions
+		// table (See `exception()`)
+		static constexpr const std::int32_t FAILED_FLAG = 1 << 30;
+		static constexpr const std::int32_t COUNTER_MASK = FAILED_FLAG - 1;
 
-		char _padding[TASK_PADDING_SIZE];
+		enum class Execution
+		{
+			AlreadyFinished,
+			// Children left, the last one finishes the task
+			Pending,
+			Completed
+		};
 
-		void finish();
+		Execution execute();
+		// Records the exception thrown by the task function for the task and
+		// the ancestors that did not fail yet
+		void fail(std::exception_ptr exception);
+		// Returns true if the task was finished by the caller
+		bool finish();
+		Task* complete();
 		void incrementUnfinishedChildrenTasks();
-		bool decrementUnfinishedChildrenTasks();
+		// Releases one unit of the counter, the task function or a child. The
+		// last one completes the task and returns true, \p parent is then the
+		// parent of the task, whose unit must be released next
+		bool decrementUnfinishedChildrenTasks(Task*& parent);
+
+		friend class Pool;
+
+		/**
+		 * \brief Initializes a task given a function to execute, data associated with the task, and
+		 * a parent task
+		 *
+		 * The data is written past `sizeof(Task)`, so only `Pool` constructs tasks with
+		 * data, in storage big enough for it (See `Pool::createTask()`).
+		 *
+		 * \tparam Data Must be a POD type
+		 * \param taskFunction Function to be executed when the task is processed
+		 * \param data Data associated with the task. The data is memcpy-ed into the
+		 * task, and can be accessed later using `Task::getData()`
+		 * \param parent Parent task. If nullptr the ob has no associated parent task
+		 */
+		template<typename Data>
+		Task(TaskFunction taskFunction, const Data& data, Task* parent = nullptr) :
+			Task{ taskFunction, parent }
+		{
+			static_assert(std::is_pod<Data>::value, "Data must be POD");
+			setData(data);
+		}
 
 		template<typename Data>
-		std::enable_if_t<std::is_pod<Data>::value && sizeof(Data) <= TASK_PADDING_SIZE>
+		std::enable_if_t<std::is_pod<Data>::value && sizeof(Data) <= TASK_MAX_DATA_SIZE>
 			setData(const Data & data)
 		{
-			std::memcpy(&_padding[0], &data, sizeof(Data));
+			std::memcpy(this->data(), &data, sizeof(Data));
 		}
 
 	public:
@@ -161,7 +393,7 @@ namespace TaskSystem {
 		template<typename Data>
 		const Data& getData() const
 		{
-			static_assert(sizeof(Data) <= TASK_PADDING_SIZE, "Objects of that type do not fit in "
+			static_assert(sizeof(Data) <= TASK_MAX_DATA_SIZE, "Objects of that type do not fit in "
 				"the task data storage");
 			return *reinterpret_cast<const Data*>(data());
 		}
@@ -178,7 +410,7 @@ namespace TaskSystem {
 		template<typename Data>
 		Data& getData()
 		{
-			static_assert(sizeof(Data) <= TASK_PADDING_SIZE, "Objects of that type do not fit in "
+			static_assert(sizeof(Data) <= TASK_MAX_DATA_SIZE, "Objects of that type do not fit in "
 				"the task data storage");
 			return *reinterpret_cast<Data*>(data());
 		}
@@ -198,7 +430,8 @@ namespace TaskSystem {
 		 *
 		 * This function constructs in place an object of the given type
 		 * at the beginning of the task data storage. Users must manually
-		 * invoke object destructor later.
+		 * invoke object destructor later. The object must fit in the data storage
+		 * of the task size class, see `Pool::maxDataSize()`.
 		 *
 		 * \tparam T Type of the object that will be constructed
 		 * \param args Constructor arguments
@@ -206,7 +439,7 @@ namespace TaskSystem {
 		template<typename T, typename... Args>
 		void constructData(Args&& ... args)
 		{
-			static_assert(sizeof(T) <= TASK_PADDING_SIZE, "Objects of that type do not fit in "
+			static_assert(sizeof(T) <= TASK_MAX_DATA_SIZE, "Objects of that type do not fit in "
 				"the task data storage");
 
 			new(data()) T{ std::forward<Args>(args)... };
@@ -214,15 +447,17 @@ namespace TaskSystem {
 
 		/**
 		 * \brief Returns the maximum size of the data that can be associated with a task
+		 * of the given size class
 		 */
-		static constexpr std::size_t maxDataSize()
+		static constexpr std::size_t maxDataSize(TaskSize size = TaskSize::Default)
 		{
-			return TASK_PADDING_SIZE;
+			return static_cast<std::size_t>(size) - TASK_HEADER_SIZE;
 		}
 		
 	};
 	
 	static_assert(std::is_trivially_destructible<Task>::value, "Task type must be trivially destructible");
+	static_assert(sizeof(Task) < static_cast<std::size_t>(TaskSize::Bytes32), "Task header does not fit in the smallest size class");
 }
 
 
@@ -0,0 +1,118 @@
+#ifndef TASKSYSTEM_TASKGROUP_HPP
+#define TASKSYSTEM_TASKGROUP_HPP
+
+#pragma once
+#include "Engine.hpp"
+#include <atomic>
+#include <exception>
+#include <mutex>
+
+namespace TaskSystem {
+	/**
+	 * \brief Runs functions as tasks and waits for all of them at once
+	 *
+	 * The tasks are children of a root task embedded in the group, so waiting for
+	 * a set of tasks needs neither a dummy root from a pool nor any heap allocation.
+	 * Functions are stored in the data of their task when they fit (See
+	 * `tasks::closure()`). A group can be used from inside tasks, and its functions
+	 * can run more functions in the same group or in groups of their own.
+	 *
+	 * The first exception thrown by a function cancels the group and is rethrown
+	 * by `wait()`. The group waits for its tasks when destroyed, so they never
+	 * outlive what they reference.
+	 *
+	 * \code
+	 * TaskGroup group{ engine };
+	 * group.run([&] { left = count(tree.left); });
+	 * group.run([&] { right = count(tree.right); });
+	 * group.wait();
+	 * \endcode
+	 */
+	class TaskGroup
+	{
+	public:
+		enum class Status
+		{
+			// Every function ran
+			Complete,
+			// The group was cancelled, functions not started by then were skipped
+			Cancelled
+		};
+
+		explicit TaskGroup(Engine& engine);
+		~TaskGroup();
+
+		TaskGroup(const TaskGroup&) = delete;
+		TaskGroup& operator=(const TaskGroup&) = delete;
+
+		/**
+		 * \brief Runs `function()` in a task of the group
+		 *
+		 * The task is allocated from the pool of the worker calling, and submitted
+		 * to it. Called outside the engine workers or with the pool full, the
+		 * function runs right away in the caller thread instead.
+		 */
+		template<typename Function>
+		void run(const Function& function)
+		{
+			Worker* worker = _engine.threadWorker();
+			Task* task = worker != nullptr ? worker->pool().createClosureTaskAsChild(
+				[this, function](Task&) { invoke(function); }, &_root) : nullptr;
+
+			if (task == nullptr)
+			{
+				invoke(function);
+				return;
+			}
+
+			worker->submit(task);
+		}
+
+		/**
+		 * \brief Waits for all the functions run so far, helping to run tasks
+		 * meanwhile from a worker thread or parking other threads, and resets the
+		 * group so it can be used again
+		 *
+		 * \returns Whether the group was cancelled
+		 * \throws The first exception thrown by a function of the group
+		 */
+		Status wait();
+
+		/**
+		 * \brief Skips the functions of the group that did not start yet.
+		 * Running ones are not interrupted, they can poll `cancelled()`
+		 */
+		void cancel();
+
+		bool cancelled() const;
+
+	private:
+		Engine& _engine;
+		Task _root;
+		std::atomic<bool> _cancelled;
+		std::mutex _exceptionMutex;
+		std::exception_ptr _exception;
+
+		template<typename Function>
+		void invoke(const Function& function)
+		{
+			if (cancelled())
+			{
+				return;
+			}
+
+			try
+			{
+				function();
+			}
+			catch (...)
+			{
+				fail(std::current_exception());
+			}
+		}
+
+		void fail(std::exception_ptr exception);
+		void join();
+	};
+}
+#endif
@@ -0,0 +1,163 @@
+#ifndef TASKSYSTEM_TIMERWHEEL_HPP
+#define TASKSYSTEM_TIMERWHEEL_HPP
+
+#pragma once
+#include "Task.hpp"
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <vector>
+
+//one wheel per worker NOT THREAD SAFE
+namespace TaskSystem {
+	/**
+	 * \brief Hierarchical timing wheel storing delayed and periodic tasks
+	 *
+	 * Time is split in ticks of `TICK` length. The wheel has `LEVELS` levels of
+	 * `SLOTS` slots each, level N slots covering `SLOTS^N` ticks. A timer is
+	 * stored in the lowest level where its deadline and the current tick differ,
+	 * and cascades down to lower levels as the current tick approaches the deadline.
+	 * Scheduling and cancelling are O(1), advancing is O(1) per elapsed tick plus
+	 * the expired timers.
+	 *
+	 * Each worker owns a wheel and advances it from its own thread, so no
+	 * synchronization is needed. See `Worker::submitAfter()`.
+	 */
+	class TimerWheel
+	{
+	public:
+		using Clock = std::chrono::steady_clock;
+		using TimerId = std::uint64_t;
+
+		static constexpr const TimerId INVALID_TIMER = 0;
+		static constexpr const std::size_t SLOTS_BITS = 6;
+		static constexpr const std::size_t SLOTS = 1 << SLOTS_BITS;
+		static constexpr const std::size_t LEVELS = 4;
+
+		static constexpr Clock::duration TICK = std::chrono::microseconds(100);
+
+		explicit TimerWheel(Clock::time_point start = Clock::now());
+
+		/**
+		 * \brief Schedules \p task to be fired at \p deadline, and every
+		 * \p period after that if period is not zero
+		 *
+		 * \returns An id that can be used to cancel the timer
+		 */
+		TimerId schedule(Task* task, Clock::time_point deadline, Clock::duration period = Clock::duration::zero());
+
+		/**
+		 * \brief Removes a timer from the wheel
+		 *
+		 * \param fired If not nullptr, set to whether the timer fired at least once,
+		 * that is, whether its task was already handed to the `advance()` callback
+		 * \returns The task associated with the timer, nullptr if the timer
+		 * already expired (and was not periodic) or was cancelled before
+		 */
+		Task* cancel(TimerId id, bool* fired = nullptr);
+
+		/**
+		 * \brief Advances the wheel up to \p now, invoking \p callback for each
+		 * expired timer
+		 *
+		 * \param callback Invoked as `callback(Task* task, TaskFunction function, bool rearm)`,
+		 * where function is the task function the task had when it was scheduled and
+		 * rearm is true if the timer is periodic and the task already fired before, so it
+		 * has to be rearmed (See `Task::rearm()`). Periodic timers are rescheduled before
+		 * invoking the callback.
+		 */
+		template<typename Callback>
+		void advance(Clock::time_point now, Callback callback)
+		{
+			const std::uint64_t target = tickOf(now);
+
+			if (_activeTimers == 0)
+			{
+				_currentTick = std::max(_currentTick, target);
+				return;
+			}
+
+			while (_currentTick < target && _activeTimers > 0)
+			{
+				++_currentTick;
+				cascade();
+
+				// Pop expired timers one by one, so the callback can safely cancel
+				// other timers of the same slot
+				std::uint32_t& slot = _slots[0][_currentTick & (SLOTS - 1)];
+
+				while (slot != NIL)
+				{
+					const std::uint32_t index = slot;
+					Entry& entry = _entries[index];
+					Task* task = entry.task;
+					const TaskFunction function = entry.function;
+					const bool periodic = entry.periodTicks > 0;
+					const bool rearm = periodic && entry.fired;
+
+					unlink(index);
+					entry.fired = true;
+
+					if (periodic)
+					{
+						entry.deadlineTick += entry.periodTicks;
+						place(index);
+					}
+					else
+					{
+						release(index);
+					}
+
+					callback(task, function, rearm);
+				}
+			}
+
+			_currentTick = std::max(_currentTick, target);
+		}
+
+		/**
+		 * \brief Returns the earliest time point at which a timer may expire,
+		 * `Clock::time_point::max()` if the wheel is empty
+		 *
+		 * The result is a lower bound: timers stored in upper levels report
+		 * the start of their slot. Useful to bound how long an idle worker sleeps.
+		 */
+		Clock::time_point nextExpiry() const;
+
+		bool empty() const;
+		std::size_t size() const;
+
+	private:
+		static constexpr const std::uint32_t NIL = ~std::uint32_t{ 0 };
+
+		struct Entry
+		{
+			Task* task;
+			TaskFunction function;
+			std::uint64_t deadlineTick;
+			std::uint64_t periodTicks;
+			std::uint32_t next;
+			std::uint32_t prev;
+			std::uint32_t generation;
+			std::uint32_t location;
+			bool fired;
+		};
+
+		std::vector<Entry> _entries;
+		std::uint32_t _freeList;
+		std::uint32_t _slots[LEVELS][SLOTS];
+		std::uint32_t _overflow;
+		Clock::time_point _start;
+		std::uint64_t _currentTick;
+		std::size_t _activeTimers;
+
+		std::uint64_t tickOf(Clock::time_point time) const;
+		std::uint64_t deadlineTickOf(Clock::time_point time) const;
+		std::uint32_t& head(std::uint32_t location);
+		void place(std::uint32_t index);
+		void unlink(std::uint32_t index);
+		void release(std::uint32_t index);
+		void cascade();
+	};
+}
+#endif
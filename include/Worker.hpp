@@ -5,7 +5,14 @@
 #include "Task.hpp"
 #include "Pool.hpp"
 #include <thread>
+#include <chrono>
+#include <vector>
 #include "TaskQueue.hpp"
+#include "TimerWheel.hpp"
+#include "IoRing.hpp"
+#include "Scratch.hpp"
+#include <memory>
+#include <mutex>
 
 
 namespace TaskSystem {
@@ -14,6 +21,23 @@ namespace TaskSystem {
 
 	using WorkQueue = TaskQueue;
 
+	/**
+	 * \brief How a worker schedules a task submitted from another task
+	 *
+	 * See `Worker::submit()`.
+	 */
+	enum class SpawnPolicy
+	{
+		// Queue the task and keep running the caller, thieves may pick the task
+		HelpFirst,
+		// Run the task right away in the caller, like a function call. This is
+		// not work-first scheduling: the rest of the caller is not offered to
+		// thieves meanwhile, it resumes once the task returns
+		Inline,
+		// Inline once the worker queue holds enough tasks for thieves, help-first otherwise
+		Auto
+	};
+
 	/**
 	 * \ingroup tasks
 	 * \
@@ -24,52 +48,332 @@ namespace TaskSystem {
 		enum class Mode
 		{
 			Background,
-			Foreground
+			Foreground,
+			// Run by the engine simulation in the caller thread, see `SchedulingOptions::simulation`
+			Simulated
 		};
 
 		enum class State
 		{
 			Idle,
 			Running,
+			// Asked to pause, finishing its current task
+			Pausing,
+			Paused,
 			Stopping
 		};
 
-		Worker(const std::uint64_t id, Engine* engine, std::size_t poolSize, Mode mode = Mode::Background);
+		Worker(const std::uint64_t id, Engine* engine, std::size_t poolSize, Mode mode = Mode::Background,
+			TaskSize taskSize = TaskSize::Default, std::size_t poolGenerations = 1);
 		~Worker();
 
 		std::uint64_t id() const;
 		std::thread::id threadId() const;
 		bool running() const;
 		void run();
+
+		/**
+		 * \brief Stops the worker, joining its thread if it is a background worker
+		 *
+		 * Tasks left in the work queue are not run. Stopping a worker that is not
+		 * running does nothing.
+		 */
 		void stop();
+
+		/**
+		 * \brief Asks a running background worker to park once its current task is done
+		 *
+		 * Other workers can still steal the tasks queued in a paused worker. Foreground
+		 * and simulated workers are never paused.
+		 *
+		 * \returns true if the worker was running and is now pausing, false otherwise
+		 */
+		bool pause();
+
+		/**
+		 * \brief Resumes a worker paused with `pause()`
+		 */
+		void resume();
+
+		/**
+		 * \brief Checks whether the worker acknowledged a `pause()` and is parked
+		 */
+		bool paused() const;
+
+		/**
+		 * \brief Checks whether the worker parked itself for lack of work
+		 *
+		 * See `Engine::setScaling()`.
+		 */
+		bool parked() const;
+
+		/**
+		 * \brief Submits \p task to the worker queue, or to the worker matching its affinity
+		 *
+		 * Must be called from the worker thread. Tasks pinned to another worker, or to a
+		 * node this worker does not belong to, are posted to that worker (See `post()`).
+		 * When the queue is full, the engine overflow policy decides what happens to
+		 * the task (See `Engine::setOverflowPolicy()`).
+		 */
 		void submit(Task* task);
+
+		/**
+		 * \brief Submits a task calling \p taskFunction, allocated from the worker pool
+		 * as a child of \p parent (See `submit(Task*)`)
+		 *
+		 * A full pool follows the overflow policy of the engine: the task spills,
+		 * except under `OverflowPolicy::Discard` where the function is lost and
+		 * under `OverflowPolicy::Fail` where `OverflowError` is thrown.
+		 */
+		void submit(TaskFunction taskFunction, Task* parent = nullptr);
+
+		/**
+		 * \brief Delivers \p task to the mailbox of this worker. Thread safe
+		 *
+		 * Used to submit tasks from other workers (or other threads). The worker checks
+		 * its mailbox before its own queue: pinned tasks are run from there, other
+		 * tasks are moved to the queue, where they can be stolen.
+		 */
+		void post(Task* task);
+
+		/**
+		 * \brief Returns the NUMA node of the worker, 0 unless set with `setNode()`
+		 */
+		std::uint32_t node() const;
+
+		/**
+		 * \brief Sets the NUMA node tasks pinned with `Affinity::node()` are routed by
+		 *
+		 * The engine does not pin worker threads to cores, so the node is whatever the
+		 * user placed the thread on. Set it before submitting node pinned tasks.
+		 */
+		void setNode(std::uint32_t node);
+
+		/**
+		 * \brief Submits \p task following the given spawn policy
+		 *
+		 * Help-first is what `submit(Task*)` does. Inline runs the task (and, if
+		 * they are spawned inline too, its children) before returning. The
+		 * continuation of the caller cannot be stolen meanwhile, so this trades
+		 * parallelism for bounded queues and pools. Tasks pinned to other workers
+		 * are always queued. With `SpawnPolicy::Auto` tasks run inline
+		 * only while the worker queue already holds enough work to keep thieves busy.
+		 *
+		 * \returns true if the task finished inline. The caller still owns it, once
+		 * done with it giving it back with `Pool::release()` keeps pool usage of
+		 * recursive algorithms proportional to the recursion depth.
+		 */
+		bool submit(Task* task, SpawnPolicy policy);
+
+		/**
+		 * \brief Submits \p task once \p delay has elapsed
+		 *
+		 * The task is stored in the worker timer wheel, which the worker advances
+		 * when it runs out of tasks (and every few tasks otherwise). Timers of the
+		 * foreground worker only fire while it is waiting (See `wait()`).
+		 *
+		 * \returns An id that can be passed to `cancelTimer()`
+		 */
+		TimerWheel::TimerId submitAfter(TimerWheel::Clock::duration delay, Task* task);
+
+		/**
+		 * \brief Submits \p task every \p period, starting one period from now
+		 *
+		 * The same task is rearmed and submitted again at each period (See `Task::rearm()`),
+		 * so it must not be a closure task and it must not have a parent.
+		 * If the previous run is not finished when the period expires, that period is skipped.
+		 *
+		 * \returns An id that can be passed to `cancelTimer()`
+		 */
+		TimerWheel::TimerId submitEvery(TimerWheel::Clock::duration period, Task* task);
+
+		/**
+		 * \brief Cancels a timer previously scheduled in this worker
+		 *
+		 * Delayed tasks that did not fire yet are discarded. Periodic tasks that
+		 * already fired are left alone, the run in progress (if any) finishes them,
+		 * so a periodic task can cancel its own timer.
+		 *
+		 * \returns true if the timer was found, false if it already fired or was cancelled
+		 */
+		bool cancelTimer(TimerWheel::TimerId id);
+
+		/**
+		 * \brief Returns the earliest time a timer of this worker may fire
+		 */
+		TimerWheel::Clock::time_point nextTimerExpiry() const;
+
+		/**
+		 * \brief Runs tasks from the worker queue (or stolen from other workers)
+		 * until \p task is finished
+		 *
+		 * \throws The exception thrown by \p task or by one of its descendants, if
+		 * any threw, taken from the task so only one wait throws it (See
+		 * `Task::takeException()`). The other wait functions rethrow it too, once
+		 * the tasks they return for are finished; `waitAll()` throws the first one
+		 * and drops the others
+		 */
 		void wait(Task* task);
+
+		/**
+		 * \brief Like `wait()`, but gives up once \p timeout expires
+		 *
+		 * \returns true if the task finished, false if the timeout expired first.
+		 */
+		template<typename Rep, typename Period>
+		bool waitFor(Task* task, const std::chrono::duration<Rep, Period>& timeout)
+		{
+			return waitUntil(task, std::chrono::steady_clock::now() +
+				std::chrono::duration_cast<std::chrono::steady_clock::duration>(timeout));
+		}
+
+		/**
+		 * \brief Like `wait()`, but gives up once \p deadline is reached
+		 *
+		 * \returns true if the task finished, false if the deadline was reached first.
+		 */
+		bool waitUntil(Task* task, std::chrono::steady_clock::time_point deadline);
+
+		/**
+		 * \brief Runs tasks until all the \p count tasks in \p tasks are finished
+		 */
+		void waitAll(Task* const* tasks, std::size_t count);
+		void waitAll(const std::vector<Task*>& tasks);
+
+		/**
+		 * \brief Runs tasks until any of the \p count tasks in \p tasks is finished
+		 *
+		 * \returns The index of the finished task in \p tasks
+		 */
+		std::size_t waitAny(Task* const* tasks, std::size_t count);
+		std::size_t waitAny(const std::vector<Task*>& tasks);
+
+		/**
+		 * \brief Keeps running tasks until \p condition returns true or
+		 * \p deadline is reached
+		 *
+		 * This is the building block of all the wait functions, and can be used
+		 * to wait for things that are not tasks (counters, flags, etc) without
+		 * stalling the worker.
+		 *
+		 * \returns true if the condition was met, false if the deadline was reached first.
+		 */
+		template<typename Condition>
+		bool helpUntil(Condition condition,
+			std::chrono::steady_clock::time_point deadline = std::chrono::steady_clock::time_point::max())
+		{
+			const bool checkDeadline = deadline != std::chrono::steady_clock::time_point::max();
+
+			while (!condition())
+			{
+				if (checkDeadline && std::chrono::steady_clock::now() >= deadline)
+				{
+					return false;
+				}
+
+				step();
+			}
+
+			return true;
+		}
+		/**
+		 * \brief Returns the task pool of the worker
+		 *
+		 * If a frame began since the last call (See `Engine::beginFrame()`), the
+		 * pool moves to its next generation first, once that one can be reused.
+		 */
 		Pool& pool();
 		const Pool& pool() const;
+
+		/**
+		 * \brief Returns the asynchronous file I/O ring of the worker
+		 *
+		 * The ring is created on first use. Continuations of completed operations
+		 * are submitted to this worker when it polls the ring, which happens when it runs
+		 * out of tasks and every few tasks otherwise. As with `submit()`, the ring
+		 * must only be used from the worker thread.
+		 */
+		IoRing& io();
 		void join();
 
 		const std::atomic<State>& state() const;
 		std::size_t totalTasksRun() const;
 		std::size_t totalTasksDiscarded() const;
+
+		/**
+		 * \brief Returns the times the pool and the queue of the worker were full,
+		 * and what the overflow policy did (See `Engine::setOverflowPolicy()`)
+		 */
+		OverflowCounters overflowCounters() const;
+
+		/**
+		 * \brief Returns the number of steal attempts that found the victim queue empty
+		 */
+		std::size_t totalStealFailures() const;
 		std::size_t cyclesWithoutTasks() const;
 		std::size_t maxCyclesWithoutTasks() const;
 
 	private:
+		friend class Engine;
+
 		WorkQueue _workQueue;
 		Pool _pool;
+		TimerWheel _timers;
+		std::unique_ptr<IoRing> _io;
 		Engine* _engine;
 		std::thread _workerThread;
 		std::thread::id _workerThreadId;
 		Mode _mode;
 		std::atomic<State> _state;
+		// Bumped to wake the thread up when parked in the paused state
+		std::atomic<std::int32_t> _wakeups;
 		std::size_t _totalTasksRun;
 		std::size_t _totalTasksDiscarded;
+		// Queue overflows, the pool counts its own
+		OverflowCounters _overflows;
+		std::size_t _totalStealFailures;
 		std::size_t _cyclesWithoutTasks;
+		// Steals tried and failed since the last task run (See `Engine::shouldPark()`)
+		std::size_t _idleSteals;
+		std::size_t _idleStealFailures;
 		std::size_t _maxCyclesWithoutTasks;
 		std::uint64_t _id;
+		std::uint64_t _randomState;
+		const std::vector<std::uint32_t>* _replayVictims;
+		std::size_t _replayCursor;
+		std::vector<std::uint32_t>* _recordedVictims;
+		std::size_t _frame;
+		Scratch _scratch;
+		Scratch* _previousScratch;
+		std::atomic<bool> _parked;
+		std::uint32_t _node;
+		std::mutex _mailboxMutex;
+		std::vector<Task*> _mailbox;
+		// Mail taken by the worker, only accessed from the worker thread
+		std::vector<Task*> _inbox;
+		std::size_t _inboxCursor;
+		// Tasks in the mailbox and the inbox
+		std::atomic<std::size_t> _pendingMail;
 
 		Task* getTask();
 		void getTasks();
+		bool runNextTask();
+		void step();
+		std::size_t nextVictim();
+		void configureScheduling(std::uint64_t seed,
+			const std::vector<std::uint32_t>* replayVictims,
+			std::vector<std::uint32_t>* recordedVictims);
+		void pollEvents();
+		void wake();
+		void park();
+		Task* takeMail();
+		void enqueue(Task* task, OverflowPolicy policy);
+		// Submits a task continuing an event (timer, I/O or blocking call)
+		void submitContinuation(Task* task);
+		void overflow(Task* task, OverflowPolicy policy);
+		bool runsHere(Affinity affinity) const;
+		Worker* route(Affinity affinity);
+		std::size_t discardQueuedTasks();
 	};
 }
 #endif
\ No newline at end of file
@@ -0,0 +1,173 @@
+#include "../include/BlockingPool.hpp"
+
+namespace TaskSystem {
+	BlockingPool::BlockingPool(std::size_t maxThreads, std::chrono::milliseconds keepAlive) :
+		_maxThreads{ maxThreads > 0 ? maxThreads : 1 },
+		_keepAlive{ keepAlive },
+		_completedCount{ 0 },
+		_idleThreads{ 0 },
+		_runningJobs{ 0 },
+		_stopping{ false }
+	{
+	}
+
+	BlockingPool::~BlockingPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			_stopping = true;
+		}
+
+		_available.notify_all();
+
+		// Threads drain the remaining jobs before exiting
+		for (auto& thread : _threads)
+		{
+			if (thread.joinable())
+			{
+				thread.join();
+			}
+		}
+	}
+
+	void BlockingPool::submit(Task* task, Task* continuation)
+	{
+		if (task == nullptr)
+		{
+			return;
+		}
+
+		std::list<std::thread> retired;
+		std::unique_lock<std::mutex> lock{ _mutex };
+
+		_jobs.push_back(Job{ task, continuation });
+		takeRetired(retired);
+
+		if (_idleThreads >= _jobs.size() || _threads.size() >= _maxThreads)
+		{
+			lock.unlock();
+			_available.notify_one();
+		}
+		else
+		{
+			// Every thread is busy, grow the pool. The new thread needs
+			// its own position in the list to retire itself later
+			_threads.emplace_back();
+			auto self = std::prev(_threads.end());
+			*self = std::thread{ [this, self] { threadLoop(self); } };
+			lock.unlock();
+		}
+
+		for (auto& thread : retired)
+		{
+			thread.join();
+		}
+	}
+
+	std::size_t BlockingPool::discardPending()
+	{
+		std::deque<Job> jobs;
+		std::vector<Task*> completed;
+
+		{
+			std::unique_lock<std::mutex> lock{ _mutex };
+			jobs.swap(_jobs);
+			_done.wait(lock, [this] { return _runningJobs == 0; });
+			completed.swap(_completed);
+			_completedCount.store(0, std::memory_order_relaxed);
+		}
+
+		std::size_t discarded = completed.size();
+
+		for (const Job& job : jobs)
+		{
+			job.task->discard();
+			discarded++;
+
+			if (job.continuation != nullptr)
+			{
+				job.continuation->discard();
+				discarded++;
+			}
+		}
+
+		for (Task* continuation : completed)
+		{
+			continuation->discard();
+		}
+
+		return discarded;
+	}
+
+	std::size_t BlockingPool::threads() const
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		return _threads.size() - _retired.size();
+	}
+
+	std::size_t BlockingPool::pending() const
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		return _jobs.size();
+	}
+
+	void BlockingPool::threadLoop(std::list<std::thread>::iterator self)
+	{
+		std::unique_lock<std::mutex> lock{ _mutex };
+
+		while (true)
+		{
+			if (_jobs.empty())
+			{
+				if (_stopping)
+				{
+					return;
+				}
+
+				++_idleThreads;
+				const bool woken = _available.wait_for(lock, _keepAlive,
+					[this] { return !_jobs.empty() || _stopping; });
+				--_idleThreads;
+
+				if (!woken)
+				{
+					// Idle for too long, shrink the pool. The thread is joined
+					// by the next submit() (or the destructor)
+					_retired.push_back(self);
+					return;
+				}
+
+				continue;
+			}
+
+			const Job job = _jobs.front();
+			_jobs.pop_front();
+			++_runningJobs;
+
+			lock.unlock();
+			job.task->run();
+			lock.lock();
+
+			if (job.continuation != nullptr)
+			{
+				_completed.push_back(job.continuation);
+				_completedCount.store(_completed.size(), std::memory_order_release);
+			}
+
+			if (--_runningJobs == 0)
+			{
+				_done.notify_all();
+			}
+		}
+	}
+
+	void BlockingPool::takeRetired(std::list<std::thread>& retired)
+	{
+		for (auto thread : _retired)
+		{
+			retired.splice(retired.end(), _threads, thread);
+		}
+
+		_retired.clear();
+	}
+}
@@ -1,55 +1,408 @@
 #include "../include/Engine.hpp"
 
 namespace TaskSystem {
+	namespace {
+		// Unique across engines, an engine created where a destroyed one
+		// lived must not be mistaken for it by the thread worker cache
+		std::atomic<std::size_t> workersGenerations{ 0 };
+
+		// Pools cannot help running tasks, they spill for the queues that do
+		OverflowPolicy poolOverflowPolicy(OverflowPolicy policy)
+		{
+			return policy == OverflowPolicy::HelpUntilSpace ? OverflowPolicy::Spill : policy;
+		}
+	}
+
 	Engine::Engine(
 		const std::size_t               workerThreads,
 		const std::vector<std::size_t>& tasksPerThread,
-		const std::size_t               fallbackTasksPerThread)
-		: _workers{ workerThreads },
-		_randomEngine{ std::random_device()() },
-		_dist{ 0, workerThreads - 1 }
+		const std::size_t               fallbackTasksPerThread,
+		const TaskSize                  taskSize,
+		const std::size_t               poolGenerations,
+		const SchedulingOptions&        scheduling)
+		: _scheduling{ scheduling },
+		_workers{ workerThreads },
+		_simulatedWorker{ nullptr },
+		_simulationRandomState{ 0 },
+		_replayStep{ 0 },
+		_frame{ 0 },
+		_tasksPerThread{ tasksPerThread },
+		_fallbackTasksPerThread{ fallbackTasksPerThread },
+		_taskSize{ taskSize },
+		_poolGenerations{ poolGenerations },
+		_seed{ scheduling.seed != 0 ? scheduling.seed : std::random_device()() },
+		_workersGeneration{ workersGenerations.fetch_add(1, std::memory_order_relaxed) },
+		_overflowPolicy{ OverflowPolicy::Discard },
+		_activeWorkers{ 0 },
+		_parkedWorkers{ 0 },
+		_injectedTasks{ 0 }
+	{
+		// Workers are not parked until setScaling() is called
+		_scaling.minWorkers = std::numeric_limits<std::size_t>::max();
+		_scaling.maxWorkers = std::numeric_limits<std::size_t>::max();
+		_scaling.parkIdleCycles = ScalingOptions{}.parkIdleCycles;
+		_scaling.parkStealFailureRate = ScalingOptions{}.parkStealFailureRate;
+		_scaling.activateQueueDepth = ScalingOptions{}.activateQueueDepth;
+		_simulationRandomState = nextSeed();
+		createWorkers(workerThreads);
+	}
+
+	Engine::~Engine()
 	{
+		// Queued tasks are discarded so their parents and waiters are released
+		shutdown(std::chrono::steady_clock::time_point::min());
+	}
 
-		std::size_t tasksPerQueue = fallbackTasksPerThread;
+	void Engine::createWorkers(const std::size_t workerThreads)
+	{
+		const Worker::Mode foregroundMode =
+			_scheduling.simulation ? Worker::Mode::Simulated : Worker::Mode::Foreground;
+		const Worker::Mode backgroundMode =
+			_scheduling.simulation ? Worker::Mode::Simulated : Worker::Mode::Background;
 
-		if (tasksPerThread.size() > 0)
+		for (std::size_t i = 0; i < workerThreads; ++i)
 		{
-			tasksPerQueue = static_cast<std::size_t>(tasksPerThread[0]);
+			const std::size_t tasksPerQueue =
+				i < _tasksPerThread.size() ? _tasksPerThread[i] : _fallbackTasksPerThread;
+
+			_workers.emplace_back(i, this, tasksPerQueue, i == 0 ? foregroundMode : backgroundMode,
+				_taskSize, _poolGenerations);
+			_workers[i]._pool.setOverflowPolicy(poolOverflowPolicy(overflowPolicy()));
 		}
 
-		_workers.emplace_back(0ull, this, tasksPerQueue, Worker::Mode::Foreground);
+		if (_scheduling.record)
+		{
+			_recordedSchedule.victims.resize(std::max(_recordedSchedule.victims.size(), _workers.size()));
+		}
 
-		for (std::size_t i = 1; i < workerThreads; ++i)
+		for (std::size_t i = 0; i < _workers.size(); ++i)
 		{
+			const std::vector<std::uint32_t>* replay = nullptr;
 
-			if (tasksPerThread.size() > i)
+			if (_scheduling.replay != nullptr && i < _scheduling.replay->victims.size())
 			{
-				tasksPerQueue = static_cast<std::size_t>(tasksPerThread[i]);
+				replay = &_scheduling.replay->victims[i];
 			}
-			else
+
+			_workers[i].configureScheduling(nextSeed(), replay,
+				_scheduling.record ? &_recordedSchedule.victims[i] : nullptr);
+		}
+
+		_activeWorkers = _workers.size();
+		_parkedWorkers = 0;
+
+		for (auto& worker : _workers)
+		{
+			worker.run();
+		}
+
+		if (_scheduling.simulation)
+		{
+			_simulatedWorker = &_workers[0];
+		}
+	}
+
+	std::uint64_t Engine::nextSeed()
+	{
+		// splitmix64, so each worker gets an independent
+		// but reproducible victim sequence from a single seed
+		std::uint64_t z = (_seed += 0x9E3779B97F4A7C15ull);
+		z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ull;
+		z = (z ^ (z >> 27)) * 0x94D049BB133111EBull;
+		return z ^ (z >> 31);
+	}
+
+	void Engine::pause()
+	{
+		for (auto& worker : _workers)
+		{
+			worker.pause();
+		}
+
+		for (auto& worker : _workers)
+		{
+			while (worker.state() == Worker::State::Pausing)
 			{
-				tasksPerQueue = fallbackTasksPerThread;
+				std::this_thread::yield();
 			}
+		}
+	}
+
+	void Engine::resume()
+	{
+		for (auto& worker : _workers)
+		{
+			worker.resume();
+		}
+	}
+
+	void Engine::setScaling(const ScalingOptions& scaling)
+	{
+		_scaling.minWorkers = scaling.minWorkers;
+		_scaling.maxWorkers = scaling.maxWorkers;
+		_scaling.parkIdleCycles = scaling.parkIdleCycles;
+		_scaling.parkStealFailureRate = scaling.parkStealFailureRate;
+		_scaling.activateQueueDepth = scaling.activateQueueDepth;
 
-			_workers.emplace_back(i, this, tasksPerQueue, Worker::Mode::Background);
+		// Wake everybody up, workers over the new limits park again by themselves
+		while (_parkedWorkers.load() != 0 && _activeWorkers.load() < _scaling.maxWorkers)
+		{
+			activateWorker();
 		}
+	}
+
+	void Engine::setOverflowPolicy(const OverflowPolicy policy)
+	{
+		_overflowPolicy.store(policy, std::memory_order_relaxed);
 
 		for (auto& worker : _workers)
 		{
-			worker.run();
+			worker._pool.setOverflowPolicy(poolOverflowPolicy(policy));
 		}
 	}
 
-	Engine::Engine(const std::size_t workerThreads, const std::size_t tasksPerThread)
+	OverflowPolicy Engine::overflowPolicy() const
+	{
+		return _overflowPolicy.load(std::memory_order_relaxed);
+	}
+
+	OverflowCounters Engine::overflowCounters() const
+	{
+		OverflowCounters total;
+
+		for (const auto& worker : _workers)
+		{
+			total += worker.overflowCounters();
+		}
+
+		return total;
+	}
+
+	std::size_t Engine::activeWorkers() const
+	{
+		return _activeWorkers.load(std::memory_order_relaxed);
+	}
+
+	bool Engine::shouldPark(Worker& worker)
+	{
+		std::size_t active = _activeWorkers.load(std::memory_order_relaxed);
+
+		// Idle for long enough, and not only because steals kept losing races
+		const bool idle = worker._cyclesWithoutTasks >= _scaling.parkIdleCycles.load(std::memory_order_relaxed) &&
+			worker._idleStealFailures >= _scaling.parkStealFailureRate.load(std::memory_order_relaxed) * worker._idleSteals;
+
+		if (!idle && active <= _scaling.maxWorkers.load(std::memory_order_relaxed))
+		{
+			return false;
+		}
+
+		// The foreground worker never parks, so one worker is always active
+		const std::size_t minWorkers = std::max<std::size_t>(_scaling.minWorkers.load(std::memory_order_relaxed), 1);
+
+		do
+		{
+			if (active <= minWorkers)
+			{
+				return false;
+			}
+		} while (!_activeWorkers.compare_exchange_weak(active, active - 1));
+
+		worker._parked = true;
+		_parkedWorkers.fetch_add(1);
+		return true;
+	}
+
+	void Engine::unpark(Worker& worker)
+	{
+		bool parked = true;
+
+		if (worker._parked.compare_exchange_strong(parked, false))
+		{
+			_parkedWorkers.fetch_sub(1);
+			_activeWorkers.fetch_add(1);
+			worker.wake();
+		}
+	}
+
+	void Engine::activateWorker()
+	{
+		if (_activeWorkers.load() >= _scaling.maxWorkers)
+		{
+			return;
+		}
+
+		for (auto& worker : _workers)
+		{
+			if (worker.parked())
+			{
+				unpark(worker);
+				return;
+			}
+		}
+	}
+
+	Task* Engine::takeInjected()
+	{
+		std::lock_guard<std::mutex> lock{ _injectedMutex };
+
+		if (_injected.empty())
+		{
+			return nullptr;
+		}
+
+		Task* task = _injected.front();
+		_injected.pop_front();
+		_injectedTasks.fetch_sub(1);
+		return task;
+	}
+
+	std::size_t Engine::discardInjected()
+	{
+		std::deque<Task*> injected;
+
+		{
+			std::lock_guard<std::mutex> lock{ _injectedMutex };
+			injected.swap(_injected);
+			_injectedTasks -= injected.size();
+		}
+
+		for (Task* task : injected)
+		{
+			task->discard();
+		}
+
+		return injected.size();
+	}
+
+	bool Engine::idle() const
+	{
+		for (const auto& worker : _workers)
+		{
+			if (!worker._workQueue.empty() || worker._pendingMail.load() != 0)
+			{
+				return false;
+			}
+		}
+
+		return _injectedTasks.load() == 0 && _blockingPool.pending() == 0;
+	}
+
+	void Engine::drain()
+	{
+		drainUntil(std::chrono::steady_clock::time_point::max());
+	}
+
+	bool Engine::drainUntil(const std::chrono::steady_clock::time_point deadline)
+	{
+		Worker* helper = threadWorker();
+
+		while (true)
+		{
+			while (!idle())
+			{
+				if (std::chrono::steady_clock::now() >= deadline)
+				{
+					return false;
+				}
+
+				if (helper != nullptr)
+				{
+					helper->step();
+				}
+				else
+				{
+					std::this_thread::yield();
+				}
+			}
+
+			// Empty queues are not enough, a worker may be running a task that is
+			// about to submit more. Paused workers are done with their current task
+			std::vector<Worker*> paused;
+
+			for (auto& worker : _workers)
+			{
+				if (worker.pause())
+				{
+					paused.push_back(&worker);
+				}
+			}
+
+			for (Worker* worker : paused)
+			{
+				while (worker->state() == Worker::State::Pausing)
+				{
+					std::this_thread::yield();
+				}
+			}
+
+			const bool drained = idle();
+
+			for (Worker* worker : paused)
+			{
+				worker->resume();
+			}
+
+			if (drained)
+			{
+				return true;
+			}
+		}
+	}
+
+	bool Engine::shutdown(const std::chrono::steady_clock::time_point deadline)
+	{
+		const bool drained = deadline == std::chrono::steady_clock::time_point::min() ?
+			idle() : drainUntil(deadline);
+
+		// Background workers first, the caller may be the foreground worker
+		for (std::size_t i = _workers.size(); i > 0; --i)
+		{
+			_workers[i - 1].stop();
+		}
+
+		for (auto& worker : _workers)
+		{
+			worker.discardQueuedTasks();
+		}
+
+		discardInjected();
+
+		// Continuations of blocking tasks would never be collected
+		_blockingPool.discardPending();
+
+		return drained;
+	}
+
+	bool Engine::restart(const std::size_t workerThreads)
+	{
+		const bool drained = shutdown(std::chrono::steady_clock::time_point::max());
+
+		_simulatedWorker = nullptr;
+		_workers.reset(workerThreads);
+		_workersGeneration = workersGenerations.fetch_add(1, std::memory_order_relaxed);
+		createWorkers(workerThreads);
+
+		return drained;
+	}
+
+	Engine::Engine(const std::size_t workerThreads, const std::size_t tasksPerThread,
+		const TaskSize taskSize, const std::size_t poolGenerations, const SchedulingOptions& scheduling)
 		: Engine{ workerThreads,
 				 std::vector<std::size_t>(workerThreads, tasksPerThread),
-				 tasksPerThread }
+				 tasksPerThread,
+				 taskSize,
+				 poolGenerations,
+				 scheduling }
 	{
 	}
 
 	Worker* Engine::randomWorker()
 	{
-		Worker* worker = &_workers[_dist(_randomEngine)];
+		// Workers pick victims concurrently, so each thread needs its own generator
+		static thread_local std::default_random_engine randomEngine{ std::random_device()() };
+		std::uniform_int_distribution<std::size_t> dist{ 0, _workers.size() - 1 };
+
+		Worker* worker = &_workers[dist(randomEngine)];
 
 		if (worker->running())
 		{
@@ -61,6 +414,11 @@ namespace TaskSystem {
 		}
 	}
 
+	Worker* Engine::worker(const std::size_t index)
+	{
+		return index < _workers.size() ? &_workers[index] : nullptr;
+	}
+
 	Worker* Engine::findThreadWorker(const std::thread::id threadId)
 	{
 		for (auto& worker : _workers)
@@ -92,7 +450,7 @@ namespace TaskSystem {
 
 		for (const auto& worker : _workers)
 		{
-			total += worker.pool().tasks();
+			total += worker.pool().tasks() + worker.pool().spilledTasks();
 		}
 
 		return total;
@@ -100,21 +458,158 @@ namespace TaskSystem {
 
 	Worker* Engine::threadWorker()
 	{
+		if (_simulatedWorker != nullptr)
+		{
+			return _simulatedWorker;
+		}
+
 		static thread_local Engine* engine = this;
+		static thread_local std::size_t generation = _workersGeneration;
 		static thread_local Worker* worker =
 			findThreadWorker(std::this_thread::get_id());
 
-		if (engine != this)
+		// Workers are created again on restart()
+		if (engine != this || generation != _workersGeneration)
 		{
 			engine = this;
+			generation = _workersGeneration;
 			worker = findThreadWorker(std::this_thread::get_id());
 		}
 
 		return worker;
 	}
 
+	void Engine::submit(Task* task)
+	{
+		if (task == nullptr)
+		{
+			return;
+		}
+
+		if (Worker* worker = threadWorker())
+		{
+			worker->submit(task);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{ _injectedMutex };
+			_injected.push_back(task);
+			_injectedTasks.fetch_add(1);
+		}
+
+		// Parked workers check the injected tasks after publishing they park
+		activateWorker();
+	}
+
+	TimerWheel::TimerId Engine::submitAfter(TimerWheel::Clock::duration delay, Task* task)
+	{
+		Worker* worker = threadWorker();
+		return worker != nullptr ? worker->submitAfter(delay, task) : TimerWheel::INVALID_TIMER;
+	}
+
+	TimerWheel::TimerId Engine::submitEvery(TimerWheel::Clock::duration period, Task* task)
+	{
+		Worker* worker = threadWorker();
+		return worker != nullptr ? worker->submitEvery(period, task) : TimerWheel::INVALID_TIMER;
+	}
+
+	bool Engine::cancelTimer(TimerWheel::TimerId id)
+	{
+		Worker* worker = threadWorker();
+		return worker != nullptr && worker->cancelTimer(id);
+	}
+
+	void Engine::submitBlocking(Task* task, Task* continuation)
+	{
+		_blockingPool.submit(task, continuation);
+	}
+
+	void Engine::wait(Task* task)
+	{
+		Worker* worker = threadWorker();
+
+		if (worker != nullptr)
+		{
+			worker->wait(task);
+		}
+		else
+		{
+			task->blockUntilFinished();
+
+			if (std::exception_ptr exception = task->takeException())
+			{
+				std::rethrow_exception(exception);
+			}
+		}
+	}
+
 	const StaticVector<Worker>& Engine::workers() const
 	{
 		return _workers;
 	}
+
+	Reactor& Engine::reactor()
+	{
+		return _reactor;
+	}
+
+	BlockingPool& Engine::blockingPool()
+	{
+		return _blockingPool;
+	}
+
+	const Schedule& Engine::recordedSchedule() const
+	{
+		return _recordedSchedule;
+	}
+
+	void Engine::beginFrame()
+	{
+		// Workers only compare it with the last frame they saw, the
+		// tasks themselves are published through the work queues
+		_frame.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	std::size_t Engine::frame() const
+	{
+		return _frame.load(std::memory_order_relaxed);
+	}
+
+	bool Engine::simulation() const
+	{
+		return _scheduling.simulation;
+	}
+
+	void Engine::simulateStep()
+	{
+		std::uint32_t next;
+
+		if (_scheduling.replay != nullptr && _replayStep < _scheduling.replay->steps.size())
+		{
+			next = _scheduling.replay->steps[_replayStep++] % static_cast<std::uint32_t>(_workers.size());
+		}
+		else
+		{
+			_simulationRandomState ^= _simulationRandomState >> 12;
+			_simulationRandomState ^= _simulationRandomState << 25;
+			_simulationRandomState ^= _simulationRandomState >> 27;
+			next = static_cast<std::uint32_t>(
+				((_simulationRandomState * 0x2545F4914F6CDD1Dull) >> 32) % _workers.size());
+		}
+
+		if (_scheduling.record)
+		{
+			_recordedSchedule.steps.push_back(next);
+		}
+
+		// Steps nest when a task waits from inside the simulation, restore
+		// the worker that was running the waiting task afterwards
+		Worker* previous = _simulatedWorker;
+		_simulatedWorker = &_workers[next];
+		Scratch* previousScratch = Scratch::makeCurrent(&_simulatedWorker->_scratch);
+		_simulatedWorker->runNextTask();
+		Scratch::makeCurrent(previousScratch);
+		_simulatedWorker = previous;
+	}
 }
\ No newline at end of file
@@ -0,0 +1,717 @@
+#include "../include/FlowGraph.hpp"
+#include "../include/Engine.hpp"
+#include "../include/Futex.hpp"
+#include "../include/SerialTask.hpp"
+#include <algorithm>
+
+namespace TaskSystem {
+	FlowGraph::Node::Node(FlowGraph& graph) :
+		_graph{ graph },
+		_successors{ std::make_shared<const std::vector<Node*>>() },
+		_forwardRequests{ 0 }
+	{}
+
+	FlowGraph::Node::~Node() = default;
+
+	bool FlowGraph::Node::tryPut(const Message& message)
+	{
+		return accept(message, nullptr);
+	}
+
+	FlowGraph& FlowGraph::Node::graph()
+	{
+		return _graph;
+	}
+
+	void FlowGraph::Node::retry()
+	{
+		retryAll(takeBlocked());
+	}
+
+	void FlowGraph::Node::deliver()
+	{}
+
+	void FlowGraph::Node::forward()
+	{
+		if (_forwardRequests.fetch_add(1, std::memory_order_acq_rel) != 0)
+		{
+			return;
+		}
+
+		std::size_t requests = 1;
+
+		do
+		{
+			deliver();
+			requests = _forwardRequests.fetch_sub(requests, std::memory_order_acq_rel) - requests;
+		} while (requests != 0);
+	}
+
+	bool FlowGraph::Node::offer(const Message& message)
+	{
+		const auto successors = std::atomic_load(&_successors);
+
+		for (Node* successor : *successors)
+		{
+			if (successor->accept(message, this))
+			{
+				return true;
+			}
+		}
+
+		return false;
+	}
+
+	void FlowGraph::Node::offerAll(const Message& message)
+	{
+		const auto successors = std::atomic_load(&_successors);
+
+		for (Node* successor : *successors)
+		{
+			successor->accept(message, this);
+		}
+	}
+
+	void FlowGraph::Node::block(Node* from)
+	{
+		if (from != nullptr && std::find(_blocked.begin(), _blocked.end(), from) == _blocked.end())
+		{
+			_blocked.push_back(from);
+		}
+	}
+
+	std::vector<FlowGraph::Node*> FlowGraph::Node::takeBlocked()
+	{
+		std::vector<Node*> blocked;
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			blocked.swap(_blocked);
+		}
+
+		_graph.progress();
+		return blocked;
+	}
+
+	void FlowGraph::Node::retryAll(const std::vector<Node*>& nodes)
+	{
+		for (Node* node : nodes)
+		{
+			node->retry();
+		}
+	}
+
+	struct FlowGraph::FunctionNode::Slot
+	{
+		explicit Slot(FunctionNode& node) :
+			node{ &node },
+			task{ node._graph._engine, slotTask, this }
+		{}
+
+		FunctionNode* node;
+		// The message processed, then the result until it is delivered
+		Message message;
+		// Each slot carries its own task, so the graph allocates
+		// nothing from the worker pools however many messages flow
+		SerialTask task;
+	};
+
+	FlowGraph::FunctionNode::FunctionNode(FlowGraph& graph, std::size_t concurrency, Body body, std::size_t capacity) :
+		Node{ graph },
+		_body{ std::move(body) },
+		_capacity{ capacity }
+	{
+		concurrency = std::max<std::size_t>(concurrency, 1);
+
+		for (std::size_t i = 0; i < concurrency; ++i)
+		{
+			_slots.push_back(std::make_unique<Slot>(*this));
+			_freeSlots.push_back(_slots[i].get());
+		}
+	}
+
+	FlowGraph::FunctionNode::~FunctionNode() = default;
+
+	bool FlowGraph::FunctionNode::accept(const Message& message, Node* from)
+	{
+		Slot* slot = nullptr;
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+
+			if (!_freeSlots.empty())
+			{
+				slot = _freeSlots.back();
+				_freeSlots.pop_back();
+				slot->message = message;
+			}
+			else if (_queue.size() < _capacity)
+			{
+				_queue.push_back(message);
+				return true;
+			}
+			else
+			{
+				block(from);
+				return false;
+			}
+		}
+
+		schedule(*slot);
+		return true;
+	}
+
+	void FlowGraph::FunctionNode::retry()
+	{
+		forward();
+	}
+
+	void FlowGraph::FunctionNode::deliver()
+	{
+		while (true)
+		{
+			Slot* slot = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+
+				if (_results.empty())
+				{
+					return;
+				}
+
+				slot = _results.front();
+			}
+
+			// Only the delivering thread pops results, the front stays the same
+			if (!offer(slot->message))
+			{
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+				_results.pop_front();
+			}
+
+			release(*slot);
+		}
+	}
+
+	void FlowGraph::FunctionNode::slotTask(void* slot)
+	{
+		Slot& self = *static_cast<Slot*>(slot);
+		self.node->process(self);
+	}
+
+	void FlowGraph::FunctionNode::process(Slot& slot)
+	{
+		Message result;
+
+		try
+		{
+			result = _body(slot.message);
+		}
+		catch (...)
+		{
+			// The message is dropped and the slot released, wait() rethrows
+			_graph.fail(std::current_exception());
+		}
+
+		if (!result.has_value())
+		{
+			release(slot);
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			slot.message = std::move(result);
+			_results.push_back(&slot);
+		}
+
+		forward();
+	}
+
+	void FlowGraph::FunctionNode::release(Slot& slot)
+	{
+		bool next = false;
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+
+			if (!_queue.empty())
+			{
+				slot.message = std::move(_queue.front());
+				_queue.pop_front();
+				next = true;
+			}
+			else
+			{
+				slot.message.reset();
+				_freeSlots.push_back(&slot);
+			}
+		}
+
+		if (next)
+		{
+			schedule(slot);
+		}
+
+		retryAll(takeBlocked());
+	}
+
+	void FlowGraph::FunctionNode::schedule(Slot& slot)
+	{
+		// A slot released by its own task, which may still be running,
+		// is processed again by that task
+		slot.task.schedule();
+	}
+
+	bool FlowGraph::FunctionNode::finished() const
+	{
+		for (const auto& slot : _slots)
+		{
+			if (!slot->task.idle())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void FlowGraph::FunctionNode::blockUntilFinished()
+	{
+		for (const auto& slot : _slots)
+		{
+			slot->task.blockUntilIdle();
+		}
+	}
+
+	FlowGraph::BroadcastNode::BroadcastNode(FlowGraph& graph) :
+		Node{ graph }
+	{}
+
+	bool FlowGraph::BroadcastNode::accept(const Message& message, Node*)
+	{
+		offerAll(message);
+		return true;
+	}
+
+	FlowGraph::BufferNode::BufferNode(FlowGraph& graph, std::size_t capacity) :
+		Node{ graph },
+		_capacity{ capacity }
+	{}
+
+	std::size_t FlowGraph::BufferNode::size()
+	{
+		std::lock_guard<std::mutex> lock{ _mutex };
+		return _messages.size();
+	}
+
+	bool FlowGraph::BufferNode::accept(const Message& message, Node* from)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+
+			if (_messages.size() >= _capacity)
+			{
+				block(from);
+				return false;
+			}
+
+			_messages.push_back(message);
+		}
+
+		forward();
+		return true;
+	}
+
+	void FlowGraph::BufferNode::retry()
+	{
+		forward();
+	}
+
+	void FlowGraph::BufferNode::deliver()
+	{
+		while (true)
+		{
+			const Message* message = nullptr;
+
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+
+				if (_messages.empty())
+				{
+					return;
+				}
+
+				message = &_messages.front();
+			}
+
+			// Only the delivering thread pops messages, and pushing to
+			// a deque does not move its elements
+			if (!offer(*message))
+			{
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+				_messages.pop_front();
+			}
+
+			retryAll(takeBlocked());
+		}
+	}
+
+	FlowGraph::LimiterNode::LimiterNode(FlowGraph& graph, std::size_t threshold) :
+		Node{ graph },
+		_threshold{ threshold },
+		_passed{ 0 },
+		_retries{ 0 }
+	{}
+
+	void FlowGraph::LimiterNode::release(std::size_t count)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			_passed -= std::min(count, _passed);
+		}
+
+		retryAll(takeBlocked());
+	}
+
+	bool FlowGraph::LimiterNode::accept(const Message& message, Node* from)
+	{
+		const std::uint64_t retries = _retries.load(std::memory_order_acquire);
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+
+			if (_passed >= _threshold)
+			{
+				block(from);
+				return false;
+			}
+
+			_passed++;
+		}
+
+		if (offer(message))
+		{
+			return true;
+		}
+
+		bool retried = false;
+
+		{
+			std::lock_guard<std::mutex> lock{ _mutex };
+			_passed--;
+			block(from);
+			retried = _retries.load(std::memory_order_acquire) != retries;
+		}
+
+		// A successor made room while refusing, it may have retried before
+		// the predecessor was blocked here
+		if (retried)
+		{
+			retry();
+		}
+
+		return false;
+	}
+
+	void FlowGraph::LimiterNode::retry()
+	{
+		_retries.fetch_add(1, std::memory_order_acq_rel);
+		retryAll(takeBlocked());
+	}
+
+	class FlowGraph::JoinNode::Input : public Node
+	{
+	public:
+		Input(JoinNode& join, std::size_t index) :
+			Node{ join._graph },
+			_join{ join },
+			_index{ index }
+		{}
+
+	protected:
+		bool accept(const Message& message, Node* from) override
+		{
+			bool ready = true;
+
+			{
+				// The queues of all the inputs are guarded by the join
+				std::lock_guard<std::mutex> lock{ _join._mutex };
+				std::deque<Message>& queue = _join._queues[_index];
+
+				if (queue.size() >= _join._capacity)
+				{
+					std::lock_guard<std::mutex> blockedLock{ _mutex };
+					block(from);
+					return false;
+				}
+
+				queue.push_back(message);
+
+				for (const auto& other : _join._queues)
+				{
+					ready = ready && !other.empty();
+				}
+			}
+
+			if (ready)
+			{
+				_join.forward();
+			}
+
+			return true;
+		}
+
+	private:
+		JoinNode& _join;
+		std::size_t _index;
+
+		friend class JoinNode;
+	};
+
+	FlowGraph::JoinNode::JoinNode(FlowGraph& graph, std::size_t inputs, std::size_t capacity) :
+		Node{ graph },
+		_capacity{ std::max<std::size_t>(capacity, 1) },
+		_queues(inputs)
+	{
+		for (std::size_t i = 0; i < inputs; ++i)
+		{
+			_inputs.push_back(std::make_unique<Input>(*this, i));
+		}
+	}
+
+	FlowGraph::JoinNode::~JoinNode() = default;
+
+	FlowGraph::Node& FlowGraph::JoinNode::input(std::size_t index)
+	{
+		return *_inputs[index];
+	}
+
+	bool FlowGraph::JoinNode::accept(const Message&, Node*)
+	{
+		// Messages go to the inputs
+		return false;
+	}
+
+	void FlowGraph::JoinNode::retry()
+	{
+		forward();
+	}
+
+	void FlowGraph::JoinNode::deliver()
+	{
+		while (true)
+		{
+			std::vector<Message> messages;
+
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+
+				for (const auto& queue : _queues)
+				{
+					if (queue.empty())
+					{
+						return;
+					}
+
+					messages.push_back(queue.front());
+				}
+			}
+
+			if (!offer(Message{ std::move(messages) }))
+			{
+				return;
+			}
+
+			{
+				std::lock_guard<std::mutex> lock{ _mutex };
+
+				for (auto& queue : _queues)
+				{
+					queue.pop_front();
+				}
+			}
+
+			for (auto& input : _inputs)
+			{
+				retryAll(input->takeBlocked());
+			}
+		}
+	}
+
+	FlowGraph::FlowGraph(Engine& engine) :
+		_engine{ engine },
+		_progress{ 0 }
+	{}
+
+	FlowGraph::~FlowGraph()
+	{
+		blockUntilIdle();
+	}
+
+	template<typename T, typename... Args>
+	T& FlowGraph::add(Args&& ... args)
+	{
+		auto node = std::make_unique<T>(*this, std::forward<Args>(args)...);
+		T& result = *node;
+
+		std::lock_guard<std::mutex> lock{ _nodesMutex };
+		_nodes.push_back(std::move(node));
+		return result;
+	}
+
+	FlowGraph::FunctionNode& FlowGraph::function(std::size_t concurrency, FunctionNode::Body body, std::size_t capacity)
+	{
+		FunctionNode& node = add<FunctionNode>(concurrency, std::move(body), capacity);
+
+		std::lock_guard<std::mutex> lock{ _nodesMutex };
+		_functionNodes.push_back(&node);
+		return node;
+	}
+
+	FlowGraph::BroadcastNode& FlowGraph::broadcast()
+	{
+		return add<BroadcastNode>();
+	}
+
+	FlowGraph::BufferNode& FlowGraph::buffer(std::size_t capacity)
+	{
+		return add<BufferNode>(capacity);
+	}
+
+	FlowGraph::LimiterNode& FlowGraph::limiter(std::size_t threshold)
+	{
+		return add<LimiterNode>(threshold);
+	}
+
+	FlowGraph::JoinNode& FlowGraph::join(std::size_t inputs, std::size_t capacity)
+	{
+		return add<JoinNode>(inputs, capacity);
+	}
+
+	void FlowGraph::connect(Node& from, Node& to)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ from._mutex };
+			auto successors = std::make_shared<std::vector<Node*>>(*std::atomic_load(&from._successors));
+			successors->push_back(&to);
+			std::atomic_store(&from._successors, std::shared_ptr<const std::vector<Node*>>{ std::move(successors) });
+		}
+
+		// Messages held for lack of successors can go now
+		from.retry();
+	}
+
+	void FlowGraph::disconnect(Node& from, Node& to)
+	{
+		std::lock_guard<std::mutex> lock{ from._mutex };
+		auto successors = std::make_shared<std::vector<Node*>>(*std::atomic_load(&from._successors));
+		successors->erase(std::remove(successors->begin(), successors->end(), &to), successors->end());
+		std::atomic_store(&from._successors, std::shared_ptr<const std::vector<Node*>>{ std::move(successors) });
+	}
+
+	void FlowGraph::put(Node& node, const Message& message)
+	{
+		Worker* worker = _engine.threadWorker();
+
+		if (worker != nullptr)
+		{
+			worker->helpUntil([&] { return node.tryPut(message); });
+		}
+		else
+		{
+			// A refusal racing with a node making room changes the word first
+			futex::await(_progress, [&] { return node.tryPut(message); });
+		}
+	}
+
+	void FlowGraph::wait()
+	{
+		blockUntilIdle();
+
+		std::exception_ptr error;
+
+		{
+			std::lock_guard<std::mutex> lock{ _errorMutex };
+			error.swap(_error);
+		}
+
+		if (error)
+		{
+			std::rethrow_exception(error);
+		}
+	}
+
+	Engine& FlowGraph::engine()
+	{
+		return _engine;
+	}
+
+	void FlowGraph::fail(std::exception_ptr error)
+	{
+		std::lock_guard<std::mutex> lock{ _errorMutex };
+
+		if (!_error)
+		{
+			_error = std::move(error);
+		}
+	}
+
+	bool FlowGraph::idle()
+	{
+		std::lock_guard<std::mutex> lock{ _nodesMutex };
+
+		for (const FunctionNode* node : _functionNodes)
+		{
+			if (!node->finished())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void FlowGraph::blockUntilIdle()
+	{
+		Worker* worker = _engine.threadWorker();
+
+		if (worker != nullptr)
+		{
+			worker->helpUntil([this] { return idle(); });
+			return;
+		}
+
+		// Slots may schedule each other, so they are waited for until
+		// all of them were found idle at once
+		while (!idle())
+		{
+			std::vector<FunctionNode*> nodes;
+
+			{
+				std::lock_guard<std::mutex> lock{ _nodesMutex };
+				nodes = _functionNodes;
+			}
+
+			for (FunctionNode* node : nodes)
+			{
+				node->blockUntilFinished();
+			}
+		}
+	}
+
+	void FlowGraph::progress()
+	{
+		_progress.fetch_add(1, std::memory_order_release);
+		futex::notify(_progress);
+	}
+}
\ No newline at end of file
@@ -0,0 +1,205 @@
+#include "../include/Futex.hpp"
+
+#include <algorithm>
+#include <cstddef>
+#include <thread>
+
+#if defined(__linux__)
+#include <linux/futex.h>
+#include <linux/membarrier.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <cerrno>
+#include <climits>
+#include <ctime>
+#elif defined(_WIN32)
+#include <windows.h>
+#endif
+
+static_assert(sizeof(std::atomic<std::int32_t>) == sizeof(std::int32_t),
+	"futex words must be plain 32 bit integers");
+
+namespace TaskSystem {
+namespace futex {
+	namespace {
+		constexpr const std::size_t WAITER_BUCKETS = 1024;
+
+		// Threads registered in await(), by word address. Words sharing a
+		// bucket only cost each other a spurious wake up
+		std::atomic<std::int32_t>& waiters(const std::atomic<std::int32_t>& word)
+		{
+			static std::atomic<std::int32_t> buckets[WAITER_BUCKETS];
+			return buckets[(reinterpret_cast<std::uintptr_t>(&word) / sizeof(std::int32_t)) % WAITER_BUCKETS];
+		}
+
+		// Makes every running thread of the process execute a full barrier, so the
+		// plain store of a notifier and its read of the bucket are not reordered
+		// past the registration of a waiter. Returns false if the barrier is not
+		// available, waiters must then bound their sleeps
+		bool processBarrier()
+		{
+#if defined(__linux__)
+			static const bool registered =
+				syscall(SYS_membarrier, MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED, 0, 0) == 0;
+
+			return registered && syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED, 0, 0) == 0;
+#elif defined(_WIN32)
+			FlushProcessWriteBuffers();
+			return true;
+#else
+			return false;
+#endif
+		}
+
+		constexpr const std::chrono::milliseconds UNFENCED_PARK_PERIOD{ 1 };
+	}
+
+	void notify(const std::atomic<std::int32_t>& word)
+	{
+		// The barrier of the waiters orders the hardware, only the compiler is left
+		std::atomic_signal_fence(std::memory_order_seq_cst);
+
+		if (waiters(word).load(std::memory_order_relaxed) != 0)
+		{
+			wakeAll(word);
+		}
+	}
+
+	Waiter::Waiter(const std::atomic<std::int32_t>& word) :
+		_word{ word }
+	{
+		waiters(_word).fetch_add(1, std::memory_order_seq_cst);
+		_fenced = processBarrier();
+	}
+
+	Waiter::~Waiter()
+	{
+		waiters(_word).fetch_sub(1, std::memory_order_relaxed);
+	}
+
+	bool Waiter::park(std::int32_t expected, std::chrono::steady_clock::time_point deadline)
+	{
+		using clock = std::chrono::steady_clock;
+
+		if (deadline == clock::time_point::max() && _fenced)
+		{
+			wait(_word, expected);
+			return true;
+		}
+
+		const clock::time_point now = clock::now();
+
+		if (now >= deadline)
+		{
+			return false;
+		}
+
+		std::chrono::nanoseconds timeout = deadline - now;
+
+		if (!_fenced)
+		{
+			timeout = std::min<std::chrono::nanoseconds>(timeout, UNFENCED_PARK_PERIOD);
+		}
+
+		waitFor(_word, expected, timeout);
+		return true;
+	}
+
+#if defined(__linux__)
+	static long futexCall(const std::atomic<std::int32_t>& word, int op, std::int32_t value,
+		const timespec* timeout)
+	{
+		return syscall(SYS_futex, reinterpret_cast<const std::int32_t*>(&word),
+			op | FUTEX_PRIVATE_FLAG, value, timeout, nullptr, 0);
+	}
+
+	void wait(const std::atomic<std::int32_t>& word, std::int32_t expected)
+	{
+		futexCall(word, FUTEX_WAIT, expected, nullptr);
+	}
+
+	bool waitFor(const std::atomic<std::int32_t>& word, std::int32_t expected,
+		std::chrono::nanoseconds timeout)
+	{
+		if (timeout.count() <= 0)
+		{
+			return false;
+		}
+
+		timespec ts;
+		ts.tv_sec = static_cast<time_t>(timeout.count() / 1000000000);
+		ts.tv_nsec = static_cast<long>(timeout.count() % 1000000000);
+
+		return futexCall(word, FUTEX_WAIT, expected, &ts) == 0 || errno != ETIMEDOUT;
+	}
+
+	void wakeOne(const std::atomic<std::int32_t>& word)
+	{
+		futexCall(word, FUTEX_WAKE, 1, nullptr);
+	}
+
+	void wakeAll(const std::atomic<std::int32_t>& word)
+	{
+		futexCall(word, FUTEX_WAKE, INT_MAX, nullptr);
+	}
+#elif defined(_WIN32)
+	void wait(const std::atomic<std::int32_t>& word, std::int32_t expected)
+	{
+		WaitOnAddress(const_cast<std::atomic<std::int32_t>*>(&word), &expected,
+			sizeof(expected), INFINITE);
+	}
+
+	bool waitFor(const std::atomic<std::int32_t>& word, std::int32_t expected,
+		std::chrono::nanoseconds timeout)
+	{
+		const auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(timeout).count();
+
+		if (ms <= 0)
+		{
+			return false;
+		}
+
+		return WaitOnAddress(const_cast<std::atomic<std::int32_t>*>(&word), &expected,
+			sizeof(expected), static_cast<DWORD>(ms)) != FALSE;
+	}
+
+	void wakeOne(const std::atomic<std::int32_t>& word)
+	{
+		WakeByAddressSingle(const_cast<std::atomic<std::int32_t>*>(&word));
+	}
+
+	void wakeAll(const std::atomic<std::int32_t>& word)
+	{
+		WakeByAddressAll(const_cast<std::atomic<std::int32_t>*>(&word));
+	}
+#else
+	void wait(const std::atomic<std::int32_t>& word, std::int32_t expected)
+	{
+		if (word.load(std::memory_order_acquire) == expected)
+		{
+			std::this_thread::yield();
+		}
+	}
+
+	bool waitFor(const std::atomic<std::int32_t>& word, std::int32_t expected,
+		std::chrono::nanoseconds timeout)
+	{
+		if (timeout.count() <= 0)
+		{
+			return false;
+		}
+
+		wait(word, expected);
+		return true;
+	}
+
+	void wakeOne(const std::atomic<std::int32_t>&)
+	{
+	}
+
+	void wakeAll(const std::atomic<std::int32_t>&)
+	{
+	}
+#endif
+}
+}
@@ -0,0 +1,445 @@
+#include "../include/HashJoin.hpp"
+#include "../include/Parallel.hpp"
+#include "../include/Scratch.hpp"
+#include <algorithm>
+#include <memory>
+
+namespace TaskSystem {
+	namespace {
+		// Rows scanned by each task of a partition pass, and the smallest chunk
+		// a skewed partition is split in
+		constexpr const std::size_t CHUNK_ROWS = 16 * 1024;
+		// A partition this many times bigger than the average is split
+		constexpr const std::size_t SKEW_FACTOR = 4;
+
+		// Murmur3 finalizer: partitions use the high bits, hash tables the low ones
+		std::uint64_t hashKey(std::uint64_t key)
+		{
+			key ^= key >> 33;
+			key *= 0xFF51AFD7ED558CCDull;
+			key ^= key >> 33;
+			key *= 0xC4CEB9FE1A85EC53ull;
+			key ^= key >> 33;
+			return key;
+		}
+
+		unsigned ceilLog2(std::size_t value)
+		{
+			unsigned bits = 0;
+
+			while ((std::size_t{ 1 } << bits) < value)
+			{
+				bits++;
+			}
+
+			return bits;
+		}
+
+		std::size_t divideRoundingUp(std::size_t value, std::size_t divisor)
+		{
+			return (value + divisor - 1) / divisor;
+		}
+
+		/**
+		 * Rows grouped by partition, partition p being rows[offsets[p], offsets[p + 1])
+		 */
+		struct Partitioned
+		{
+			std::unique_ptr<Row[]> storage;
+			const Row* rows;
+			std::vector<std::size_t> offsets;
+
+			std::size_t partitions() const
+			{
+				return offsets.size() - 1;
+			}
+
+			std::size_t size(std::size_t partition) const
+			{
+				return offsets[partition + 1] - offsets[partition];
+			}
+		};
+
+		// Scatters \p input to \p output grouped by \p bits bits of the key hashes,
+		// after the \p skipBits highest ones. Writes the 2^bits + 1 partition offsets
+		void partitionPass(Engine& engine, const Row* input, std::size_t size, Row* output,
+			unsigned skipBits, unsigned bits, std::size_t* offsets)
+		{
+			const std::size_t fanout = std::size_t{ 1 } << bits;
+			const std::size_t chunks = std::max<std::size_t>(divideRoundingUp(size, CHUNK_ROWS), 1);
+			const unsigned shift = 64 - skipBits - bits;
+			// Histograms of the chunks first, then where each chunk writes its rows
+			std::vector<std::size_t> cursors(chunks * fanout, 0);
+
+			auto partitionOf = [shift, fanout](const Row& row)
+			{
+				return static_cast<std::size_t>(hashKey(row.key) >> shift) & (fanout - 1);
+			};
+
+			parallelFor(engine, 0, chunks, 1, [&](std::size_t first, std::size_t last)
+			{
+				for (std::size_t chunk = first; chunk < last; ++chunk)
+				{
+					std::size_t* histogram = &cursors[chunk * fanout];
+					const std::size_t end = std::min(size, (chunk + 1) * CHUNK_ROWS);
+
+					for (std::size_t i = chunk * CHUNK_ROWS; i < end; ++i)
+					{
+						histogram[partitionOf(input[i])]++;
+					}
+				}
+			});
+
+			std::size_t position = 0;
+
+			for (std::size_t partition = 0; partition < fanout; ++partition)
+			{
+				offsets[partition] = position;
+
+				for (std::size_t chunk = 0; chunk < chunks; ++chunk)
+				{
+					const std::size_t count = cursors[chunk * fanout + partition];
+					cursors[chunk * fanout + partition] = position;
+					position += count;
+				}
+			}
+
+			offsets[fanout] = position;
+
+			parallelFor(engine, 0, chunks, 1, [&](std::size_t first, std::size_t last)
+			{
+				for (std::size_t chunk = first; chunk < last; ++chunk)
+				{
+					std::size_t* cursor = &cursors[chunk * fanout];
+					const std::size_t end = std::min(size, (chunk + 1) * CHUNK_ROWS);
+
+					for (std::size_t i = chunk * CHUNK_ROWS; i < end; ++i)
+					{
+						output[cursor[partitionOf(input[i])]++] = input[i];
+					}
+				}
+			});
+		}
+
+		// Partitions \p rows in 2^bits partitions, in up to two passes
+		Partitioned partition(Engine& engine, const std::vector<Row>& rows, unsigned bits, const PartitionOptions& options)
+		{
+			Partitioned result;
+			const std::size_t size = rows.size();
+
+			if (bits == 0)
+			{
+				result.rows = rows.data();
+				result.offsets = { 0, size };
+				return result;
+			}
+
+			const unsigned firstBits = std::min(bits, options.bitsPerPass);
+			const unsigned secondBits = bits - firstBits;
+			const std::size_t firstFanout = std::size_t{ 1 } << firstBits;
+			const std::size_t secondFanout = std::size_t{ 1 } << secondBits;
+
+			std::unique_ptr<Row[]> first{ new Row[size] };
+			std::vector<std::size_t> firstOffsets(firstFanout + 1);
+			partitionPass(engine, rows.data(), size, first.get(), 0, firstBits, firstOffsets.data());
+
+			if (secondBits == 0)
+			{
+				result.storage = std::move(first);
+				result.rows = result.storage.get();
+				result.offsets = std::move(firstOffsets);
+				return result;
+			}
+
+			result.storage.reset(new Row[size]);
+			result.rows = result.storage.get();
+			result.offsets.resize(firstFanout * secondFanout + 1);
+			result.offsets.back() = size;
+			Row* second = result.storage.get();
+
+			parallelFor(engine, 0, firstFanout, 1, [&](std::size_t begin, std::size_t end)
+			{
+				std::vector<std::size_t> offsets(secondFanout + 1);
+
+				for (std::size_t partition = begin; partition < end; ++partition)
+				{
+					const std::size_t offset = firstOffsets[partition];
+
+					partitionPass(engine, first.get() + offset, firstOffsets[partition + 1] - offset,
+						second + offset, firstBits, secondBits, offsets.data());
+
+					for (std::size_t i = 0; i < secondFanout; ++i)
+					{
+						result.offsets[partition * secondFanout + i] = offset + offsets[i];
+					}
+				}
+			});
+
+			return result;
+		}
+
+		// Enough partitions for their hash tables to fit in \p cacheBytes, and for
+		// all the workers to have a few of them
+		unsigned partitionBits(Engine& engine, std::size_t rows, std::size_t bytesPerRow, const PartitionOptions& options)
+		{
+			if (rows < CHUNK_ROWS)
+			{
+				return 0;
+			}
+
+			const unsigned cacheBits = ceilLog2(divideRoundingUp(rows * bytesPerRow, options.cacheBytes));
+			const unsigned workerBits = ceilLog2(engine.workers().size() * 4);
+			const unsigned maxBits = options.bitsPerPass * std::min(options.maxPasses, 2u);
+
+			return std::min(std::max(cacheBits, workerBits), maxBits);
+		}
+
+		std::size_t tableSize(std::size_t entries)
+		{
+			return std::size_t{ 1 } << std::max(ceilLog2(entries * 2), 4u);
+		}
+
+		// Parallel over the partitions, the ones over SKEW_FACTOR times the average
+		// size are handed to \p skewed, the others to \p regular
+		template<typename Regular, typename Skewed>
+		void forEachPartition(Engine& engine, const Partitioned& partitioned, const Regular& regular, const Skewed& skewed)
+		{
+			const std::size_t average = partitioned.offsets.back() / partitioned.partitions();
+			const std::size_t threshold = std::max(average * SKEW_FACTOR, CHUNK_ROWS);
+
+			parallelFor(engine, 0, partitioned.partitions(), 1, [&](std::size_t begin, std::size_t end)
+			{
+				for (std::size_t partition = begin; partition < end; ++partition)
+				{
+					if (partitioned.size(partition) > threshold)
+					{
+						skewed(partition);
+					}
+					else
+					{
+						regular(partition);
+					}
+				}
+			});
+		}
+
+		template<typename Part>
+		void concatenate(Engine& engine, const std::vector<std::vector<Part>>& parts, std::vector<Part>& output)
+		{
+			std::vector<std::size_t> offsets(parts.size() + 1, 0);
+
+			for (std::size_t i = 0; i < parts.size(); ++i)
+			{
+				offsets[i + 1] = offsets[i] + parts[i].size();
+			}
+
+			output.resize(offsets.back());
+
+			parallelFor(engine, 0, parts.size(), 1, [&](std::size_t begin, std::size_t end)
+			{
+				for (std::size_t i = begin; i < end; ++i)
+				{
+					std::copy(parts[i].begin(), parts[i].end(), output.begin() + offsets[i]);
+				}
+			});
+		}
+
+		/**
+		 * Hash table of the build rows of a partition, in the scratch arena of the
+		 * worker. Entries are the index of the row plus one, 0 being empty
+		 */
+		class BuildTable
+		{
+		public:
+			BuildTable(const Row* rows, std::size_t size) :
+				_rows{ rows },
+				_mask{ tableSize(size) - 1 },
+				_entries{ Scratch::current().allocate<std::uint32_t>(_mask + 1) }
+			{
+				std::fill(_entries, _entries + _mask + 1, 0);
+
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					std::size_t slot = hashKey(rows[i].key) & _mask;
+
+					while (_entries[slot] != 0)
+					{
+						slot = (slot + 1) & _mask;
+					}
+
+					_entries[slot] = static_cast<std::uint32_t>(i + 1);
+				}
+			}
+
+			void probe(const Row* rows, std::size_t size, std::vector<JoinMatch>& matches) const
+			{
+				for (std::size_t i = 0; i < size; ++i)
+				{
+					const std::uint64_t key = rows[i].key;
+
+					for (std::size_t slot = hashKey(key) & _mask; _entries[slot] != 0; slot = (slot + 1) & _mask)
+					{
+						const Row& row = _rows[_entries[slot] - 1];
+
+						if (row.key == key)
+						{
+							matches.push_back(JoinMatch{ key, row.payload, rows[i].payload });
+						}
+					}
+				}
+			}
+
+		private:
+			const Row* _rows;
+			std::size_t _mask;
+			std::uint32_t* _entries;
+		};
+
+		std::uint64_t countOf(const Row&)
+		{
+			return 1;
+		}
+
+		std::uint64_t countOf(const Group& group)
+		{
+			return group.count;
+		}
+
+		std::uint64_t sumOf(const Row& row)
+		{
+			return row.payload;
+		}
+
+		std::uint64_t sumOf(const Group& group)
+		{
+			return group.sum;
+		}
+
+		// Aggregates rows, or partial groups, with a hash table in the scratch
+		// arena of the worker. Empty entries have no rows
+		template<typename Input>
+		void aggregate(const Input* input, std::size_t size, std::vector<Group>& groups)
+		{
+			Scratch& scratch = Scratch::current();
+			const Scratch::Marker marker = scratch.mark();
+			const std::size_t mask = tableSize(size) - 1;
+			Group* table = scratch.allocate<Group>(mask + 1);
+			std::fill(table, table + mask + 1, Group{ 0, 0, 0 });
+
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				std::size_t slot = hashKey(input[i].key) & mask;
+
+				while (table[slot].count != 0 && table[slot].key != input[i].key)
+				{
+					slot = (slot + 1) & mask;
+				}
+
+				table[slot].key = input[i].key;
+				table[slot].count += countOf(input[i]);
+				table[slot].sum += sumOf(input[i]);
+			}
+
+			for (std::size_t slot = 0; slot <= mask; ++slot)
+			{
+				if (table[slot].count != 0)
+				{
+					groups.push_back(table[slot]);
+				}
+			}
+
+			scratch.rewind(marker);
+		}
+	}
+
+	std::size_t hashJoin(Engine& engine, const std::vector<Row>& build, const std::vector<Row>& probe,
+		std::vector<JoinMatch>& matches, const PartitionOptions& options)
+	{
+		// The build rows are read while probing, so they count as much as the table
+		const unsigned bits = partitionBits(engine, build.size(), sizeof(Row) + 2 * sizeof(std::uint32_t), options);
+		const Partitioned builds = partition(engine, build, bits, options);
+		const Partitioned probes = partition(engine, probe, bits, options);
+		std::vector<std::vector<JoinMatch>> outputs(builds.partitions());
+
+		forEachPartition(engine, probes,
+			[&](std::size_t partition)
+			{
+				Scratch& scratch = Scratch::current();
+				const Scratch::Marker marker = scratch.mark();
+				const BuildTable table{ builds.rows + builds.offsets[partition], builds.size(partition) };
+
+				table.probe(probes.rows + probes.offsets[partition], probes.size(partition), outputs[partition]);
+				scratch.rewind(marker);
+			},
+			[&](std::size_t partition)
+			{
+				// Built once, then probed by several tasks
+				Scratch& scratch = Scratch::current();
+				const Scratch::Marker marker = scratch.mark();
+				const BuildTable table{ builds.rows + builds.offsets[partition], builds.size(partition) };
+				const Row* rows = probes.rows + probes.offsets[partition];
+				const std::size_t size = probes.size(partition);
+				std::vector<std::vector<JoinMatch>> chunks(divideRoundingUp(size, CHUNK_ROWS));
+
+				parallelFor(engine, 0, chunks.size(), 1, [&](std::size_t begin, std::size_t end)
+				{
+					for (std::size_t chunk = begin; chunk < end; ++chunk)
+					{
+						const std::size_t first = chunk * CHUNK_ROWS;
+						table.probe(rows + first, std::min(CHUNK_ROWS, size - first), chunks[chunk]);
+					}
+				});
+
+				scratch.rewind(marker);
+
+				for (const auto& chunk : chunks)
+				{
+					outputs[partition].insert(outputs[partition].end(), chunk.begin(), chunk.end());
+				}
+			});
+
+		concatenate(engine, outputs, matches);
+		return matches.size();
+	}
+
+	void groupBy(Engine& engine, const std::vector<Row>& rows, std::vector<Group>& groups, const PartitionOptions& options)
+	{
+		// As many groups as rows at worst
+		const unsigned bits = partitionBits(engine, rows.size(), 2 * sizeof(Group), options);
+		const Partitioned partitioned = partition(engine, rows, bits, options);
+		std::vector<std::vector<Group>> outputs(partitioned.partitions());
+
+		forEachPartition(engine, partitioned,
+			[&](std::size_t partition)
+			{
+				aggregate(partitioned.rows + partitioned.offsets[partition], partitioned.size(partition), outputs[partition]);
+			},
+			[&](std::size_t partition)
+			{
+				// Chunks are aggregated apart, skewed keys leave few partial groups to merge
+				const Row* input = partitioned.rows + partitioned.offsets[partition];
+				const std::size_t size = partitioned.size(partition);
+				std::vector<std::vector<Group>> chunks(divideRoundingUp(size, CHUNK_ROWS));
+
+				parallelFor(engine, 0, chunks.size(), 1, [&](std::size_t begin, std::size_t end)
+				{
+					for (std::size_t chunk = begin; chunk < end; ++chunk)
+					{
+						const std::size_t first = chunk * CHUNK_ROWS;
+						aggregate(input + first, std::min(CHUNK_ROWS, size - first), chunks[chunk]);
+					}
+				});
+
+				std::vector<Group> partials;
+
+				for (const auto& chunk : chunks)
+				{
+					partials.insert(partials.end(), chunk.begin(), chunk.end());
+				}
+
+				aggregate(partials.data(), partials.size(), outputs[partition]);
+			});
+
+		concatenate(engine, outputs, groups);
+	}
+}
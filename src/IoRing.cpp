@@ -0,0 +1,337 @@
+#include "../include/IoRing.hpp"
+
+#include <algorithm>
+#include <cerrno>
+#include <cstring>
+
+#if defined(__linux__)
+#include <linux/io_uring.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#elif defined(__unix__) || defined(__APPLE__)
+#include <unistd.h>
+#endif
+
+namespace TaskSystem {
+	static constexpr const std::uint32_t NO_REQUEST = ~std::uint32_t{ 0 };
+
+	// Portable operation codes, translated to io_uring opcodes on submission
+	enum Operation : std::uint8_t
+	{
+		OPERATION_READ,
+		OPERATION_WRITE,
+		OPERATION_FSYNC
+	};
+
+	IoRing::IoRing(std::uint32_t entries, bool asynchronous) :
+		_fd{ -1 },
+		_submissions{},
+		_completions{},
+		_submissionEntries{ nullptr },
+		_submissionEntriesSize{ 0 },
+		_completionEntries{ nullptr },
+		_entries{ entries },
+		_unflushed{ 0 },
+		_inFlight{ 0 },
+		_freeRequests{ NO_REQUEST }
+	{
+		if (asynchronous)
+		{
+			setup();
+		}
+
+		_requests.resize(_entries);
+
+		for (std::uint32_t i = 0; i < _entries; ++i)
+		{
+			_requests[i].next = i + 1 < _entries ? i + 1 : NO_REQUEST;
+		}
+
+		_freeRequests = _entries > 0 ? 0 : NO_REQUEST;
+		_ready.reserve(_entries);
+	}
+
+	IoRing::~IoRing()
+	{
+#if defined(__linux__)
+		if (_fd >= 0)
+		{
+			if (_completions.mapping != _submissions.mapping)
+			{
+				munmap(_completions.mapping, _completions.mappingSize);
+			}
+
+			munmap(_submissions.mapping, _submissions.mappingSize);
+			munmap(_submissionEntries, _submissionEntriesSize);
+			close(_fd);
+		}
+#endif
+	}
+
+	void IoRing::setup()
+	{
+#if defined(__linux__)
+		io_uring_params params;
+		std::memset(&params, 0, sizeof(params));
+
+		const int fd = static_cast<int>(syscall(__NR_io_uring_setup, _entries, &params));
+
+		if (fd < 0)
+		{
+			return;
+		}
+
+		std::size_t submissionsSize = params.sq_off.array + params.sq_entries * sizeof(std::uint32_t);
+		std::size_t completionsSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+
+		// Recent kernels map both rings with a single mmap() call
+		const bool singleMapping = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+
+		if (singleMapping)
+		{
+			submissionsSize = completionsSize = std::max(submissionsSize, completionsSize);
+		}
+
+		void* submissions = mmap(nullptr, submissionsSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQ_RING);
+
+		if (submissions == MAP_FAILED)
+		{
+			close(fd);
+			return;
+		}
+
+		void* completions = submissions;
+
+		if (!singleMapping)
+		{
+			completions = mmap(nullptr, completionsSize, PROT_READ | PROT_WRITE,
+				MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_CQ_RING);
+
+			if (completions == MAP_FAILED)
+			{
+				munmap(submissions, submissionsSize);
+				close(fd);
+				return;
+			}
+		}
+
+		const std::size_t entriesSize = params.sq_entries * sizeof(io_uring_sqe);
+		void* entries = mmap(nullptr, entriesSize, PROT_READ | PROT_WRITE,
+			MAP_SHARED | MAP_POPULATE, fd, IORING_OFF_SQES);
+
+		if (entries == MAP_FAILED)
+		{
+			if (!singleMapping)
+			{
+				munmap(completions, completionsSize);
+			}
+
+			munmap(submissions, submissionsSize);
+			close(fd);
+			return;
+		}
+
+		auto* sq = static_cast<char*>(submissions);
+		auto* cq = static_cast<char*>(completions);
+
+		_submissions.head = reinterpret_cast<std::atomic<std::uint32_t>*>(sq + params.sq_off.head);
+		_submissions.tail = reinterpret_cast<std::atomic<std::uint32_t>*>(sq + params.sq_off.tail);
+		_submissions.array = reinterpret_cast<std::uint32_t*>(sq + params.sq_off.array);
+		_submissions.mask = *reinterpret_cast<std::uint32_t*>(sq + params.sq_off.ring_mask);
+		_submissions.mapping = submissions;
+		_submissions.mappingSize = submissionsSize;
+
+		_completions.head = reinterpret_cast<std::atomic<std::uint32_t>*>(cq + params.cq_off.head);
+		_completions.tail = reinterpret_cast<std::atomic<std::uint32_t>*>(cq + params.cq_off.tail);
+		_completions.array = nullptr;
+		_completions.mask = *reinterpret_cast<std::uint32_t*>(cq + params.cq_off.ring_mask);
+		_completions.mapping = completions;
+		_completions.mappingSize = completionsSize;
+
+		_submissionEntries = entries;
+		_submissionEntriesSize = entriesSize;
+		_completionEntries = cq + params.cq_off.cqes;
+
+		// The kernel rounds the number of entries up to a power of two
+		_entries = params.sq_entries;
+		_fd = fd;
+#endif
+	}
+
+	bool IoRing::read(int fd, void* buffer, std::uint32_t size, std::uint64_t offset,
+		Task* continuation, std::int32_t* result)
+	{
+		return submit(OPERATION_READ, fd, reinterpret_cast<std::uintptr_t>(buffer), size, offset, continuation, result);
+	}
+
+	bool IoRing::write(int fd, const void* buffer, std::uint32_t size, std::uint64_t offset,
+		Task* continuation, std::int32_t* result)
+	{
+		return submit(OPERATION_WRITE, fd, reinterpret_cast<std::uintptr_t>(buffer), size, offset, continuation, result);
+	}
+
+	bool IoRing::fsync(int fd, Task* continuation, std::int32_t* result)
+	{
+		return submit(OPERATION_FSYNC, fd, 0, 0, 0, continuation, result);
+	}
+
+	std::size_t IoRing::inFlight() const
+	{
+		return _inFlight;
+	}
+
+	bool IoRing::asynchronous() const
+	{
+		return _fd >= 0;
+	}
+
+	bool IoRing::submit(std::uint8_t operation, int fd, std::uint64_t address, std::uint32_t size,
+		std::uint64_t offset, Task* continuation, std::int32_t* result)
+	{
+		if (_freeRequests == NO_REQUEST)
+		{
+			return false;
+		}
+
+		const std::uint32_t request = _freeRequests;
+		_freeRequests = _requests[request].next;
+		_requests[request].continuation = continuation;
+		_requests[request].result = result;
+		++_inFlight;
+
+#if defined(__linux__)
+		if (_fd >= 0)
+		{
+			// We are the only producer, the kernel only reads the tail
+			const std::uint32_t tail = _submissions.tail->load(std::memory_order_relaxed);
+			const std::uint32_t index = tail & _submissions.mask;
+			auto* entry = static_cast<io_uring_sqe*>(_submissionEntries) + index;
+
+			std::memset(entry, 0, sizeof(*entry));
+
+			switch (operation)
+			{
+			case OPERATION_READ:
+				entry->opcode = IORING_OP_READ;
+				break;
+			case OPERATION_WRITE:
+				entry->opcode = IORING_OP_WRITE;
+				break;
+			case OPERATION_FSYNC:
+				entry->opcode = IORING_OP_FSYNC;
+				break;
+			}
+
+			entry->fd = fd;
+			entry->addr = address;
+			entry->len = size;
+			entry->off = offset;
+			entry->user_data = request;
+
+			_submissions.array[index] = index;
+			_submissions.tail->store(tail + 1, std::memory_order_release);
+			++_unflushed;
+
+			return true;
+		}
+#endif
+
+		// Synchronous fallback, run the operation now and report it
+		// completed on the next poll()
+		std::int32_t operationResult = -ENOSYS;
+
+#if defined(__unix__) || defined(__APPLE__)
+		ssize_t bytes = -1;
+
+		switch (operation)
+		{
+		case OPERATION_READ:
+			bytes = pread(fd, reinterpret_cast<void*>(static_cast<std::uintptr_t>(address)), size,
+				static_cast<off_t>(offset));
+			break;
+		case OPERATION_WRITE:
+			bytes = pwrite(fd, reinterpret_cast<const void*>(static_cast<std::uintptr_t>(address)), size,
+				static_cast<off_t>(offset));
+			break;
+		case OPERATION_FSYNC:
+			bytes = ::fsync(fd);
+			break;
+		}
+
+		operationResult = bytes < 0 ? -errno : static_cast<std::int32_t>(bytes);
+#endif
+
+		_requests[request].value = operationResult;
+		_ready.push_back(request);
+		return true;
+	}
+
+	void IoRing::flush()
+	{
+#if defined(__linux__)
+		if (_fd >= 0 && _unflushed > 0)
+		{
+			const long submitted = syscall(__NR_io_uring_enter, _fd, _unflushed, 0, 0, nullptr, 0);
+
+			// On failure (EAGAIN, EBUSY) entries stay in the ring and we try
+			// again on the next flush
+			if (submitted > 0)
+			{
+				_unflushed -= static_cast<std::uint32_t>(submitted);
+			}
+		}
+#endif
+	}
+
+	Task* IoRing::nextCompletion()
+	{
+		if (!_ready.empty())
+		{
+			const std::uint32_t request = _ready.back();
+			_ready.pop_back();
+
+			return complete(request, _requests[request].value);
+		}
+
+#if defined(__linux__)
+		if (_fd >= 0)
+		{
+			const std::uint32_t head = _completions.head->load(std::memory_order_relaxed);
+
+			if (head == _completions.tail->load(std::memory_order_acquire))
+			{
+				return nullptr;
+			}
+
+			const auto& entry = static_cast<const io_uring_cqe*>(_completionEntries)[head & _completions.mask];
+			const std::uint32_t request = static_cast<std::uint32_t>(entry.user_data);
+			const std::int32_t result = entry.res;
+
+			_completions.head->store(head + 1, std::memory_order_release);
+
+			return complete(request, result);
+		}
+#endif
+
+		return nullptr;
+	}
+
+	Task* IoRing::complete(std::uint32_t request, std::int32_t result)
+	{
+		Request& entry = _requests[request];
+
+		if (entry.result != nullptr)
+		{
+			*entry.result = result;
+		}
+
+		Task* continuation = entry.continuation;
+		entry.next = _freeRequests;
+		_freeRequests = request;
+		--_inFlight;
+
+		return continuation;
+	}
+}
@@ -0,0 +1,291 @@
+#include "../include/Pipeline.hpp"
+#include "../include/Engine.hpp"
+#include "../include/Futex.hpp"
+#include "../include/SerialTask.hpp"
+#include <utility>
+
+namespace TaskSystem {
+	struct Pipeline::Token : Pipeline::Item
+	{
+		Token(Pipeline& pipeline, std::size_t index) :
+			Item{ 0, index, nullptr },
+			pipeline{ &pipeline },
+			stage{ 0 },
+			entered{ false },
+			task{ pipeline._engine, tokenTask, this }
+		{}
+
+		Pipeline* pipeline;
+		// Stage the token runs next, 0 being the input
+		std::size_t stage;
+		// Set when the token was let into a serial stage while waiting for it
+		bool entered;
+		// Each token carries its own task, so the pipeline allocates
+		// nothing from the worker pools however long the stream is
+		SerialTask task;
+	};
+
+	Pipeline::Pipeline(Engine& engine, std::size_t maxTokens) :
+		_engine{ engine },
+		_maxTokens{ maxTokens > 0 ? maxTokens : 1 },
+		_nextSequence{ 0 },
+		_exhausted{ false },
+		_retiredTokens{ 0 },
+		_failed{ false }
+	{
+		_stages.push_back(std::make_unique<Stage>());
+		_stages[0]->mode = Mode::SerialOutOfOrder;
+
+		for (std::size_t i = 0; i < _maxTokens; ++i)
+		{
+			_tokens.push_back(std::make_unique<Token>(*this, i));
+		}
+	}
+
+	Pipeline::~Pipeline() = default;
+
+	Pipeline& Pipeline::input(InputFunction function)
+	{
+		_input = std::move(function);
+		return *this;
+	}
+
+	Pipeline& Pipeline::stage(Mode mode, StageFunction function)
+	{
+		_stages.push_back(std::make_unique<Stage>());
+		_stages.back()->mode = mode;
+		_stages.back()->function = std::move(function);
+		return *this;
+	}
+
+	std::size_t Pipeline::maxTokens() const
+	{
+		return _maxTokens;
+	}
+
+	void Pipeline::run()
+	{
+		_nextSequence = 0;
+		_exhausted = !_input;
+		_retiredTokens = 0;
+		_failed = false;
+		_error = nullptr;
+
+		for (auto& stage : _stages)
+		{
+			stage->busy = false;
+			stage->next = 0;
+			stage->waiting.clear();
+			stage->waitingInOrder.assign(stage->mode == Mode::SerialInOrder ? _maxTokens : 0, nullptr);
+		}
+
+		for (auto& token : _tokens)
+		{
+			token->stage = 0;
+			token->entered = false;
+			token->data = nullptr;
+			schedule(*token);
+		}
+
+		Worker* worker = _engine.threadWorker();
+
+		if (worker != nullptr)
+		{
+			worker->helpUntil([this] { return finished(); });
+		}
+		else
+		{
+			// Parked until the last token retired, then until every token
+			// returned from its task
+			futex::await(_retiredTokens, [this] { return allRetired(); });
+
+			for (auto& token : _tokens)
+			{
+				token->task.blockUntilIdle();
+			}
+		}
+
+		if (_error)
+		{
+			std::rethrow_exception(std::exchange(_error, nullptr));
+		}
+	}
+
+	void Pipeline::fail(std::exception_ptr error)
+	{
+		if (!_failed.exchange(true, std::memory_order_acq_rel))
+		{
+			// Read by run() once the token retired
+			_error = std::move(error);
+		}
+	}
+
+	bool Pipeline::allRetired() const
+	{
+		return static_cast<std::size_t>(_retiredTokens.load(std::memory_order_acquire)) == _maxTokens;
+	}
+
+	bool Pipeline::finished() const
+	{
+		if (!allRetired())
+		{
+			return false;
+		}
+
+		// Retired tokens may still be returning from their task
+		for (const auto& token : _tokens)
+		{
+			if (!token->task.idle())
+			{
+				return false;
+			}
+		}
+
+		return true;
+	}
+
+	void Pipeline::tokenTask(void* token)
+	{
+		Token& self = *static_cast<Token*>(token);
+		self.pipeline->advance(self);
+	}
+
+	void Pipeline::schedule(Token& token)
+	{
+		// A token parked by its own task, which may still be returning,
+		// is run again by that task
+		token.task.schedule();
+	}
+
+	bool Pipeline::enter(Stage& stage, Token& token)
+	{
+		std::lock_guard<std::mutex> lock{ stage.mutex };
+
+		if (!stage.busy && (stage.mode != Mode::SerialInOrder || token.sequence == stage.next))
+		{
+			stage.busy = true;
+			return true;
+		}
+
+		if (stage.mode == Mode::SerialInOrder)
+		{
+			stage.waitingInOrder[token.sequence % _maxTokens] = &token;
+		}
+		else
+		{
+			stage.waiting.push_back(&token);
+		}
+
+		return false;
+	}
+
+	Pipeline::Token* Pipeline::leave(Stage& stage)
+	{
+		std::lock_guard<std::mutex> lock{ stage.mutex };
+		Token* next = nullptr;
+
+		if (stage.mode == Mode::SerialInOrder)
+		{
+			stage.next++;
+
+			Item*& waiting = stage.waitingInOrder[stage.next % _maxTokens];
+
+			if (waiting != nullptr && waiting->sequence == stage.next)
+			{
+				next = static_cast<Token*>(waiting);
+				waiting = nullptr;
+			}
+		}
+		else if (!stage.waiting.empty())
+		{
+			next = static_cast<Token*>(stage.waiting.front());
+			stage.waiting.pop_front();
+		}
+
+		// The stage is handed over to the next token, so it stays busy
+		stage.busy = next != nullptr;
+		return next;
+	}
+
+	void Pipeline::advance(Token& token)
+	{
+		while (true)
+		{
+			if (token.stage == _stages.size())
+			{
+				// Done with the item, the token goes back to the input
+				token.stage = 0;
+				token.data = nullptr;
+			}
+
+			Stage& stage = *_stages[token.stage];
+
+			if (stage.mode != Mode::Parallel)
+			{
+				if (!token.entered && !enter(stage, token))
+				{
+					// Resumed by the token leaving the stage
+					return;
+				}
+
+				token.entered = false;
+			}
+
+			bool retire = false;
+
+			if (token.stage == 0)
+			{
+				token.sequence = _nextSequence;
+
+				try
+				{
+					// No more items are read once a stage failed
+					_exhausted = _exhausted || _failed.load(std::memory_order_acquire) || !_input(token);
+				}
+				catch (...)
+				{
+					fail(std::current_exception());
+					_exhausted = true;
+				}
+
+				retire = _exhausted;
+
+				if (!retire)
+				{
+					_nextSequence++;
+				}
+			}
+			else if (!_failed.load(std::memory_order_acquire))
+			{
+				// Items in flight still go through the serial stages once a stage
+				// failed, skipping the functions, so the tokens behind get in
+				try
+				{
+					stage.function(token);
+				}
+				catch (...)
+				{
+					fail(std::current_exception());
+				}
+			}
+
+			if (stage.mode != Mode::Parallel)
+			{
+				if (Token* next = leave(stage))
+				{
+					next->entered = true;
+					schedule(*next);
+				}
+			}
+
+			if (retire)
+			{
+				_retiredTokens.fetch_add(1, std::memory_order_release);
+				futex::notify(_retiredTokens);
+				return;
+			}
+
+			token.stage++;
+		}
+	}
+}
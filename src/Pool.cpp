@@ -1,28 +1,63 @@
 #include "../include/Pool.hpp"
+#include <algorithm>
+#include <stdexcept>
 
 
 namespace TaskSystem {
 
-	Pool::Pool(std::size_t maxTasks) :
-		_storage{ maxTasks },
-		_allocatedTasks{ 0 }
+	Pool::Pool(std::size_t maxTasks, TaskSize taskSize, std::size_t generations) :
+		_storage{ (std::max<std::size_t>(generations, 1) * maxTasks * static_cast<std::size_t>(taskSize) +
+			sizeof(CacheLine) - 1) / sizeof(CacheLine) },
+		_taskSize{ static_cast<std::size_t>(taskSize) },
+		_maxTasks{ maxTasks },
+		_generations(std::max<std::size_t>(generations, 1)),
+		_currentGeneration{ 0 },
+		_overflowPolicy{ OverflowPolicy::Discard }
 	{}
 
 	Task* Pool::allocate()
 	{
 		if (full())
 		{
-			return nullptr;
+			++_overflows.poolExhausted;
+
+			switch (overflowPolicy())
+			{
+			case OverflowPolicy::RunInline:
+			case OverflowPolicy::Spill:
+				// Tasks of a pool are always run by a worker, spilling them
+				// loses nothing where returning nullptr would
+				return spill();
+			case OverflowPolicy::Fail:
+				++_overflows.failed;
+				throw OverflowError{ "Task pool exhausted" };
+			default:
+				return nullptr;
+			}
 		}
 		else
 		{
 		
-			Task* taskStorage = &_storage[_allocatedTasks];
-			_allocatedTasks++;
+			Task* taskStorage = at(_generations[_currentGeneration].allocatedTasks);
+			_generations[_currentGeneration].allocatedTasks++;
 			return taskStorage;
 		}
 	}
 
+	Task* Pool::spill()
+	{
+		Generation& tasks = _generations[_currentGeneration];
+
+		if (tasks.spilledTasks == tasks.spillBlocks.size() * SPILL_BLOCK_TASKS)
+		{
+			tasks.spillBlocks.push_back(std::make_unique<CacheLine[]>(
+				(SPILL_BLOCK_TASKS * _taskSize + sizeof(CacheLine) - 1) / sizeof(CacheLine)));
+		}
+
+		++_overflows.spilled;
+		return spilled(_currentGeneration, tasks.spilledTasks++);
+	}
+
 	Task* Pool::createTask(TaskFunction taskFunction)
 	{
 		auto* taskStorage = allocate();
@@ -51,19 +86,118 @@ namespace TaskSystem {
 		}
 	}
 
+	bool Pool::release(Task* task)
+	{
+		Generation& tasks = _generations[_currentGeneration];
+
+		if (tasks.allocatedTasks == 0 || task != at(tasks.allocatedTasks - 1))
+		{
+			return false;
+		}
+
+		tasks.allocatedTasks--;
+		tasks.finishedTasks = std::min(tasks.finishedTasks, tasks.allocatedTasks);
+		return true;
+	}
+
 	void Pool::clear()
 	{
-		_allocatedTasks = 0;
+		for (Generation& generation : _generations)
+		{
+			generation.reset();
+		}
+
+		_currentGeneration = 0;
+	}
+
+	bool Pool::beginGeneration()
+	{
+		const std::size_t next = (_currentGeneration + 1) % _generations.size();
+
+		if (!finished(next))
+		{
+			return false;
+		}
+
+		_generations[next].reset();
+		_currentGeneration = next;
+		return true;
+	}
+
+	bool Pool::finished(std::size_t generation)
+	{
+		Generation& tasks = _generations[generation];
+
+		// Tasks are never reused while their generation is alive, so once
+		// finished they stay finished and the scan can resume where it stopped
+		while (tasks.finishedTasks < tasks.allocatedTasks &&
+			at(generation, tasks.finishedTasks)->finished())
+		{
+			tasks.finishedTasks++;
+		}
+
+		while (tasks.finishedSpilledTasks < tasks.spilledTasks &&
+			spilled(generation, tasks.finishedSpilledTasks)->finished())
+		{
+			tasks.finishedSpilledTasks++;
+		}
+
+		return tasks.finishedTasks == tasks.allocatedTasks && tasks.finishedSpilledTasks == tasks.spilledTasks;
+	}
+
+	void Pool::setOverflowPolicy(OverflowPolicy policy)
+	{
+		if (policy == OverflowPolicy::HelpUntilSpace)
+		{
+			throw std::invalid_argument{ "A pool cannot help running tasks, it has no worker" };
+		}
+
+		_overflowPolicy.store(policy, std::memory_order_relaxed);
+	}
+
+	OverflowPolicy Pool::overflowPolicy() const
+	{
+		return _overflowPolicy.load(std::memory_order_relaxed);
+	}
+
+	OverflowCounters Pool::overflowCounters() const
+	{
+		return _overflows;
+	}
+
+	std::size_t Pool::spilledTasks() const
+	{
+		return _generations[_currentGeneration].spilledTasks;
+	}
+
+	std::size_t Pool::generations() const
+	{
+		return _generations.size();
+	}
+
+	std::size_t Pool::currentGeneration() const
+	{
+		return _currentGeneration;
 	}
 
 	std::size_t Pool::tasks() const
 	{
-		return _allocatedTasks;
+		return _generations[_currentGeneration].allocatedTasks;
 	}
 
 	std::size_t Pool::maxTasks() const
 	{
-		return _storage.size();
+		return _maxTasks;
+	}
+
+	TaskSize Pool::taskSize() const
+	{
+		return static_cast<TaskSize>(_taskSize);
+	}
+
+	std::size_t Pool::maxDataSize() const
+	{
+		return Task::maxDataSize(taskSize());
 	}
 
 	float Pool::tasksFactor() const
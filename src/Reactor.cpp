@@ -0,0 +1,213 @@
+#include "../include/Reactor.hpp"
+
+#if defined(__linux__)
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <unistd.h>
+#include <cerrno>
+#endif
+
+namespace TaskSystem {
+	Reactor::Reactor() :
+		_fd{ -1 },
+		_eventFd{ -1 },
+		_polling{ false },
+		_blocked{ false },
+		_watching{ 0 }
+	{
+#if defined(__linux__)
+		_fd = epoll_create1(EPOLL_CLOEXEC);
+		_eventFd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+
+		if (_fd >= 0 && _eventFd >= 0)
+		{
+			// Level triggered, collect() drains it
+			epoll_event event{};
+			event.events = EPOLLIN;
+			event.data.fd = _eventFd;
+			epoll_ctl(_fd, EPOLL_CTL_ADD, _eventFd, &event);
+		}
+#endif
+	}
+
+	Reactor::~Reactor()
+	{
+#if defined(__linux__)
+		if (_eventFd >= 0)
+		{
+			close(_eventFd);
+		}
+
+		if (_fd >= 0)
+		{
+			close(_fd);
+		}
+#endif
+	}
+
+	void Reactor::interrupt()
+	{
+#if defined(__linux__)
+		if (_blocked.load() && _eventFd >= 0)
+		{
+			const std::uint64_t one = 1;
+			const ssize_t written = write(_eventFd, &one, sizeof(one));
+			(void)written;
+		}
+#endif
+	}
+
+	bool Reactor::watch(int fd, std::uint32_t events, Task* continuation, std::uint32_t* readyEvents)
+	{
+#if defined(__linux__)
+		if (_fd < 0 || continuation == nullptr)
+		{
+			return false;
+		}
+
+		epoll_event event{};
+		event.events = EPOLLONESHOT;
+		event.data.fd = fd;
+
+		if ((events & Readable) != 0)
+		{
+			event.events |= EPOLLIN | EPOLLRDHUP;
+		}
+
+		if ((events & Writable) != 0)
+		{
+			event.events |= EPOLLOUT;
+		}
+
+		std::lock_guard<std::mutex> lock{ _mutex };
+
+		auto it = _registrations.find(fd);
+		const bool known = it != _registrations.end();
+		const bool pending = known && it->second.continuation != nullptr;
+
+		// The registration must be in place before arming the file descriptor,
+		// since the polling worker may get the notification right away
+		Registration& registration = known ? it->second : _registrations[fd];
+		const Registration previous = registration;
+		registration = Registration{ continuation, readyEvents };
+
+		if (epoll_ctl(_fd, known ? EPOLL_CTL_MOD : EPOLL_CTL_ADD, fd, &event) != 0 &&
+			(!known || errno != ENOENT || epoll_ctl(_fd, EPOLL_CTL_ADD, fd, &event) != 0))
+		{
+			if (known)
+			{
+				registration = previous;
+			}
+			else
+			{
+				_registrations.erase(fd);
+			}
+
+			return false;
+		}
+
+		if (!pending)
+		{
+			_watching.fetch_add(1, std::memory_order_relaxed);
+		}
+
+		return true;
+#else
+		(void)fd;
+		(void)events;
+		(void)continuation;
+		(void)readyEvents;
+		return false;
+#endif
+	}
+
+	Task* Reactor::unwatch(int fd)
+	{
+#if defined(__linux__)
+		std::lock_guard<std::mutex> lock{ _mutex };
+
+		auto it = _registrations.find(fd);
+
+		if (it == _registrations.end())
+		{
+			return nullptr;
+		}
+
+		Task* continuation = it->second.continuation;
+		_registrations.erase(it);
+		epoll_ctl(_fd, EPOLL_CTL_DEL, fd, nullptr);
+
+		if (continuation != nullptr)
+		{
+			_watching.fetch_sub(1, std::memory_order_relaxed);
+		}
+
+		return continuation;
+#else
+		(void)fd;
+		return nullptr;
+#endif
+	}
+
+	std::size_t Reactor::watching() const
+	{
+		return _watching.load(std::memory_order_relaxed);
+	}
+
+	std::size_t Reactor::collect(Task** continuations, int timeout)
+	{
+#if defined(__linux__)
+		epoll_event events[MAX_EVENTS];
+		const int count = epoll_wait(_fd, events, static_cast<int>(MAX_EVENTS), timeout);
+
+		if (count <= 0)
+		{
+			return 0;
+		}
+
+		std::size_t collected = 0;
+		std::lock_guard<std::mutex> lock{ _mutex };
+
+		for (int i = 0; i < count; ++i)
+		{
+			if (events[i].data.fd == _eventFd)
+			{
+				std::uint64_t interrupts;
+				const ssize_t read = ::read(_eventFd, &interrupts, sizeof(interrupts));
+				(void)read;
+				continue;
+			}
+
+			auto it = _registrations.find(events[i].data.fd);
+
+			// The file descriptor may have been unwatched meanwhile
+			if (it == _registrations.end() || it->second.continuation == nullptr)
+			{
+				continue;
+			}
+
+			Registration& registration = it->second;
+
+			if (registration.readyEvents != nullptr)
+			{
+				std::uint32_t ready = 0;
+				ready |= (events[i].events & EPOLLIN) != 0 ? static_cast<std::uint32_t>(Readable) : 0;
+				ready |= (events[i].events & EPOLLOUT) != 0 ? static_cast<std::uint32_t>(Writable) : 0;
+				ready |= (events[i].events & EPOLLERR) != 0 ? static_cast<std::uint32_t>(Error) : 0;
+				ready |= (events[i].events & (EPOLLHUP | EPOLLRDHUP)) != 0 ? static_cast<std::uint32_t>(HangUp) : 0;
+				*registration.readyEvents = ready;
+			}
+
+			continuations[collected++] = registration.continuation;
+			registration.continuation = nullptr;
+		}
+
+		_watching.fetch_sub(collected, std::memory_order_relaxed);
+		return collected;
+#else
+		(void)continuations;
+		(void)timeout;
+		return 0;
+#endif
+	}
+}
@@ -0,0 +1,87 @@
+#include "../include/Schedule.hpp"
+
+#include <istream>
+#include <ostream>
+#include <string>
+
+namespace TaskSystem {
+	void Schedule::clear()
+	{
+		steps.clear();
+		victims.clear();
+	}
+
+	void Schedule::save(std::ostream& os) const
+	{
+		os << "steps " << steps.size() << '\n';
+
+		for (const auto step : steps)
+		{
+			os << step << ' ';
+		}
+
+		os << "\nworkers " << victims.size() << '\n';
+
+		for (const auto& worker : victims)
+		{
+			os << worker.size() << '\n';
+
+			for (const auto victim : worker)
+			{
+				os << victim << ' ';
+			}
+
+			os << '\n';
+		}
+	}
+
+	bool Schedule::load(std::istream& is)
+	{
+		clear();
+
+		std::string tag;
+		std::size_t count = 0;
+
+		if (!(is >> tag >> count) || tag != "steps")
+		{
+			return false;
+		}
+
+		steps.resize(count);
+
+		for (auto& step : steps)
+		{
+			if (!(is >> step))
+			{
+				return false;
+			}
+		}
+
+		if (!(is >> tag >> count) || tag != "workers")
+		{
+			return false;
+		}
+
+		victims.resize(count);
+
+		for (auto& worker : victims)
+		{
+			if (!(is >> count))
+			{
+				return false;
+			}
+
+			worker.resize(count);
+
+			for (auto& victim : worker)
+			{
+				if (!(is >> victim))
+				{
+					return false;
+				}
+			}
+		}
+
+		return true;
+	}
+}
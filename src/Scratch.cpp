@@ -0,0 +1,73 @@
+#include "../include/Scratch.hpp"
+#include <algorithm>
+#include <cstdint>
+
+namespace TaskSystem {
+	static thread_local Scratch* currentScratch = nullptr;
+
+	Scratch::Scratch(std::size_t blockSize) :
+		_blockSize{ std::max<std::size_t>(blockSize, 1) },
+		_block{ 0 },
+		_offset{ 0 }
+	{}
+
+	void* Scratch::allocate(std::size_t bytes, std::size_t alignment)
+	{
+		// Blocks are allocated lazily, workers never using the arena cost nothing
+		while (_block < _blocks.size())
+		{
+			Block& block = _blocks[_block];
+			const auto base = reinterpret_cast<std::uintptr_t>(block.bytes.get());
+			const std::size_t offset = ((base + _offset + alignment - 1) & ~(alignment - 1)) - base;
+
+			if (offset + bytes <= block.size)
+			{
+				_offset = offset + bytes;
+				return block.bytes.get() + offset;
+			}
+
+			// Blocks left behind are reused once the arena is rewound
+			_block++;
+			_offset = 0;
+		}
+
+		const std::size_t size = std::max(
+			_blocks.empty() ? _blockSize : _blocks.back().size * 2, bytes + alignment);
+
+		_blocks.push_back(Block{ std::unique_ptr<unsigned char[]>{ new unsigned char[size] }, size });
+		_block = _blocks.size() - 1;
+		_offset = 0;
+
+		return allocate(bytes, alignment);
+	}
+
+	std::size_t Scratch::capacity() const
+	{
+		std::size_t total = 0;
+
+		for (const auto& block : _blocks)
+		{
+			total += block.size;
+		}
+
+		return total;
+	}
+
+	Scratch& Scratch::current()
+	{
+		if (currentScratch != nullptr)
+		{
+			return *currentScratch;
+		}
+
+		static thread_local Scratch threadScratch;
+		return threadScratch;
+	}
+
+	Scratch* Scratch::makeCurrent(Scratch* scratch)
+	{
+		Scratch* previous = currentScratch;
+		currentScratch = scratch;
+		return previous;
+	}
+}
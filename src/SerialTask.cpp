@@ -0,0 +1,78 @@
+#include "../include/SerialTask.hpp"
+#include "../include/Engine.hpp"
+#include <thread>
+
+namespace TaskSystem {
+	SerialTask::SerialTask(Engine& engine, Function function, void* context) :
+		_run{ { nullptr }, this },
+		_engine{ engine },
+		_function{ function },
+		_context{ context },
+		_state{ State::Idle }
+	{
+		// Finished, as if it had run once already
+		_run.task.discard();
+	}
+
+	void SerialTask::schedule()
+	{
+		State state = _state.load();
+
+		while (state != State::RunAgain)
+		{
+			const State next = state == State::Idle ? State::Running : State::RunAgain;
+
+			if (_state.compare_exchange_weak(state, next))
+			{
+				if (next == State::Running)
+				{
+					submit();
+				}
+
+				return;
+			}
+		}
+	}
+
+	bool SerialTask::idle() const
+	{
+		return _state.load() == State::Idle && _run.task.finished();
+	}
+
+	void SerialTask::blockUntilIdle()
+	{
+		// A run scheduled right before its predecessor finished is only
+		// submitted after that, the loop waits for it in turn
+		while (!idle())
+		{
+			_run.task.blockUntilFinished();
+		}
+	}
+
+	void SerialTask::submit()
+	{
+		// The previous run went idle right before its task finished
+		while (!_run.task.finished())
+		{
+			std::this_thread::yield();
+		}
+
+		// Rearmed rather than constructed again, idle() may be reading the counter
+		_run.task.rearm(runTask);
+		_engine.submit(&_run.task);
+	}
+
+	void SerialTask::runTask(Task& task)
+	{
+		SerialTask& self = *reinterpret_cast<Link&>(task).owner;
+		State running = State::Running;
+
+		// Scheduled since the function was called, run it again
+		do
+		{
+			self._state.store(State::Running);
+			self._function(self._context);
+			running = State::Running;
+		} while (!self._state.compare_exchange_strong(running, State::Idle));
+	}
+}
@@ -0,0 +1,988 @@
+#include "../include/Simd.hpp"
+#include "../include/Scratch.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cassert>
+#include <cstring>
+#include <limits>
+
+#if (defined(__x86_64__) || defined(__i386__)) && (defined(__GNUC__) || defined(__clang__))
+#define TASKSYSTEM_SIMD_X86
+#include <immintrin.h>
+#define TASKSYSTEM_TARGET(isa) __attribute__((target(isa)))
+#endif
+
+namespace TaskSystem {
+namespace simd {
+	namespace {
+		std::atomic<Isa>& selectedIsa()
+		{
+			static std::atomic<Isa> isa{ supportedIsa() };
+			return isa;
+		}
+
+		template<typename Result, typename T>
+		Result scalarSum(const T* data, std::size_t size)
+		{
+			Result sum = 0;
+
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				sum += data[i];
+			}
+
+			return sum;
+		}
+
+		template<typename T>
+		T scalarMin(const T* data, std::size_t size)
+		{
+			T min = std::numeric_limits<T>::max();
+
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				min = std::min(min, data[i]);
+			}
+
+			return min;
+		}
+
+		template<typename T>
+		T scalarMax(const T* data, std::size_t size)
+		{
+			T max = std::numeric_limits<T>::lowest();
+
+			for (std::size_t i = 0; i < size; ++i)
+			{
+				max = std::max(max, data[i]);
+			}
+
+			return max;
+		}
+
+		template<typename T>
+		void scalarSortSmall(T* data, std::size_t size)
+		{
+			for (std::size_t i = 1; i < size; ++i)
+			{
+				const T value = data[i];
+				std::size_t j = i;
+
+				for (; j > 0 && value < data[j - 1]; --j)
+				{
+					data[j] = data[j - 1];
+				}
+
+				data[j] = value;
+			}
+		}
+
+		template<typename T>
+		std::size_t scalarPartition(T* data, std::size_t size, T pivot)
+		{
+			return std::partition(data, data + size, [pivot](T value) { return value < pivot; }) - data;
+		}
+
+		// Pads the elements to sort with the largest value, which stays at the end
+		template<typename T>
+		void padSmall(T (&padded)[SMALL_SORT_SIZE], const T* data, std::size_t size)
+		{
+			const T largest = std::numeric_limits<T>::has_infinity ?
+				std::numeric_limits<T>::infinity() : std::numeric_limits<T>::max();
+
+			std::fill(padded, padded + SMALL_SORT_SIZE, largest);
+			std::copy(data, data + size, padded);
+		}
+
+#ifdef TASKSYSTEM_SIMD_X86
+		// For each mask of 8 lanes, the lanes set followed by the others, so
+		// a permutation moves the lanes selected to the front
+		struct CompressTable
+		{
+			std::uint8_t lanes[256][8];
+		};
+
+		constexpr CompressTable makeCompressTable()
+		{
+			CompressTable table{};
+
+			for (unsigned mask = 0; mask < 256; ++mask)
+			{
+				unsigned next = 0;
+
+				for (unsigned lane = 0; lane < 8; ++lane)
+				{
+					if ((mask >> lane) & 1)
+					{
+						table.lanes[mask][next++] = static_cast<std::uint8_t>(lane);
+					}
+				}
+
+				for (unsigned lane = 0; lane < 8; ++lane)
+				{
+					if (!((mask >> lane) & 1))
+					{
+						table.lanes[mask][next++] = static_cast<std::uint8_t>(lane);
+					}
+				}
+			}
+
+			return table;
+		}
+
+		constexpr CompressTable COMPRESS_TABLE = makeCompressTable();
+
+		// Lanes of a compare-exchange against lane i ^ distance keeping the
+		// maximum, the ones above their partner
+		constexpr unsigned maxLanes(unsigned distance, unsigned lanes)
+		{
+			unsigned mask = 0;
+
+			for (unsigned lane = 0; lane < lanes; ++lane)
+			{
+				mask |= ((lane ^ distance) < lane ? 1u : 0u) << lane;
+			}
+
+			return mask;
+		}
+
+		// SSE2
+
+		TASKSYSTEM_TARGET("sse2") std::int64_t sumSse2(const std::int32_t* data, std::size_t size)
+		{
+			__m128i sum = _mm_setzero_si128();
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				// Sign extended to 64 bits with the sign of each lane
+				const __m128i sign = _mm_srai_epi32(values, 31);
+				sum = _mm_add_epi64(sum, _mm_unpacklo_epi32(values, sign));
+				sum = _mm_add_epi64(sum, _mm_unpackhi_epi32(values, sign));
+			}
+
+			std::int64_t lanes[2];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), sum);
+			return lanes[0] + lanes[1] + scalarSum<std::int64_t>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("sse2") float sumSse2(const float* data, std::size_t size)
+		{
+			__m128 sum = _mm_setzero_ps();
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				sum = _mm_add_ps(sum, _mm_loadu_ps(data + i));
+			}
+
+			float lanes[4];
+			_mm_storeu_ps(lanes, sum);
+			return (lanes[0] + lanes[1]) + (lanes[2] + lanes[3]) + scalarSum<float>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("sse2") double sumSse2(const double* data, std::size_t size)
+		{
+			__m128d sum = _mm_setzero_pd();
+			std::size_t i = 0;
+
+			for (; i + 2 <= size; i += 2)
+			{
+				sum = _mm_add_pd(sum, _mm_loadu_pd(data + i));
+			}
+
+			double lanes[2];
+			_mm_storeu_pd(lanes, sum);
+			return lanes[0] + lanes[1] + scalarSum<double>(data + i, size - i);
+		}
+
+		// SSE2 has no 32 bit integer min and max, they are blended from a comparison
+		TASKSYSTEM_TARGET("sse2") std::int32_t minSse2(const std::int32_t* data, std::size_t size)
+		{
+			__m128i min = _mm_set1_epi32(std::numeric_limits<std::int32_t>::max());
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				const __m128i greater = _mm_cmpgt_epi32(min, values);
+				min = _mm_or_si128(_mm_and_si128(greater, values), _mm_andnot_si128(greater, min));
+			}
+
+			std::int32_t lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), min);
+			return std::min(scalarMin(lanes, 4), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("sse2") std::int32_t maxSse2(const std::int32_t* data, std::size_t size)
+		{
+			__m128i max = _mm_set1_epi32(std::numeric_limits<std::int32_t>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				const __m128i values = _mm_loadu_si128(reinterpret_cast<const __m128i*>(data + i));
+				const __m128i greater = _mm_cmpgt_epi32(values, max);
+				max = _mm_or_si128(_mm_and_si128(greater, values), _mm_andnot_si128(greater, max));
+			}
+
+			std::int32_t lanes[4];
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(lanes), max);
+			return std::max(scalarMax(lanes, 4), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("sse2") float minSse2(const float* data, std::size_t size)
+		{
+			__m128 min = _mm_set1_ps(std::numeric_limits<float>::max());
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				min = _mm_min_ps(min, _mm_loadu_ps(data + i));
+			}
+
+			float lanes[4];
+			_mm_storeu_ps(lanes, min);
+			return std::min(scalarMin(lanes, 4), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("sse2") float maxSse2(const float* data, std::size_t size)
+		{
+			__m128 max = _mm_set1_ps(std::numeric_limits<float>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				max = _mm_max_ps(max, _mm_loadu_ps(data + i));
+			}
+
+			float lanes[4];
+			_mm_storeu_ps(lanes, max);
+			return std::max(scalarMax(lanes, 4), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("sse2") double minSse2(const double* data, std::size_t size)
+		{
+			__m128d min = _mm_set1_pd(std::numeric_limits<double>::max());
+			std::size_t i = 0;
+
+			for (; i + 2 <= size; i += 2)
+			{
+				min = _mm_min_pd(min, _mm_loadu_pd(data + i));
+			}
+
+			double lanes[2];
+			_mm_storeu_pd(lanes, min);
+			return std::min(scalarMin(lanes, 2), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("sse2") double maxSse2(const double* data, std::size_t size)
+		{
+			__m128d max = _mm_set1_pd(std::numeric_limits<double>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 2 <= size; i += 2)
+			{
+				max = _mm_max_pd(max, _mm_loadu_pd(data + i));
+			}
+
+			double lanes[2];
+			_mm_storeu_pd(lanes, max);
+			return std::max(scalarMax(lanes, 2), scalarMax(data + i, size - i));
+		}
+
+		// AVX2
+
+		TASKSYSTEM_TARGET("avx2") std::int64_t sumAvx2(const std::int32_t* data, std::size_t size)
+		{
+			__m256i low = _mm256_setzero_si256();
+			__m256i high = _mm256_setzero_si256();
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				low = _mm256_add_epi64(low, _mm256_cvtepi32_epi64(_mm256_castsi256_si128(values)));
+				high = _mm256_add_epi64(high, _mm256_cvtepi32_epi64(_mm256_extracti128_si256(values, 1)));
+			}
+
+			std::int64_t lanes[4];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), _mm256_add_epi64(low, high));
+			return lanes[0] + lanes[1] + lanes[2] + lanes[3] + scalarSum<std::int64_t>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("avx2") float sumAvx2(const float* data, std::size_t size)
+		{
+			// Two accumulators hide the latency of the additions
+			__m256 first = _mm256_setzero_ps();
+			__m256 second = _mm256_setzero_ps();
+			std::size_t i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				first = _mm256_add_ps(first, _mm256_loadu_ps(data + i));
+				second = _mm256_add_ps(second, _mm256_loadu_ps(data + i + 8));
+			}
+
+			float lanes[8];
+			_mm256_storeu_ps(lanes, _mm256_add_ps(first, second));
+			return scalarSum<float>(lanes, 8) + scalarSum<float>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("avx2") double sumAvx2(const double* data, std::size_t size)
+		{
+			__m256d first = _mm256_setzero_pd();
+			__m256d second = _mm256_setzero_pd();
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				first = _mm256_add_pd(first, _mm256_loadu_pd(data + i));
+				second = _mm256_add_pd(second, _mm256_loadu_pd(data + i + 4));
+			}
+
+			double lanes[4];
+			_mm256_storeu_pd(lanes, _mm256_add_pd(first, second));
+			return scalarSum<double>(lanes, 4) + scalarSum<double>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("avx2") std::int32_t minAvx2(const std::int32_t* data, std::size_t size)
+		{
+			__m256i min = _mm256_set1_epi32(std::numeric_limits<std::int32_t>::max());
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				min = _mm256_min_epi32(min, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+			}
+
+			std::int32_t lanes[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), min);
+			return std::min(scalarMin(lanes, 8), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx2") std::int32_t maxAvx2(const std::int32_t* data, std::size_t size)
+		{
+			__m256i max = _mm256_set1_epi32(std::numeric_limits<std::int32_t>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				max = _mm256_max_epi32(max, _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i)));
+			}
+
+			std::int32_t lanes[8];
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(lanes), max);
+			return std::max(scalarMax(lanes, 8), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx2") float minAvx2(const float* data, std::size_t size)
+		{
+			__m256 min = _mm256_set1_ps(std::numeric_limits<float>::max());
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				min = _mm256_min_ps(min, _mm256_loadu_ps(data + i));
+			}
+
+			float lanes[8];
+			_mm256_storeu_ps(lanes, min);
+			return std::min(scalarMin(lanes, 8), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx2") float maxAvx2(const float* data, std::size_t size)
+		{
+			__m256 max = _mm256_set1_ps(std::numeric_limits<float>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				max = _mm256_max_ps(max, _mm256_loadu_ps(data + i));
+			}
+
+			float lanes[8];
+			_mm256_storeu_ps(lanes, max);
+			return std::max(scalarMax(lanes, 8), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx2") double minAvx2(const double* data, std::size_t size)
+		{
+			__m256d min = _mm256_set1_pd(std::numeric_limits<double>::max());
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				min = _mm256_min_pd(min, _mm256_loadu_pd(data + i));
+			}
+
+			double lanes[4];
+			_mm256_storeu_pd(lanes, min);
+			return std::min(scalarMin(lanes, 4), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx2") double maxAvx2(const double* data, std::size_t size)
+		{
+			__m256d max = _mm256_set1_pd(std::numeric_limits<double>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 4 <= size; i += 4)
+			{
+				max = _mm256_max_pd(max, _mm256_loadu_pd(data + i));
+			}
+
+			double lanes[4];
+			_mm256_storeu_pd(lanes, max);
+			return std::max(scalarMax(lanes, 4), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx2") inline __m256i laneMask(unsigned lanes)
+		{
+			const __m256i bits = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+			return _mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(static_cast<int>(lanes)), bits), bits);
+		}
+
+		TASKSYSTEM_TARGET("avx2") inline __m256i partners(unsigned distance)
+		{
+			return _mm256_xor_si256(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(static_cast<int>(distance)));
+		}
+
+		// Compares each lane with lane i ^ distance, the higher lane of each pair keeps the maximum
+		TASKSYSTEM_TARGET("avx2") inline __m256i compareExchange(__m256i values, unsigned distance)
+		{
+			const __m256i other = _mm256_permutevar8x32_epi32(values, partners(distance));
+			return _mm256_blendv_epi8(_mm256_min_epi32(values, other), _mm256_max_epi32(values, other),
+				laneMask(maxLanes(distance, 8)));
+		}
+
+		TASKSYSTEM_TARGET("avx2") inline __m256 compareExchange(__m256 values, unsigned distance)
+		{
+			const __m256 other = _mm256_permutevar8x32_ps(values, partners(distance));
+			return _mm256_blendv_ps(_mm256_min_ps(values, other), _mm256_max_ps(values, other),
+				_mm256_castsi256_ps(laneMask(maxLanes(distance, 8))));
+		}
+
+		// Bitonic network: each merge compares the mirrored lanes of its
+		// block, then halves the distance down to neighbour lanes
+		template<typename Vector>
+		TASKSYSTEM_TARGET("avx2") inline Vector sort8(Vector values)
+		{
+			values = compareExchange(values, 1);
+			values = compareExchange(values, 3);
+			values = compareExchange(values, 1);
+			values = compareExchange(values, 7);
+			values = compareExchange(values, 2);
+			return compareExchange(values, 1);
+		}
+
+		template<typename Vector>
+		TASKSYSTEM_TARGET("avx2") inline Vector clean8(Vector values)
+		{
+			values = compareExchange(values, 4);
+			values = compareExchange(values, 2);
+			return compareExchange(values, 1);
+		}
+
+		TASKSYSTEM_TARGET("avx2") void sortSmallAvx2(std::int32_t* data, std::size_t size)
+		{
+			std::int32_t padded[SMALL_SORT_SIZE];
+			padSmall(padded, data, size);
+			const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+			__m256i low = sort8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(padded)));
+
+			if (size > 8)
+			{
+				const __m256i high = _mm256_permutevar8x32_epi32(
+					sort8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(padded + 8))), reverse);
+				const __m256i merged = _mm256_max_epi32(low, high);
+				low = clean8(_mm256_min_epi32(low, high));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(padded + 8), clean8(_mm256_permutevar8x32_epi32(merged, reverse)));
+			}
+
+			_mm256_storeu_si256(reinterpret_cast<__m256i*>(padded), low);
+			std::copy(padded, padded + size, data);
+		}
+
+		TASKSYSTEM_TARGET("avx2") void sortSmallAvx2(float* data, std::size_t size)
+		{
+			float padded[SMALL_SORT_SIZE];
+			padSmall(padded, data, size);
+			const __m256i reverse = _mm256_setr_epi32(7, 6, 5, 4, 3, 2, 1, 0);
+
+			__m256 low = sort8(_mm256_loadu_ps(padded));
+
+			if (size > 8)
+			{
+				const __m256 high = _mm256_permutevar8x32_ps(sort8(_mm256_loadu_ps(padded + 8)), reverse);
+				const __m256 merged = _mm256_max_ps(low, high);
+				low = clean8(_mm256_min_ps(low, high));
+				_mm256_storeu_ps(padded + 8, clean8(_mm256_permutevar8x32_ps(merged, reverse)));
+			}
+
+			_mm256_storeu_ps(padded, low);
+			std::copy(padded, padded + size, data);
+		}
+
+		TASKSYSTEM_TARGET("avx2") inline __m256i compressPermutation(unsigned mask)
+		{
+			return _mm256_cvtepu8_epi32(_mm_loadl_epi64(reinterpret_cast<const __m128i*>(COMPRESS_TABLE.lanes[mask])));
+		}
+
+		// Both buffers get the whole permuted vector, the lanes past the ones
+		// kept are overwritten by the next store
+		TASKSYSTEM_TARGET("avx2") std::size_t partitionAvx2(std::int32_t* data, std::size_t size, std::int32_t pivot,
+			std::int32_t* less, std::int32_t* rest)
+		{
+			const __m256i pivots = _mm256_set1_epi32(pivot);
+			std::size_t lessCount = 0, restCount = 0, i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				const __m256i values = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i));
+				const unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(pivots, values))));
+
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(less + lessCount),
+					_mm256_permutevar8x32_epi32(values, compressPermutation(mask)));
+				_mm256_storeu_si256(reinterpret_cast<__m256i*>(rest + restCount),
+					_mm256_permutevar8x32_epi32(values, compressPermutation(~mask & 0xFF)));
+
+				const unsigned count = static_cast<unsigned>(__builtin_popcount(mask));
+				lessCount += count;
+				restCount += 8 - count;
+			}
+
+			for (; i < size; ++i)
+			{
+				(data[i] < pivot ? less[lessCount++] : rest[restCount++]) = data[i];
+			}
+
+			return lessCount;
+		}
+
+		TASKSYSTEM_TARGET("avx2") std::size_t partitionAvx2(float* data, std::size_t size, float pivot,
+			float* less, float* rest)
+		{
+			const __m256 pivots = _mm256_set1_ps(pivot);
+			std::size_t lessCount = 0, restCount = 0, i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				const __m256 values = _mm256_loadu_ps(data + i);
+				const unsigned mask = static_cast<unsigned>(_mm256_movemask_ps(_mm256_cmp_ps(values, pivots, _CMP_LT_OQ)));
+
+				_mm256_storeu_ps(less + lessCount, _mm256_permutevar8x32_ps(values, compressPermutation(mask)));
+				_mm256_storeu_ps(rest + restCount, _mm256_permutevar8x32_ps(values, compressPermutation(~mask & 0xFF)));
+
+				const unsigned count = static_cast<unsigned>(__builtin_popcount(mask));
+				lessCount += count;
+				restCount += 8 - count;
+			}
+
+			for (; i < size; ++i)
+			{
+				(data[i] < pivot ? less[lessCount++] : rest[restCount++]) = data[i];
+			}
+
+			return lessCount;
+		}
+
+		// AVX-512
+
+		TASKSYSTEM_TARGET("avx512f") std::int64_t sumAvx512(const std::int32_t* data, std::size_t size)
+		{
+			__m512i sum = _mm512_setzero_si512();
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				sum = _mm512_add_epi64(sum, _mm512_cvtepi32_epi64(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(data + i))));
+			}
+
+			return _mm512_reduce_add_epi64(sum) + scalarSum<std::int64_t>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("avx512f") float sumAvx512(const float* data, std::size_t size)
+		{
+			__m512 first = _mm512_setzero_ps();
+			__m512 second = _mm512_setzero_ps();
+			std::size_t i = 0;
+
+			for (; i + 32 <= size; i += 32)
+			{
+				first = _mm512_add_ps(first, _mm512_loadu_ps(data + i));
+				second = _mm512_add_ps(second, _mm512_loadu_ps(data + i + 16));
+			}
+
+			return _mm512_reduce_add_ps(_mm512_add_ps(first, second)) + scalarSum<float>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("avx512f") double sumAvx512(const double* data, std::size_t size)
+		{
+			__m512d first = _mm512_setzero_pd();
+			__m512d second = _mm512_setzero_pd();
+			std::size_t i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				first = _mm512_add_pd(first, _mm512_loadu_pd(data + i));
+				second = _mm512_add_pd(second, _mm512_loadu_pd(data + i + 8));
+			}
+
+			return _mm512_reduce_add_pd(_mm512_add_pd(first, second)) + scalarSum<double>(data + i, size - i);
+		}
+
+		TASKSYSTEM_TARGET("avx512f") std::int32_t minAvx512(const std::int32_t* data, std::size_t size)
+		{
+			__m512i min = _mm512_set1_epi32(std::numeric_limits<std::int32_t>::max());
+			std::size_t i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				min = _mm512_min_epi32(min, _mm512_loadu_si512(data + i));
+			}
+
+			return std::min(_mm512_reduce_min_epi32(min), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") std::int32_t maxAvx512(const std::int32_t* data, std::size_t size)
+		{
+			__m512i max = _mm512_set1_epi32(std::numeric_limits<std::int32_t>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				max = _mm512_max_epi32(max, _mm512_loadu_si512(data + i));
+			}
+
+			return std::max(_mm512_reduce_max_epi32(max), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") float minAvx512(const float* data, std::size_t size)
+		{
+			__m512 min = _mm512_set1_ps(std::numeric_limits<float>::max());
+			std::size_t i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				min = _mm512_min_ps(min, _mm512_loadu_ps(data + i));
+			}
+
+			return std::min(_mm512_reduce_min_ps(min), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") float maxAvx512(const float* data, std::size_t size)
+		{
+			__m512 max = _mm512_set1_ps(std::numeric_limits<float>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				max = _mm512_max_ps(max, _mm512_loadu_ps(data + i));
+			}
+
+			return std::max(_mm512_reduce_max_ps(max), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") double minAvx512(const double* data, std::size_t size)
+		{
+			__m512d min = _mm512_set1_pd(std::numeric_limits<double>::max());
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				min = _mm512_min_pd(min, _mm512_loadu_pd(data + i));
+			}
+
+			return std::min(_mm512_reduce_min_pd(min), scalarMin(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") double maxAvx512(const double* data, std::size_t size)
+		{
+			__m512d max = _mm512_set1_pd(std::numeric_limits<double>::lowest());
+			std::size_t i = 0;
+
+			for (; i + 8 <= size; i += 8)
+			{
+				max = _mm512_max_pd(max, _mm512_loadu_pd(data + i));
+			}
+
+			return std::max(_mm512_reduce_max_pd(max), scalarMax(data + i, size - i));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") inline __m512i partners16(unsigned distance)
+		{
+			return _mm512_xor_si512(_mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15),
+				_mm512_set1_epi32(static_cast<int>(distance)));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") inline __m512i compareExchange(__m512i values, unsigned distance)
+		{
+			const __m512i other = _mm512_permutexvar_epi32(partners16(distance), values);
+			return _mm512_mask_blend_epi32(static_cast<__mmask16>(maxLanes(distance, 16)),
+				_mm512_min_epi32(values, other), _mm512_max_epi32(values, other));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") inline __m512 compareExchange(__m512 values, unsigned distance)
+		{
+			const __m512 other = _mm512_permutexvar_ps(partners16(distance), values);
+			return _mm512_mask_blend_ps(static_cast<__mmask16>(maxLanes(distance, 16)),
+				_mm512_min_ps(values, other), _mm512_max_ps(values, other));
+		}
+
+		// The whole bitonic network of 16 lanes fits in one register
+		template<typename Vector>
+		TASKSYSTEM_TARGET("avx512f") inline Vector sort16(Vector values)
+		{
+			values = compareExchange(values, 1);
+			values = compareExchange(values, 3);
+			values = compareExchange(values, 1);
+			values = compareExchange(values, 7);
+			values = compareExchange(values, 2);
+			values = compareExchange(values, 1);
+			values = compareExchange(values, 15);
+			values = compareExchange(values, 4);
+			values = compareExchange(values, 2);
+			return compareExchange(values, 1);
+		}
+
+		TASKSYSTEM_TARGET("avx512f") void sortSmallAvx512(std::int32_t* data, std::size_t size)
+		{
+			const __mmask16 lanes = static_cast<__mmask16>((1u << size) - 1);
+			const __m512i padding = _mm512_set1_epi32(std::numeric_limits<std::int32_t>::max());
+			_mm512_mask_storeu_epi32(data, lanes, sort16(_mm512_mask_loadu_epi32(padding, lanes, data)));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") void sortSmallAvx512(float* data, std::size_t size)
+		{
+			const __mmask16 lanes = static_cast<__mmask16>((1u << size) - 1);
+			const __m512 padding = _mm512_set1_ps(std::numeric_limits<float>::infinity());
+			_mm512_mask_storeu_ps(data, lanes, sort16(_mm512_mask_loadu_ps(padding, lanes, data)));
+		}
+
+		TASKSYSTEM_TARGET("avx512f") std::size_t partitionAvx512(std::int32_t* data, std::size_t size, std::int32_t pivot,
+			std::int32_t* less, std::int32_t* rest)
+		{
+			const __m512i pivots = _mm512_set1_epi32(pivot);
+			std::size_t lessCount = 0, restCount = 0, i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				const __m512i values = _mm512_loadu_si512(data + i);
+				const __mmask16 mask = _mm512_cmplt_epi32_mask(values, pivots);
+
+				_mm512_mask_compressstoreu_epi32(less + lessCount, mask, values);
+				_mm512_mask_compressstoreu_epi32(rest + restCount, static_cast<__mmask16>(~mask), values);
+
+				const unsigned count = static_cast<unsigned>(__builtin_popcount(mask));
+				lessCount += count;
+				restCount += 16 - count;
+			}
+
+			for (; i < size; ++i)
+			{
+				(data[i] < pivot ? less[lessCount++] : rest[restCount++]) = data[i];
+			}
+
+			return lessCount;
+		}
+
+		TASKSYSTEM_TARGET("avx512f") std::size_t partitionAvx512(float* data, std::size_t size, float pivot,
+			float* less, float* rest)
+		{
+			const __m512 pivots = _mm512_set1_ps(pivot);
+			std::size_t lessCount = 0, restCount = 0, i = 0;
+
+			for (; i + 16 <= size; i += 16)
+			{
+				const __m512 values = _mm512_loadu_ps(data + i);
+				const __mmask16 mask = _mm512_cmp_ps_mask(values, pivots, _CMP_LT_OQ);
+
+				_mm512_mask_compressstoreu_ps(less + lessCount, mask, values);
+				_mm512_mask_compressstoreu_ps(rest + restCount, static_cast<__mmask16>(~mask), values);
+
+				const unsigned count = static_cast<unsigned>(__builtin_popcount(mask));
+				lessCount += count;
+				restCount += 16 - count;
+			}
+
+			for (; i < size; ++i)
+			{
+				(data[i] < pivot ? less[lessCount++] : rest[restCount++]) = data[i];
+			}
+
+			return lessCount;
+		}
+#endif
+
+		// The vector partitions compress into two buffers, then copy them back
+		template<typename T>
+		std::size_t vectorPartition(T* data, std::size_t size, T pivot)
+		{
+#ifdef TASKSYSTEM_SIMD_X86
+			const Isa current = isa();
+
+			if (current == Isa::Avx2 || current == Isa::Avx512)
+			{
+				Scratch& scratch = Scratch::current();
+				const Scratch::Marker marker = scratch.mark();
+				// Room for the lanes written past the end by the last store
+				T* less = scratch.allocate<T>(size + 16);
+				T* rest = scratch.allocate<T>(size + 16);
+
+				const std::size_t lessCount = current == Isa::Avx512 ?
+					partitionAvx512(data, size, pivot, less, rest) :
+					partitionAvx2(data, size, pivot, less, rest);
+
+				std::memcpy(data, less, lessCount * sizeof(T));
+				std::memcpy(data + lessCount, rest, (size - lessCount) * sizeof(T));
+				scratch.rewind(marker);
+				return lessCount;
+			}
+#endif
+			return scalarPartition(data, size, pivot);
+		}
+
+		template<typename T>
+		void vectorSortSmall(T* data, std::size_t size)
+		{
+			assert(size <= SMALL_SORT_SIZE);
+
+			if (size <= 1)
+			{
+				return;
+			}
+
+#ifdef TASKSYSTEM_SIMD_X86
+			switch (isa())
+			{
+			case Isa::Avx512:
+				sortSmallAvx512(data, size);
+				return;
+			case Isa::Avx2:
+				sortSmallAvx2(data, size);
+				return;
+			default:
+				break;
+			}
+#endif
+			scalarSortSmall(data, size);
+		}
+	}
+
+	Isa supportedIsa()
+	{
+#ifdef TASKSYSTEM_SIMD_X86
+		__builtin_cpu_init();
+
+		if (__builtin_cpu_supports("avx512f"))
+		{
+			return Isa::Avx512;
+		}
+
+		if (__builtin_cpu_supports("avx2"))
+		{
+			return Isa::Avx2;
+		}
+
+		if (__builtin_cpu_supports("sse2"))
+		{
+			return Isa::Sse2;
+		}
+#endif
+		return Isa::Scalar;
+	}
+
+	Isa isa()
+	{
+		return selectedIsa().load(std::memory_order_relaxed);
+	}
+
+	void setIsa(Isa isa)
+	{
+		selectedIsa().store(std::min(isa, supportedIsa()), std::memory_order_relaxed);
+	}
+
+#ifdef TASKSYSTEM_SIMD_X86
+	// Dispatches a kernel implemented for every instruction set
+#define TASKSYSTEM_DISPATCH(kernel, scalar, ...) \
+	switch (isa()) \
+	{ \
+	case Isa::Avx512: return kernel##Avx512(__VA_ARGS__); \
+	case Isa::Avx2: return kernel##Avx2(__VA_ARGS__); \
+	case Isa::Sse2: return kernel##Sse2(__VA_ARGS__); \
+	default: return scalar(__VA_ARGS__); \
+	}
+#else
+#define TASKSYSTEM_DISPATCH(kernel, scalar, ...) return scalar(__VA_ARGS__);
+#endif
+
+	std::int64_t sum(const std::int32_t* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(sum, scalarSum<std::int64_t>, data, size)
+	}
+
+	float sum(const float* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(sum, scalarSum<float>, data, size)
+	}
+
+	double sum(const double* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(sum, scalarSum<double>, data, size)
+	}
+
+	std::int32_t min(const std::int32_t* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(min, scalarMin, data, size)
+	}
+
+	float min(const float* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(min, scalarMin, data, size)
+	}
+
+	double min(const double* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(min, scalarMin, data, size)
+	}
+
+	std::int32_t max(const std::int32_t* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(max, scalarMax, data, size)
+	}
+
+	float max(const float* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(max, scalarMax, data, size)
+	}
+
+	double max(const double* data, std::size_t size)
+	{
+		TASKSYSTEM_DISPATCH(max, scalarMax, data, size)
+	}
+
+#undef TASKSYSTEM_DISPATCH
+
+	void sortSmall(std::int32_t* data, std::size_t size)
+	{
+		vectorSortSmall(data, size);
+	}
+
+	void sortSmall(float* data, std::size_t size)
+	{
+		vectorSortSmall(data, size);
+	}
+
+	std::size_t partition(std::int32_t* data, std::size_t size, std::int32_t pivot)
+	{
+		return vectorPartition(data, size, pivot);
+	}
+
+	std::size_t partition(float* data, std::size_t size, float pivot)
+	{
+		return vectorPartition(data, size, pivot);
+	}
+}
+}
@@ -1,14 +1,58 @@
 #include "../include/Task.hpp"
+#include "../include/Futex.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
 
 namespace TaskSystem {
+	namespace {
+		// Exceptions of the failed tasks, sharded by task address. Entries are
+		// erased when a wait takes them, or when the failed task is rearmed or
+		// discarded. One a pooled task left unwaited is replaced by the next
+		// task failing in the same storage
+		struct Exceptions
+		{
+			std::mutex mutex;
+			std::unordered_map<const Task*, std::exception_ptr> table;
+			// Size of the table, so reusing storage only locks shards with entries
+			std::atomic<std::size_t> entries{ 0 };
+		};
+
+		constexpr const std::size_t EXCEPTION_SHARDS = 64;
+
+		Exceptions& exceptions(const Task* task)
+		{
+			static Exceptions shards[EXCEPTION_SHARDS];
+			return shards[(reinterpret_cast<std::uintptr_t>(task) / alignof(std::max_align_t)) % EXCEPTION_SHARDS];
+		}
+
+		// Only called for failed tasks, whose entry the flag publishes
+		void forgetException(const Task* task)
+		{
+			Exceptions& failures = exceptions(task);
+
+			if (failures.entries.load(std::memory_order_relaxed) == 0)
+			{
+				return;
+			}
+
+			std::lock_guard<std::mutex> lock{ failures.mutex };
+			failures.table.erase(task);
+			failures.entries.store(failures.table.size(), std::memory_order_relaxed);
+		}
+	}
+
 	Task::Task(TaskFunction taskFunction, Task* parent) :
 		_payload{
+			{ 1 },
+			Affinity::any(),
 			taskFunction,
 			parent
 	}
 	{
-		_payload.unfinishedChildrenTasks.store(1, std::memory_order_seq_cst);
-
 		if (_payload.parent != nullptr)
 		{
 			_payload.parent->incrementUnfinishedChildrenTasks();
@@ -16,17 +60,43 @@ namespace TaskSystem {
 	}
 
 	bool Task::run()
+	{
+		return execute() != Execution::AlreadyFinished;
+	}
+
+	bool Task::runInline()
+	{
+		return execute() == Execution::Completed;
+	}
+
+	Task::Execution Task::execute()
 	{
 		if (finished())
 		{
-			return false;
+			return Execution::AlreadyFinished;
 		}
 
 		TaskFunction taskFunction = _payload.function;
 
 		if (taskFunction != nullptr)
 		{
-			taskFunction(*this);
+			// Tasks run while this one waits rewind their own allocations
+			// before returning, so the arena is always released in LIFO order
+			Scratch& scratch = Scratch::current();
+			const Scratch::Marker marker = scratch.mark();
+
+			// Zero cost unless it throws, the exception is kept for the waiters
+			// instead of unwinding through the worker loop
+			try
+			{
+				taskFunction(*this);
+			}
+			catch (...)
+			{
+				fail(std::current_exception());
+			}
+
+			scratch.rewind(marker);
 
 
 			// When the task is marked as finished, we run the task function
@@ -42,30 +112,136 @@ namespace TaskSystem {
 				_payload.function = nullptr;
 			}
 
-			finish();
+			if (finish())
+			{
+				return Execution::Completed;
+			}
 		}
 
-		return true;
+		return Execution::Pending;
 	}
 
 	bool Task::finished() const
 	{
-		return _payload.unfinishedChildrenTasks.load(std::memory_order_seq_cst) == 0;
+		// Pairs with the release half of the last decrement, so everything the task
+		// (and its children) wrote is visible to whoever sees the task finished
+		return (_payload.unfinishedChildrenTasks.load(std::memory_order_acquire) & COUNTER_MASK) == 0;
+	}
+
+	void Task::blockUntilFinished()
+	{
+		blockUntilFinishedFor(std::chrono::nanoseconds::max());
+	}
+
+	bool Task::blockUntilFinishedFor(std::chrono::nanoseconds timeout)
+	{
+		using clock = std::chrono::steady_clock;
+		const bool forever = timeout == std::chrono::nanoseconds::max();
+		const clock::time_point deadline = forever ? clock::time_point::max() : clock::now() + timeout;
+
+		// The counter drops with a plain store, notified (See `decrementUnfinishedChildrenTasks()`)
+		return futex::await(_payload.unfinishedChildrenTasks, [this] { return finished(); }, deadline);
 	}
 
 	void Task::incrementUnfinishedChildrenTasks()
 	{
-		_payload.unfinishedChildrenTasks.fetch_add(1, std::memory_order_seq_cst);
+		// Relaxed is enough: whoever adds a child is either the task function or
+		// another child, both keeping the task unfinished, and the child is published
+		// to other threads through the work queue, which has its own ordering
+		_payload.unfinishedChildrenTasks.fetch_add(1, std::memory_order_relaxed);
+	}
+
+	bool Task::decrementUnfinishedChildrenTasks(Task*& parent)
+	{
+		// Acquire makes the work of the units released before visible to the thread
+		// releasing the last one, before it runs the finished callback and moves on
+		// to the parent. Release publishes the work of this unit to that thread
+		std::int32_t counter = _payload.unfinishedChildrenTasks.load(std::memory_order_acquire);
+
+		while ((counter & COUNTER_MASK) != 1)
+		{
+			if (_payload.unfinishedChildrenTasks.compare_exchange_weak(
+				counter, counter - 1, std::memory_order_release, std::memory_order_acquire))
+			{
+				return false;
+			}
+		}
+
+		// Last unit: the task function and every child are done, and they were
+		// the only ones adding children or failing, so nobody else writes the
+		// counter anymore. The task is completed before it is seen finished, and
+		// its storage is not touched once it is, it may be reused right away
+		parent = complete();
+		// Reloaded, a throwing callback flagged the task failed
+		counter = _payload.unfinishedChildrenTasks.load(std::memory_order_relaxed);
+		_payload.unfinishedChildrenTasks.store(counter - 1, std::memory_order_release);
+		futex::notify(_payload.unfinishedChildrenTasks);
+		return true;
+	}
+
+	bool Task::failed() const
+	{
+		return (_payload.unfinishedChildrenTasks.load(std::memory_order_acquire) & FAILED_FLAG) != 0;
+	}
+
+	std::exception_ptr Task::exception() const
+	{
+		if (!failed())
+		{
+			return nullptr;
+		}
+
+		Exceptions& failures = exceptions(this);
+		std::lock_guard<std::mutex> lock{ failures.mutex };
+		const auto entry = failures.table.find(this);
+		return entry != failures.table.end() ? entry->second : nullptr;
 	}
 
-	bool Task::decrementUnfinishedChildrenTasks()
+	std::exception_ptr Task::takeException()
 	{
-		return _payload.unfinishedChildrenTasks.fetch_sub(1, std::memory_order_seq_cst) == 1;
+		if (!failed())
+		{
+			return nullptr;
+		}
+
+		Exceptions& failures = exceptions(this);
+		std::lock_guard<std::mutex> lock{ failures.mutex };
+		const auto entry = failures.table.find(this);
+
+		if (entry == failures.table.end())
+		{
+			return nullptr;
+		}
+
+		std::exception_ptr exception = std::move(entry->second);
+		failures.table.erase(entry);
+		failures.entries.store(failures.table.size(), std::memory_order_relaxed);
+		return exception;
+	}
+
+	void Task::fail(std::exception_ptr exception)
+	{
+		// Ancestors are unfinished while this task is, so they can be flagged.
+		// One already failed keeps its first exception, and so do its ancestors.
+		// The flag is set with the shard locked, so exception() finds the entry
+		for (Task* task = this; task != nullptr; task = task->_payload.parent)
+		{
+			Exceptions& failures = exceptions(task);
+			std::lock_guard<std::mutex> lock{ failures.mutex };
+
+			if ((task->_payload.unfinishedChildrenTasks.fetch_or(FAILED_FLAG, std::memory_order_acq_rel) & FAILED_FLAG) != 0)
+			{
+				break;
+			}
+
+			failures.table[task] = exception;
+			failures.entries.store(failures.table.size(), std::memory_order_relaxed);
+		}
 	}
 
 	std::int32_t Task::unfinishedChildrenTasks() const
 	{
-		return _payload.unfinishedChildrenTasks.load(std::memory_order_seq_cst);
+		return _payload.unfinishedChildrenTasks.load(std::memory_order_relaxed) & COUNTER_MASK;
 	}
 
 	Task* Task::parent() const
@@ -73,32 +249,63 @@ namespace TaskSystem {
 		return _payload.parent;
 	}
 
-	void Task::finish()
+	bool Task::finish()
+	{
+		Task* task = this;
+
+		if (!decrementUnfinishedChildrenTasks(task))
+		{
+			return false;
+		}
+
+		// Walk up the parent chain iteratively, deep trees must not
+		// grow the stack of the thread finishing the last leaf
+		while (task != nullptr && task->decrementUnfinishedChildrenTasks(task))
+			;
+
+		return true;
+	}
+
+	Task* Task::complete()
 	{
-		if (decrementUnfinishedChildrenTasks())
+		Task* parent = _payload.parent;
+
+		if (_payload.function != nullptr)
 		{
-			if (_payload.function != nullptr)
+			// If the task function was left as a whenFinished() callback,
+			// execute it. It runs out of the task function, and may run from
+			// the worker loop or a wait, so its exception fails the task too
+			try
 			{
-				// If the task function was left as a whenFinished() callback,
-				// execute it
 				_payload.function(*this);
 			}
-
-			if (_payload.parent != nullptr)
+			catch (...)
 			{
-				_payload.parent->finish();
+				fail(std::current_exception());
 			}
 		}
+
+		return parent;
 	}
 
 	void Task::discard()
 	{
+		if (failed())
+		{
+			forgetException(this);
+		}
+
 		finish();
 	}
 
 	void* Task::data()
 	{
-		return &_padding[0];
+		return reinterpret_cast<char*>(this) + TASK_HEADER_SIZE;
+	}
+
+	const void* Task::data() const
+	{
+		return reinterpret_cast<const char*>(this) + TASK_HEADER_SIZE;
 	}
 
 	void Task::whenFinished(TaskFunction taskFunction)
@@ -106,11 +313,39 @@ namespace TaskSystem {
 		_payload.function = taskFunction;
 	}
 
+	void Task::rearm(TaskFunction taskFunction)
+	{
+		if (failed())
+		{
+			forgetException(this);
+		}
+
+		_payload.function = taskFunction;
+		_payload.parent = nullptr;
+		// Published by the work queue when the task is submitted again
+		_payload.unfinishedChildrenTasks.store(1, std::memory_order_relaxed);
+	}
+
+	void Task::setAffinity(Affinity affinity)
+	{
+		_payload.affinity = affinity;
+	}
+
+	Affinity Task::affinity() const
+	{
+		return _payload.affinity;
+	}
+
 	TaskFunction Task::function() const
 	{
 		return _payload.function;
 	}
 
+	Scratch& Task::scratch()
+	{
+		return Scratch::current();
+	}
+
 	std::uintptr_t Task::id() const
 	{
 		return reinterpret_cast<std::uintptr_t>(this);
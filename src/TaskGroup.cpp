@@ -0,0 +1,94 @@
+#include "../include/TaskGroup.hpp"
+#include "../include/Worker.hpp"
+
+namespace TaskSystem {
+	namespace {
+		// The root only gathers the children, running it releases the count
+		// it holds on itself once they are done
+		void rootTask(Task&)
+		{
+		}
+	}
+
+	TaskGroup::TaskGroup(Engine& engine) :
+		_engine{ engine },
+		_root{ rootTask },
+		_cancelled{ false }
+	{
+	}
+
+	TaskGroup::~TaskGroup()
+	{
+		// A destructor cannot throw, the exception of a group never waited for is dropped
+		join();
+	}
+
+	TaskGroup::Status TaskGroup::wait()
+	{
+		join();
+
+		const Status status = cancelled() ? Status::Cancelled : Status::Complete;
+		std::exception_ptr exception = std::move(_exception);
+
+		// Failures of the tasks themselves, outside the functions. Taken even
+		// when the group has its own, the root entry goes with the wait
+		std::exception_ptr failure = _root.takeException();
+
+		if (exception == nullptr)
+		{
+			exception = std::move(failure);
+		}
+
+		_exception = nullptr;
+		_cancelled.store(false, std::memory_order_relaxed);
+		new(&_root) Task{ rootTask };
+
+		if (exception != nullptr)
+		{
+			std::rethrow_exception(exception);
+		}
+
+		return status;
+	}
+
+	void TaskGroup::cancel()
+	{
+		_cancelled.store(true, std::memory_order_relaxed);
+	}
+
+	bool TaskGroup::cancelled() const
+	{
+		return _cancelled.load(std::memory_order_relaxed);
+	}
+
+	void TaskGroup::fail(std::exception_ptr exception)
+	{
+		{
+			std::lock_guard<std::mutex> lock{ _exceptionMutex };
+
+			if (_exception == nullptr)
+			{
+				_exception = std::move(exception);
+			}
+		}
+
+		cancel();
+	}
+
+	void TaskGroup::join()
+	{
+		// Releases the count the root holds on itself, the last child finishes
+		// it. Nothing reads the root once it is seen finished, it can be
+		// constructed again right away
+		_root.run();
+
+		if (Worker* worker = _engine.threadWorker())
+		{
+			worker->helpUntil([this] { return _root.finished(); });
+		}
+		else
+		{
+			_root.blockUntilFinished();
+		}
+	}
+}
@@ -0,0 +1,286 @@
+#include "../include/TimerWheel.hpp"
+
+namespace TaskSystem {
+	// Entry locations are encoded as level * SLOTS + slot, with an extra
+	// location for timers too far in the future to fit in the wheel
+	static constexpr const std::uint32_t OVERFLOW_LOCATION =
+		static_cast<std::uint32_t>(TimerWheel::LEVELS * TimerWheel::SLOTS);
+
+	TimerWheel::TimerWheel(Clock::time_point start) :
+		_freeList{ NIL },
+		_overflow{ NIL },
+		_start{ start },
+		_currentTick{ 0 },
+		_activeTimers{ 0 }
+	{
+		for (auto& level : _slots)
+		{
+			for (auto& slot : level)
+			{
+				slot = NIL;
+			}
+		}
+	}
+
+	TimerWheel::TimerId TimerWheel::schedule(Task* task, Clock::time_point deadline, Clock::duration period)
+	{
+		std::uint32_t index;
+
+		if (_freeList != NIL)
+		{
+			index = _freeList;
+			_freeList = _entries[index].next;
+		}
+		else
+		{
+			index = static_cast<std::uint32_t>(_entries.size());
+			_entries.push_back(Entry{});
+			_entries[index].generation = 1;
+		}
+
+		Entry& entry = _entries[index];
+		entry.task = task;
+		entry.function = task->function();
+		// Timers already due fire at the next tick, the current one was
+		// already processed
+		entry.deadlineTick = std::max(deadlineTickOf(deadline), _currentTick + 1);
+		entry.periodTicks = 0;
+		entry.fired = false;
+
+		if (period > Clock::duration::zero())
+		{
+			// Round periods to at least one tick, a periodic timer firing
+			// at every advance() call would starve the worker
+			entry.periodTicks = std::max<std::uint64_t>(1,
+				static_cast<std::uint64_t>((period + TICK - Clock::duration{ 1 }) / TICK));
+		}
+
+		place(index);
+		++_activeTimers;
+
+		// The generation prevents stale ids from cancelling a reused entry.
+		// Generation 0 is never used so INVALID_TIMER is never a valid id
+		return (static_cast<TimerId>(entry.generation) << 32) | index;
+	}
+
+	Task* TimerWheel::cancel(TimerId id, bool* fired)
+	{
+		const std::uint32_t index = static_cast<std::uint32_t>(id & 0xFFFFFFFF);
+		const std::uint32_t generation = static_cast<std::uint32_t>(id >> 32);
+
+		if (index >= _entries.size())
+		{
+			return nullptr;
+		}
+
+		Entry& entry = _entries[index];
+
+		if (entry.generation != generation || entry.location == NIL)
+		{
+			return nullptr;
+		}
+
+		Task* task = entry.task;
+
+		if (fired != nullptr)
+		{
+			*fired = entry.fired;
+		}
+
+		unlink(index);
+		release(index);
+		return task;
+	}
+
+	TimerWheel::Clock::time_point TimerWheel::nextExpiry() const
+	{
+		if (_activeTimers == 0)
+		{
+			return Clock::time_point::max();
+		}
+
+		// Timers in a slot of level N cannot expire before that slot is
+		// reached, so the first non empty slot of the lowest level gives the bound
+		for (std::size_t level = 0; level < LEVELS; ++level)
+		{
+			const std::size_t shift = level * SLOTS_BITS;
+			const std::size_t current = (_currentTick >> shift) & (SLOTS - 1);
+
+			for (std::size_t i = 1; i < SLOTS; ++i)
+			{
+				const std::size_t slot = current + i;
+
+				if (slot >= SLOTS)
+				{
+					break;
+				}
+
+				if (_slots[level][slot] != NIL)
+				{
+					const std::uint64_t base = (_currentTick >> (shift + SLOTS_BITS)) << (shift + SLOTS_BITS);
+					return _start + TICK * static_cast<Clock::rep>(base + (static_cast<std::uint64_t>(slot) << shift));
+				}
+			}
+		}
+
+		// Only timers beyond the wheel range left, which are reconsidered when
+		// the highest level wraps around
+		const std::size_t shift = LEVELS * SLOTS_BITS;
+		const std::uint64_t wrap = ((_currentTick >> shift) + 1) << shift;
+		return _start + TICK * static_cast<Clock::rep>(wrap);
+	}
+
+	bool TimerWheel::empty() const
+	{
+		return _activeTimers == 0;
+	}
+
+	std::size_t TimerWheel::size() const
+	{
+		return _activeTimers;
+	}
+
+	std::uint64_t TimerWheel::tickOf(Clock::time_point time) const
+	{
+		if (time <= _start)
+		{
+			return 0;
+		}
+
+		return static_cast<std::uint64_t>((time - _start) / TICK);
+	}
+
+	std::uint64_t TimerWheel::deadlineTickOf(Clock::time_point time) const
+	{
+		// Deadlines are rounded up, timers never fire early
+		if (time <= _start)
+		{
+			return 0;
+		}
+
+		return static_cast<std::uint64_t>((time - _start + TICK - Clock::duration{ 1 }) / TICK);
+	}
+
+	std::uint32_t& TimerWheel::head(std::uint32_t location)
+	{
+		if (location == OVERFLOW_LOCATION)
+		{
+			return _overflow;
+		}
+
+		return _slots[location / SLOTS][location % SLOTS];
+	}
+
+	void TimerWheel::place(std::uint32_t index)
+	{
+		Entry& entry = _entries[index];
+
+		// The level is given by the highest group of bits where the deadline
+		// and the current tick differ
+		const std::uint64_t difference = entry.deadlineTick ^ _currentTick;
+		std::size_t level = 0;
+
+		while (level < LEVELS && (difference >> ((level + 1) * SLOTS_BITS)) != 0)
+		{
+			++level;
+		}
+
+		if (level < LEVELS)
+		{
+			const std::size_t slot = (entry.deadlineTick >> (level * SLOTS_BITS)) & (SLOTS - 1);
+			entry.location = static_cast<std::uint32_t>(level * SLOTS + slot);
+		}
+		else
+		{
+			entry.location = OVERFLOW_LOCATION;
+		}
+
+		std::uint32_t& first = head(entry.location);
+		entry.prev = NIL;
+		entry.next = first;
+
+		if (first != NIL)
+		{
+			_entries[first].prev = index;
+		}
+
+		first = index;
+	}
+
+	void TimerWheel::unlink(std::uint32_t index)
+	{
+		Entry& entry = _entries[index];
+
+		if (entry.prev != NIL)
+		{
+			_entries[entry.prev].next = entry.next;
+		}
+		else
+		{
+			head(entry.location) = entry.next;
+		}
+
+		if (entry.next != NIL)
+		{
+			_entries[entry.next].prev = entry.prev;
+		}
+
+		entry.location = NIL;
+	}
+
+	void TimerWheel::release(std::uint32_t index)
+	{
+		Entry& entry = _entries[index];
+		entry.task = nullptr;
+		entry.location = NIL;
+		entry.next = _freeList;
+		_freeList = index;
+
+		if (++entry.generation == 0)
+		{
+			entry.generation = 1;
+		}
+
+		--_activeTimers;
+	}
+
+	void TimerWheel::cascade()
+	{
+		// When the current tick enters a new slot of an upper level, the timers
+		// of that slot are redistributed in lower levels. Higher levels go first,
+		// since their timers may land in the lower level slots being cascaded next
+		std::size_t levels = 0;
+
+		while (levels < LEVELS - 1 &&
+			(_currentTick & ((std::uint64_t{ 1 } << ((levels + 1) * SLOTS_BITS)) - 1)) == 0)
+		{
+			++levels;
+		}
+
+		if (levels == LEVELS - 1 && (_currentTick & ((std::uint64_t{ 1 } << (LEVELS * SLOTS_BITS)) - 1)) == 0)
+		{
+			// Detach the whole list first, timers still out of range go back to it
+			std::uint32_t index = _overflow;
+			_overflow = NIL;
+
+			while (index != NIL)
+			{
+				const std::uint32_t next = _entries[index].next;
+				place(index);
+				index = next;
+			}
+		}
+
+		for (std::size_t level = levels; level > 0; --level)
+		{
+			std::uint32_t& slot = _slots[level][(_currentTick >> (level * SLOTS_BITS)) & (SLOTS - 1)];
+
+			while (slot != NIL)
+			{
+				const std::uint32_t index = slot;
+				unlink(index);
+				place(index);
+			}
+		}
+	}
+}
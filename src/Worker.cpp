@@ -1,54 +1,143 @@
 
 #include "../include/Worker.hpp"
 #include "../include/Engine.hpp"
+#include "../include/Futex.hpp"
 
 namespace TaskSystem {
+	// Number of tasks run between timer and I/O checks when the worker is busy
+	static constexpr const std::size_t EVENTS_CHECK_PERIOD = 64;
+
+	// Queue depth from which SpawnPolicy::Auto runs tasks inline
+	static constexpr const std::size_t AUTO_INLINE_QUEUE_DEPTH = 8;
+
+	// Longest a parked worker sleeps before polling events again
+	static constexpr const std::chrono::milliseconds MAX_PARK_PERIOD{ 10 };
+
+	// Waiting for a failed task throws what the task (or a descendant) threw,
+	// taken from the task so its entry goes with the wait
+	static void rethrowIfFailed(Task* task)
+	{
+		if (std::exception_ptr exception = task->takeException())
+		{
+			std::rethrow_exception(exception);
+		}
+	}
+
 	Worker::Worker(
 		const std::uint64_t id,
 		Engine* engine,
 		std::size_t         poolSize,
-		Worker::Mode        mode)
-		: _workQueue{ poolSize + 1 },
-		_pool{ poolSize },
+		Worker::Mode        mode,
+		TaskSize            taskSize,
+		std::size_t         poolGenerations)
+		: _workQueue{ poolSize * std::max<std::size_t>(poolGenerations, 1) + 1 },
+		_pool{ poolSize, taskSize, poolGenerations },
 		_engine{ engine },
 		_mode{ mode },
 		_state{ State::Idle },
+		_wakeups{ 0 },
 		_totalTasksRun{ 0 },
 		_totalTasksDiscarded{ 0 },
+		_totalStealFailures{ 0 },
 		_cyclesWithoutTasks{ 0 },
+		_idleSteals{ 0 },
+		_idleStealFailures{ 0 },
 		_maxCyclesWithoutTasks{ 0 },
-		_id{ id }
+		_id{ id },
+		_randomState{ id + 1 },
+		_replayVictims{ nullptr },
+		_replayCursor{ 0 },
+		_recordedVictims{ nullptr },
+		_frame{ 0 },
+		_previousScratch{ nullptr },
+		_parked{ false },
+		_node{ 0 },
+		_inboxCursor{ 0 },
+		_pendingMail{ 0 }
+	{
+	}
+
+	void Worker::configureScheduling(
+		std::uint64_t                     seed,
+		const std::vector<std::uint32_t>* replayVictims,
+		std::vector<std::uint32_t>*       recordedVictims)
 	{
+		// xorshift state must never be zero
+		_randomState = seed != 0 ? seed : 0x9E3779B97F4A7C15ull;
+		_replayVictims = replayVictims;
+		_replayCursor = 0;
+		_recordedVictims = recordedVictims;
+	}
+
+	std::size_t Worker::nextVictim()
+	{
+		const std::size_t workers = _engine->workers().size();
+		std::size_t victim;
+
+		if (_replayVictims != nullptr && _replayCursor < _replayVictims->size())
+		{
+			victim = (*_replayVictims)[_replayCursor++] % workers;
+		}
+		else
+		{
+			// xorshift64*, cheap and private to the worker so the sequence of
+			// victims only depends on the seed
+			_randomState ^= _randomState >> 12;
+			_randomState ^= _randomState << 25;
+			_randomState ^= _randomState >> 27;
+			victim = static_cast<std::size_t>((_randomState * 0x2545F4914F6CDD1Dull) >> 32) % workers;
+		}
+
+		if (_recordedVictims != nullptr)
+		{
+			_recordedVictims->push_back(static_cast<std::uint32_t>(victim));
+		}
+
+		return victim;
 	}
 
 	void Worker::run()
 	{
-		if (running())
+		if (_state != State::Idle)
 		{
 			return;
 		}
 
-		auto mainLoop = [this] {
-			_state = State::Running;
+		// Set before starting the thread, a stop() issued right after
+		// run() must not be overwritten by the thread starting up
+		_state = State::Running;
 
+		auto mainLoop = [this] {
+			Scratch::makeCurrent(&_scratch);
 
-			while (running())
+			for (State state = _state.load(); state != State::Stopping; state = _state.load())
 			{
-				Task* task = getTask();
-
-				if (task != nullptr)
+				if (state == State::Running)
 				{
-					if (task->run())
+					if (_parked)
+					{
+						park();
+					}
+					else if (!runNextTask() && _engine->shouldPark(*this))
 					{
-						++_totalTasksRun;
-						_cyclesWithoutTasks = 0;
+						park();
 					}
 				}
 				else
 				{
-					++_cyclesWithoutTasks;
-					_maxCyclesWithoutTasks =
-						std::max(_cyclesWithoutTasks, _maxCyclesWithoutTasks);
+					// Read the wakeups before publishing we are paused, so a
+					// resume() right after is seen by the futex wait
+					const std::int32_t wakeups = _wakeups.load();
+
+					if (state == State::Pausing)
+					{
+						_state.compare_exchange_strong(state, State::Paused);
+					}
+
+					if (_state.load() == State::Paused)
+					{
+						futex::wait(_wakeups, wakeups);
+					}
 				}
 			}
 		};
@@ -60,23 +149,169 @@ namespace TaskSystem {
 		}
 		else
 		{
-			_state = State::Running;
 			_workerThreadId = std::this_thread::get_id();
 
-
+			// Simulated workers get the thread arena when the engine steps them
+			if (_mode == Mode::Foreground)
+			{
+				_previousScratch = Scratch::makeCurrent(&_scratch);
+			}
 		}
 	}
 
 	void Worker::stop()
 	{
-		State expected = State::Running;
-		while (!_state.compare_exchange_weak(expected, State::Stopping))
-			;
+		State state = _state.load();
 
+		do
+		{
+			// Never started, or being stopped by someone else
+			if (state == State::Idle || state == State::Stopping)
+			{
+				return;
+			}
+		} while (!_state.compare_exchange_weak(state, State::Stopping));
 
+		wake();
 		join();
 		_state = State::Idle;
 
+		if (std::this_thread::get_id() == threadId() && &Scratch::current() == &_scratch)
+		{
+			Scratch::makeCurrent(_previousScratch);
+		}
+	}
+
+	bool Worker::pause()
+	{
+		State expected = State::Running;
+
+		if (_mode == Mode::Background && _state.compare_exchange_strong(expected, State::Pausing))
+		{
+			// Parked workers sleep on the same word
+			wake();
+			return true;
+		}
+		else
+		{
+			return false;
+		}
+	}
+
+	void Worker::resume()
+	{
+		State state = _state.load();
+
+		while ((state == State::Pausing || state == State::Paused) &&
+			!_state.compare_exchange_weak(state, State::Running))
+			;
+
+		wake();
+	}
+
+	bool Worker::paused() const
+	{
+		return _state == State::Paused;
+	}
+
+	void Worker::park()
+	{
+		using clock = TimerWheel::Clock;
+
+		// Parked workers still wake up from time to time, and when their own timers
+		// are due, to poll events. What they poll is submitted to their own queue
+		while (_parked.load() && _state.load() == State::Running)
+		{
+			const std::int32_t wakeups = _wakeups.load();
+
+			// Mail posted right before parking did not see the worker parked,
+			// check for it after publishing the flag (See `post()`)
+			if (!_workQueue.empty() || _pendingMail.load() != 0 || _engine->_injectedTasks.load() != 0)
+			{
+				_engine->unpark(*this);
+				break;
+			}
+
+			const clock::time_point now = clock::now();
+			const clock::time_point expiry = nextTimerExpiry();
+
+			if (expiry > now && _parked.load())
+			{
+				const clock::duration timeout = std::min<clock::duration>(MAX_PARK_PERIOD, expiry - now);
+
+				// One parked worker sleeps in the reactor, so readiness wakes it up, the
+				// others on their futex. Both are woken up by wake()
+				const bool polled = _engine->reactor().wait(timeout,
+					[this](Task* continuation) { submitContinuation(continuation); },
+					[this, wakeups] { return _wakeups.load() == wakeups && _parked.load(); });
+
+				if (!polled)
+				{
+					futex::waitFor(_wakeups, wakeups, timeout);
+				}
+			}
+
+			pollEvents();
+		}
+
+		// Start counting idle cycles again, otherwise a worker woken up for
+		// work that was stolen by somebody else would park again right away
+		_cyclesWithoutTasks = 0;
+		_idleSteals = 0;
+		_idleStealFailures = 0;
+	}
+
+	bool Worker::parked() const
+	{
+		return _parked.load(std::memory_order_relaxed);
+	}
+
+	void Worker::wake()
+	{
+		_wakeups.fetch_add(1);
+		futex::wakeAll(_wakeups);
+
+		// The worker may be the one blocked in the reactor (See park())
+		_engine->reactor().interrupt();
+	}
+
+	std::size_t Worker::discardQueuedTasks()
+	{
+		std::size_t discarded = 0;
+
+		// Only called once the worker is stopped, but other stopped workers
+		// may be discarding too, so go through steal() like a thief
+		while (!_workQueue.empty())
+		{
+			Task* task = _workQueue.steal();
+
+			if (task != nullptr)
+			{
+				task->discard();
+				discarded++;
+			}
+		}
+
+		std::vector<Task*> mail;
+
+		{
+			std::lock_guard<std::mutex> lock{ _mailboxMutex };
+			mail.swap(_mailbox);
+		}
+
+		mail.insert(mail.end(), _inbox.begin() + _inboxCursor, _inbox.end());
+		_inbox.clear();
+		_inboxCursor = 0;
+		_pendingMail -= mail.size();
+
+		for (Task* task : mail)
+		{
+			task->discard();
+			discarded++;
+		}
+
+		_totalTasksDiscarded += discarded;
+		return discarded;
 	}
 
 	Worker::~Worker()
@@ -99,36 +334,476 @@ namespace TaskSystem {
 
 	void Worker::submit(Task* task)
 	{
-		if (task != nullptr && !_workQueue.push(task))
+		enqueue(task, _engine->overflowPolicy());
+	}
+
+	void Worker::submitContinuation(Task* task)
+	{
+		// Continuations are submitted from the worker loop, an OverflowError
+		// would end the worker thread. They spill instead, nothing is lost
+		const OverflowPolicy policy = _engine->overflowPolicy();
+		enqueue(task, policy == OverflowPolicy::Fail ? OverflowPolicy::Spill : policy);
+	}
+
+	void Worker::enqueue(Task* task, OverflowPolicy policy)
+	{
+		if (task != nullptr && task->affinity().pinned())
+		{
+			const Affinity affinity = task->affinity();
+
+			if (affinity.kind() == Affinity::Kind::Local)
+			{
+				// Thieves send it back here
+				task->setAffinity(Affinity::worker(static_cast<std::uint32_t>(_id)));
+			}
+			else if (!runsHere(affinity))
+			{
+				Worker* worker = route(affinity);
+
+				if (worker != nullptr)
+				{
+					worker->post(task);
+					return;
+				}
+			}
+		}
+
+		if (task == nullptr)
+		{
+			++_overflows.discarded;
+		}
+		else if (!_workQueue.push(task))
 		{
+			overflow(task, policy);
+		}
+		else if (_engine->_parkedWorkers.load(std::memory_order_relaxed) != 0 &&
+			_workQueue.size() > _engine->_scaling.activateQueueDepth.load(std::memory_order_relaxed))
+		{
+			_engine->activateWorker();
+		}
+	}
+
+	void Worker::submit(TaskFunction taskFunction, Task* parent)
+	{
+		// A full pool spills unless discarding (See `Pool::setOverflowPolicy()`)
+		submit(_pool.createTaskAsChild(taskFunction, parent));
+	}
+
+	void Worker::overflow(Task* task, OverflowPolicy policy)
+	{
+		++_overflows.queueFull;
+
+		switch (policy)
+		{
+		case OverflowPolicy::RunInline:
+			++_overflows.ranInline;
+			++_totalTasksRun;
+
+			task->runInline();
+			break;
+		case OverflowPolicy::HelpUntilSpace:
+			// Running tasks pops them from the queue, tasks they submit may
+			// take the room again, so the push is retried after each one
+			++_overflows.helped;
+			helpUntil([this, task] { return _workQueue.push(task); });
+			break;
+		case OverflowPolicy::Spill:
+			// The mailbox is unbounded, tasks left there run here (See takeMail())
+			++_overflows.spilled;
+			post(task);
+			break;
+		case OverflowPolicy::Fail:
+			++_overflows.failed;
 			task->discard();
 			++_totalTasksDiscarded;
+			throw OverflowError{ "Worker queue full" };
+		default:
+			++_overflows.discarded;
+			task->discard();
+			++_totalTasksDiscarded;
+			break;
+		}
+	}
+
+	bool Worker::submit(Task* task, SpawnPolicy policy)
+	{
+		if (task == nullptr)
+		{
+			++_overflows.discarded;
+			return false;
+		}
+
+		if (policy == SpawnPolicy::HelpFirst || !runsHere(task->affinity()) ||
+			(policy == SpawnPolicy::Auto && _workQueue.size() < AUTO_INLINE_QUEUE_DEPTH))
+		{
+			submit(task);
+			return false;
+		}
+
+		++_totalTasksRun;
+		return task->runInline();
+	}
+
+	void Worker::post(Task* task)
+	{
+		if (task == nullptr)
+		{
+			return;
+		}
+
+		{
+			std::lock_guard<std::mutex> lock{ _mailboxMutex };
+			_mailbox.push_back(task);
+			_pendingMail.fetch_add(1);
+		}
+
+		if (_parked.load())
+		{
+			_engine->unpark(*this);
 		}
 	}
 
+	Task* Worker::takeMail()
+	{
+		if (_inboxCursor == _inbox.size())
+		{
+			_inbox.clear();
+			_inboxCursor = 0;
+
+			{
+				std::lock_guard<std::mutex> lock{ _mailboxMutex };
+				_inbox.swap(_mailbox);
+			}
+
+			// Only pinned tasks stay in the inbox, the rest can be stolen. Unless the
+			// queue is full: then they are discarded, or kept in the inbox and run
+			// here under any other overflow policy
+			const bool discardOverflow = _engine->overflowPolicy() == OverflowPolicy::Discard;
+			std::size_t kept = 0;
+
+			for (Task* task : _inbox)
+			{
+				if (task->affinity().pinned())
+				{
+					_inbox[kept++] = task;
+				}
+				else if (_workQueue.push(task))
+				{
+					_pendingMail.fetch_sub(1, std::memory_order_relaxed);
+				}
+				else if (discardOverflow)
+				{
+					_pendingMail.fetch_sub(1, std::memory_order_relaxed);
+					++_overflows.discarded;
+					task->discard();
+					++_totalTasksDiscarded;
+				}
+				else
+				{
+					_inbox[kept++] = task;
+				}
+			}
+
+			_inbox.resize(kept);
+		}
+
+		if (_inboxCursor < _inbox.size())
+		{
+			_pendingMail.fetch_sub(1, std::memory_order_relaxed);
+			return _inbox[_inboxCursor++];
+		}
+
+		return nullptr;
+	}
+
+	bool Worker::runsHere(Affinity affinity) const
+	{
+		switch (affinity.kind())
+		{
+		case Affinity::Kind::Worker:
+			return affinity.index() == _id;
+		case Affinity::Kind::Node:
+			return affinity.index() == _node;
+		default:
+			return true;
+		}
+	}
+
+	Worker* Worker::route(Affinity affinity)
+	{
+		if (affinity.kind() == Affinity::Kind::Worker)
+		{
+			return _engine->worker(affinity.index());
+		}
+
+		// Next worker of the node, starting after this one so
+		// submitters spread their tasks across the node
+		const std::size_t workers = _engine->workers().size();
+
+		for (std::size_t i = 1; i < workers; ++i)
+		{
+			Worker* worker = _engine->worker((_id + i) % workers);
+
+			if (worker->_node == affinity.index())
+			{
+				return worker;
+			}
+		}
+
+		return nullptr;
+	}
+
+	std::uint32_t Worker::node() const
+	{
+		return _node;
+	}
+
+	void Worker::setNode(std::uint32_t node)
+	{
+		_node = node;
+	}
+
 	void Worker::wait(Task* waitTask)
 	{
-		while (!waitTask->finished())
+		helpUntil([waitTask] { return waitTask->finished(); });
+		rethrowIfFailed(waitTask);
+	}
+
+	bool Worker::waitUntil(Task* waitTask, std::chrono::steady_clock::time_point deadline)
+	{
+		if (!helpUntil([waitTask] { return waitTask->finished(); }, deadline))
 		{
-			Task* task = getTask();
+			return false;
+		}
 
-			if (task != nullptr)
+		rethrowIfFailed(waitTask);
+		return true;
+	}
+
+	void Worker::waitAll(Task* const* tasks, std::size_t count)
+	{
+		// Tasks are checked in order, we never go back to an already
+		// finished task since finished tasks cannot become unfinished
+		std::size_t next = 0;
+
+		helpUntil([tasks, count, &next]
 			{
-				task->run();
-				++_totalTasksRun;
-				_cyclesWithoutTasks = 0;
+				while (next < count && tasks[next]->finished())
+				{
+					++next;
+				}
+
+				return next == count;
+			});
+
+		// The first exception is thrown, the others are dropped with their entries
+		std::exception_ptr first;
+
+		for (std::size_t i = 0; i < count; ++i)
+		{
+			std::exception_ptr exception = tasks[i]->takeException();
+
+			if (first == nullptr)
+			{
+				first = std::move(exception);
 			}
-			else
+		}
+
+		if (first != nullptr)
+		{
+			std::rethrow_exception(first);
+		}
+	}
+
+	void Worker::waitAll(const std::vector<Task*>& tasks)
+	{
+		waitAll(tasks.data(), tasks.size());
+	}
+
+	std::size_t Worker::waitAny(Task* const* tasks, std::size_t count)
+	{
+		std::size_t finishedTask = count;
+
+		helpUntil([tasks, count, &finishedTask]
+			{
+				for (std::size_t i = 0; i < count; ++i)
+				{
+					if (tasks[i]->finished())
+					{
+						finishedTask = i;
+						return true;
+					}
+				}
+
+				return count == 0;
+			});
+
+		if (finishedTask < count)
+		{
+			rethrowIfFailed(tasks[finishedTask]);
+		}
+
+		return finishedTask;
+	}
+
+	std::size_t Worker::waitAny(const std::vector<Task*>& tasks)
+	{
+		return waitAny(tasks.data(), tasks.size());
+	}
+
+	TimerWheel::TimerId Worker::submitAfter(TimerWheel::Clock::duration delay, Task* task)
+	{
+		if (task == nullptr)
+		{
+			return TimerWheel::INVALID_TIMER;
+		}
+
+		return _timers.schedule(task, TimerWheel::Clock::now() + delay);
+	}
+
+	TimerWheel::TimerId Worker::submitEvery(TimerWheel::Clock::duration period, Task* task)
+	{
+		if (task == nullptr)
+		{
+			return TimerWheel::INVALID_TIMER;
+		}
+
+		return _timers.schedule(task, TimerWheel::Clock::now() + period, period);
+	}
+
+	bool Worker::cancelTimer(TimerWheel::TimerId id)
+	{
+		bool fired = false;
+		Task* task = _timers.cancel(id, &fired);
+
+		if (task == nullptr)
+		{
+			return false;
+		}
+
+		// Tasks of timers that fired were submitted, they finish when they run
+		// (a periodic task may even be cancelling itself). The others were never
+		// submitted and someone may be waiting for them
+		if (!fired)
+		{
+			task->discard();
+		}
+
+		return true;
+	}
+
+	TimerWheel::Clock::time_point Worker::nextTimerExpiry() const
+	{
+		return _timers.nextExpiry();
+	}
+
+	IoRing& Worker::io()
+	{
+		if (_io == nullptr)
+		{
+			_io = std::make_unique<IoRing>();
+		}
+
+		return *_io;
+	}
+
+	void Worker::pollEvents()
+	{
+		// Readiness costs a syscall, idle workers only check it every few cycles
+		if ((_cyclesWithoutTasks % EVENTS_CHECK_PERIOD) == 0)
+		{
+			_engine->reactor().poll([this](Task* continuation)
+				{
+					submitContinuation(continuation);
+				});
+		}
+
+		_engine->blockingPool().poll([this](Task* continuation)
+			{
+				submitContinuation(continuation);
+			});
+
+		if (_io != nullptr)
+		{
+			_io->poll([this](Task* continuation)
+				{
+					submitContinuation(continuation);
+				});
+		}
+
+		if (_timers.empty())
+		{
+			return;
+		}
+
+		_timers.advance(TimerWheel::Clock::now(),
+			[this](Task* task, TaskFunction function, bool rearm)
 			{
-				++_cyclesWithoutTasks;
-				_maxCyclesWithoutTasks =
-					std::max(_cyclesWithoutTasks, _maxCyclesWithoutTasks);
+				if (!rearm)
+				{
+					submitContinuation(task);
+				}
+				else if (task->finished())
+				{
+					task->rearm(function);
+					submitContinuation(task);
+				}
+			});
+	}
+
+	void Worker::step()
+	{
+		if (_mode == Mode::Simulated)
+		{
+			// Waiting in simulation mode drives the whole engine, not only this worker
+			_engine->simulateStep();
+		}
+		else
+		{
+			runNextTask();
+		}
+	}
+
+	bool Worker::runNextTask()
+	{
+		Task* task = getTask();
+
+		if (task != nullptr && task->run())
+		{
+			++_totalTasksRun;
+			_cyclesWithoutTasks = 0;
+			_idleSteals = 0;
+			_idleStealFailures = 0;
+
+			// Busy workers still check their timers and I/O from time to time
+			if ((_totalTasksRun % EVENTS_CHECK_PERIOD) == 0)
+			{
+				pollEvents();
 			}
+
+			return true;
+		}
+		else
+		{
+			pollEvents();
+
+			++_cyclesWithoutTasks;
+			_maxCyclesWithoutTasks =
+				std::max(_cyclesWithoutTasks, _maxCyclesWithoutTasks);
+			return false;
 		}
 	}
 
 	Pool& Worker::pool()
 	{
+		const std::size_t frame = _engine->frame();
+
+		// Retried on every access until the next generation is reusable
+		if (frame != _frame && _pool.beginGeneration())
+		{
+			_frame = frame;
+		}
+
 		return _pool;
 	}
 
@@ -139,7 +814,26 @@ namespace TaskSystem {
 
 	Task* Worker::getTask()
 	{
-		Task* task = _workQueue.pop();
+		Task* task = _pendingMail.load(std::memory_order_relaxed) != 0 ? takeMail() : nullptr;
+
+		if (task == nullptr)
+		{
+			task = _workQueue.pop();
+		}
+
+		// Tasks submitted from outside the workers, before stealing from
+		// the others. Pinned ones are routed like continuations, the
+		// thread that submitted them is not here to catch an overflow
+		if (task == nullptr && _engine->_injectedTasks.load(std::memory_order_relaxed) != 0)
+		{
+			task = _engine->takeInjected();
+
+			if (task != nullptr && task->affinity().pinned() && !runsHere(task->affinity()))
+			{
+				submitContinuation(task);
+				task = nullptr;
+			}
+		}
 
 		if (task != nullptr)
 		{
@@ -149,7 +843,13 @@ namespace TaskSystem {
 		{
 			// Steal task from another worker
 
-			Worker* worker = _engine->randomWorker();
+			Worker* worker = _engine->worker(nextVictim());
+
+			// Paused workers still have their queues drained by thieves
+			if (worker != nullptr && (worker->_state == State::Idle || worker->_state == State::Stopping))
+			{
+				worker = nullptr;
+			}
 
 			if (worker == this)
 			{
@@ -160,7 +860,32 @@ namespace TaskSystem {
 			{
 				if (worker != nullptr)
 				{
-					return worker->_workQueue.steal();
+					task = worker->_workQueue.steal();
+					++_idleSteals;
+
+					if (task == nullptr)
+					{
+						// A steal may also fail losing a race for a queue still holding tasks
+						if (worker->_workQueue.empty())
+						{
+							++_totalStealFailures;
+							++_idleStealFailures;
+						}
+					}
+					else if (!runsHere(task->affinity()))
+					{
+						// Pinned somewhere else, hand it over instead of running it
+						Worker* owner = task->affinity().kind() == Affinity::Kind::Worker ?
+							route(task->affinity()) : worker;
+
+						if (owner != nullptr && owner != this)
+						{
+							owner->post(task);
+							return nullptr;
+						}
+					}
+
+					return task;
 				}
 				else
 				{
@@ -205,4 +930,16 @@ namespace TaskSystem {
 	{
 		return _totalTasksDiscarded;
 	}
+
+	OverflowCounters Worker::overflowCounters() const
+	{
+		OverflowCounters counters = _overflows;
+		counters += _pool.overflowCounters();
+		return counters;
+	}
+
+	std::size_t Worker::totalStealFailures() const
+	{
+		return _totalStealFailures;
+	}
 }
\ No newline at end of file
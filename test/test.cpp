@@ -1,8 +1,41 @@
 #include "../include/Engine.hpp"
 #include "../include/Worker.hpp"
+#include "../include/Pipeline.hpp"
+#include "../include/FlowGraph.hpp"
+#include "../include/PerWorker.hpp"
+#include "../include/ConcurrentHashMap.hpp"
+#include "../include/BoundedQueue.hpp"
+#include "../include/HashJoin.hpp"
+#include "../include/Parallel.hpp"
+#include "../include/Simd.hpp"
+#include "../include/TaskGroup.hpp"
+#include <algorithm>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/socket.h>
+#include <unistd.h>
+#endif
 
 #define TEST_COUNT 100
 #define ITERATIONS 100
+#define TEST_WORKERS 4
+#define TREE_DEPTH 15
+#define TREE_ROUNDS 20
+#define SIMULATION_DEPTH 8
+#define INLINE_RUNS 1000000
 
 using namespace TaskSystem;
 
@@ -13,7 +46,1546 @@ void test(Task &task) {
 	}
 }
 
-int main() {
+// Spawn/complete stress: each node spawns two children until TREE_DEPTH,
+// so every round exercises the counter increment/decrement protocol with
+// children finishing concurrently in other workers
+std::atomic<long> leaves{ 0 };
+Engine* treeEngine = nullptr;
+int treeDepth = TREE_DEPTH;
+SpawnPolicy treePolicy = SpawnPolicy::HelpFirst;
+
+struct TreeNode {
+	int depth;
+};
+
+void treeTask(Task& task) {
+	const TreeNode node = task.getData<TreeNode>();
+
+	if (node.depth == treeDepth) {
+		leaves.fetch_add(1, std::memory_order_relaxed);
+		return;
+	}
+
+	Worker* worker = treeEngine->threadWorker();
+
+	for (int i = 0; i < 2; i++) {
+		Task* child = worker->pool().createTaskAsChild(treeTask, TreeNode{ node.depth + 1 }, &task);
+
+		if (worker->submit(child, treePolicy)) {
+			worker->pool().release(child);
+		}
+	}
+}
+
+// Pinned tasks record the worker that ran them
+std::atomic<int> misplacedTasks{ 0 };
+
+void pinnedTask(Task& task) {
+	const std::uint64_t expected = task.getData<std::uint64_t>();
+
+	if (treeEngine->threadWorker()->id() != expected) {
+		misplacedTasks.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+// Parallel scan aggregating into the concurrent containers
+#define SCAN_TASKS 4096
+#define SCAN_KEYS 97
+PerWorker<long>* scanSums = nullptr;
+ConcurrentHashMap<int, long>* scanCounts = nullptr;
+BoundedQueue<long>* scanQueue = nullptr;
+
+void scanTask(Task& task) {
+	const long value = task.getData<long>();
+
+	scanSums->local() += value;
+	scanCounts->update(static_cast<int>(value % SCAN_KEYS), [](long& count) { count++; });
+
+	while (!scanQueue->tryPush(value)) {
+		std::this_thread::yield();
+	}
+}
+
+// Periodic task cancelling its own timer on its third run
+Engine* timerEngine = nullptr;
+TimerWheel::TimerId periodicTimer = TimerWheel::INVALID_TIMER;
+std::atomic<int> periodicRuns{ 0 };
+
+void periodicTask(Task&) {
+	if (++periodicRuns == 3) {
+		timerEngine->threadWorker()->cancelTimer(periodicTimer);
+	}
+}
+
+// Tree whose grandchild throws
+Engine* failureEngine = nullptr;
+
+void failingGrandchild(Task&) {
+	throw std::runtime_error{ "grandchild" };
+}
+
+void failingChild(Task& task) {
+	Worker* worker = failureEngine->threadWorker();
+	worker->submit(worker->pool().createTaskAsChild(failingGrandchild, &task));
+}
+
+void failingRoot(Task& task) {
+	Worker* worker = failureEngine->threadWorker();
+	worker->submit(worker->pool().createTaskAsChild(failingChild, &task));
+}
+
+// Runs a small tree on a simulated engine and returns the schedule it took
+Schedule simulateTree(std::uint64_t seed, const Schedule* replay) {
+	SchedulingOptions options;
+	options.seed = seed;
+	options.simulation = true;
+	options.record = true;
+	options.replay = replay;
+
+	Engine engine{ TEST_WORKERS, 1024, TaskSize::Default, 1, options };
+	treeEngine = &engine;
+	treeDepth = SIMULATION_DEPTH;
+	leaves = 0;
+
+	Worker* worker = engine.threadWorker();
+	Task* root = worker->pool().createTask(treeTask, TreeNode{ 0 });
+	worker->submit(root);
+	engine.wait(root);
+
+	treeEngine = &Engine::Instance();
+	treeDepth = TREE_DEPTH;
+	return engine.recordedSchedule();
+}
+
+// Counter handoff litmus: children write plain data and finish, the finished
+// callback of their parent and the waiters of the root read it
+#define HANDOFF_CHILDREN 8
+#define HANDOFF_ROUNDS 2000
+Engine* handoffEngine = nullptr;
+int handoffSlots[HANDOFF_CHILDREN];
+int handoffRound = 0;
+std::atomic<int> handoffErrors{ 0 };
+
+void checkHandoff() {
+	int sum = 0;
+
+	for (int slot : handoffSlots) {
+		sum += slot;
+	}
+
+	if (sum != HANDOFF_CHILDREN * handoffRound) {
+		handoffErrors.fetch_add(1, std::memory_order_relaxed);
+	}
+}
+
+void handoffChild(Task& task) {
+	handoffSlots[task.getData<int>()] = handoffRound;
+}
+
+void handoffParent(Task& task) {
+	Worker* worker = handoffEngine->threadWorker();
+
+	for (int i = 0; i < HANDOFF_CHILDREN; i++) {
+		worker->submit(worker->pool().createTaskAsChild(handoffChild, i, &task));
+	}
+
+	task.whenFinished([](Task&) { checkHandoff(); });
+}
+
+// Finished callbacks run once the counter dropped, so the waiters wait
+// for a root that only finishes after the callback of the parent
+void handoffRoot(Task& task) {
+	Worker* worker = handoffEngine->threadWorker();
+	worker->submit(worker->pool().createTaskAsChild(handoffParent, &task));
+}
+
+// Chain of tasks, each the child of the previous one, counting the finished callbacks
+#define CHAIN_DEPTH 100000
+std::atomic<int> chainCompleted{ 0 };
+
+void chainTask(Task& task) {
+	task.whenFinished([](Task&) { chainCompleted.fetch_add(1, std::memory_order_relaxed); });
+}
+
+// Fills two neighbour tasks of the size class with as much data as fits and checks
+// it is laid out at the stride of the class, cache line aligned from 64 bytes on
+template<TaskSize Size>
+bool sizeClassValid() {
+	constexpr std::size_t bytes = static_cast<std::size_t>(Size);
+	using Data = std::array<unsigned char, Task::maxDataSize(Size)>;
+	Pool pool{ 2, Size };
+	Data first, second;
+	first.fill(0xa5);
+	second.fill(0x5a);
+
+	Task* firstTask = pool.createTask(test, first);
+	Task* secondTask = pool.createTask(test, second);
+	const auto stride = reinterpret_cast<std::uintptr_t>(secondTask) - reinterpret_cast<std::uintptr_t>(firstTask);
+
+	return pool.maxDataSize() == sizeof(Data) && stride == bytes &&
+		(bytes < 64 || reinterpret_cast<std::uintptr_t>(firstTask) % 64 == 0) &&
+		firstTask->getData<Data>() == first && secondTask->getData<Data>() == second;
+}
+
+// Bounded waits give up on time, other waits return once their tasks are finished
+int testWaits() {
+	using std::chrono::milliseconds;
+
+	Engine engine{ TEST_WORKERS, 1024 };
+	Worker* worker = engine.threadWorker();
+
+	// Held unfinished by a child submitted last
+	Task* held = worker->pool().createTask([](Task&) {});
+	Task* heldChild = worker->pool().createTaskAsChild([](Task&) {}, held);
+	worker->submit(held);
+
+	const auto start = std::chrono::steady_clock::now();
+	bool valid = !worker->waitFor(held, milliseconds(5)) &&
+		!worker->waitUntil(held, std::chrono::steady_clock::now() + milliseconds(5)) &&
+		!held->blockUntilFinishedFor(milliseconds(5)) &&
+		std::chrono::steady_clock::now() - start >= milliseconds(15);
+
+	std::vector<Task*> all;
+
+	for (int i = 0; i < 16; i++) {
+		all.push_back(worker->pool().createTask([](Task&) {}));
+		worker->submit(all.back());
+	}
+
+	worker->waitAll(all);
+	valid = valid && std::all_of(all.begin(), all.end(), [](Task* task) { return task->finished(); });
+
+	Task* quick = worker->pool().createTask([](Task&) {});
+	worker->submit(quick);
+	valid = valid && worker->waitAny({ held, quick }) == 1 && !held->finished();
+
+	// A thread outside the engine parks on the task until it is finished
+	std::atomic<bool> woken{ false };
+	std::thread blocked{ [&] {
+		held->blockUntilFinished();
+		woken = true;
+	} };
+
+	std::this_thread::sleep_for(milliseconds(10));
+	valid = valid && !woken;
+	worker->submit(heldChild);
+	worker->wait(held);
+	blocked.join();
+	valid = valid && woken && worker->waitFor(held, milliseconds(0));
+
+	if (!valid) {
+		std::cerr << "Waits returned before their tasks finished or past their timeout" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Timers fire in deadline order, never early, cascading down from the upper levels
+int testTimers() {
+	using Clock = TimerWheel::Clock;
+
+	const Clock::time_point start = Clock::now();
+	const auto at = [start](std::uint64_t ticks) { return start + TimerWheel::TICK * static_cast<Clock::rep>(ticks); };
+	TimerWheel wheel{ start };
+	// One timer per level, one past the wheel range, one periodic and one cancelled
+	const std::uint64_t deadlines[] = { 300000, 3, 20000000, 100, 5000 };
+	Task tasks[7];
+	std::vector<Task*> fired;
+	std::vector<bool> rearmed;
+
+	for (Task& task : tasks) {
+		new(&task) Task{ test };
+	}
+
+	for (int i = 0; i < 5; i++) {
+		wheel.schedule(&tasks[i], at(deadlines[i]));
+	}
+
+	const TimerWheel::TimerId periodic = wheel.schedule(&tasks[5], at(7), TimerWheel::TICK * 7);
+	const TimerWheel::TimerId cancelled = wheel.schedule(&tasks[6], at(5000));
+	const auto record = [&](Task* task, TaskFunction, bool rearm) {
+		fired.push_back(task);
+		rearmed.push_back(rearm);
+	};
+
+	wheel.advance(at(50), record);
+	bool periodicFired = false, cancelledFired = true;
+	bool valid = fired.size() == 8 && fired[0] == &tasks[1] && fired[1] == &tasks[5] &&
+		std::count(fired.begin(), fired.end(), &tasks[5]) == 7 && !rearmed[1] && rearmed.back() &&
+		wheel.cancel(periodic, &periodicFired) == &tasks[5] && periodicFired &&
+		wheel.cancel(cancelled, &cancelledFired) == &tasks[6] && !cancelledFired &&
+		wheel.cancel(cancelled) == nullptr;
+
+	fired.clear();
+	wheel.advance(at(99), record);
+	valid = valid && fired.empty();
+	wheel.advance(at(20000000), record);
+
+	valid = valid && wheel.empty() && fired == std::vector<Task*>{ &tasks[3], &tasks[4], &tasks[0], &tasks[2] };
+
+	// Delayed tasks submitted to a worker wait at least their delay
+	Engine engine{ 1, 64 };
+	Worker* worker = engine.threadWorker();
+	Task* delayed = worker->pool().createTask(test);
+	const Clock::time_point submitted = Clock::now();
+	worker->submitAfter(std::chrono::milliseconds(5), delayed);
+	worker->wait(delayed);
+	valid = valid && Clock::now() - submitted >= std::chrono::milliseconds(5);
+
+	if (!valid) {
+		std::cerr << "Timers fired out of order, early or after being cancelled" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// A periodic task cancelling its own timer still finishes once per run
+int testPeriodicCancel() {
+	Engine engine{ 1, 64 };
+	timerEngine = &engine;
+
+	Worker* worker = engine.threadWorker();
+	Task* task = worker->pool().createTask(periodicTask);
+	periodicTimer = worker->submitEvery(std::chrono::milliseconds(1), task);
+	worker->helpUntil([] { return periodicRuns == 3; });
+	worker->wait(task);
+
+	// No period left to fire
+	worker->helpUntil([] { return false; }, std::chrono::steady_clock::now() + std::chrono::milliseconds(5));
+
+	if (periodicRuns != 3 || !task->finished() || task->unfinishedChildrenTasks() != 0 ||
+		worker->cancelTimer(periodicTimer)) {
+		std::cerr << "Periodic task cancelled from its own run finished twice" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// File I/O round-trips through io_uring, when available, and through the synchronous fallback
+int testFileIo() {
+	bool valid = true;
+
+	for (bool asynchronous : { true, false }) {
+		IoRing ring{ 16, asynchronous };
+		std::FILE* file = std::tmpfile();
+		const int fd = fileno(file);
+		const char written[] = "task system";
+		char read[sizeof(written)] = {};
+		std::int32_t results[3] = { -1, -1, -1 };
+		Task continuations[3];
+		std::vector<Task*> completed;
+
+		for (Task& continuation : continuations) {
+			new(&continuation) Task{ test };
+		}
+
+		// Operations are not ordered, each one waits for the previous to complete
+		const auto complete = [&ring, &completed] {
+			while (ring.inFlight() != 0) {
+				ring.poll([&completed](Task* continuation) { completed.push_back(continuation); });
+			}
+		};
+
+		valid = valid && (asynchronous || !ring.asynchronous()) &&
+			ring.write(fd, written, sizeof(written), 0, &continuations[0], &results[0]);
+		complete();
+		valid = valid && ring.fsync(fd, &continuations[1], &results[1]);
+		complete();
+		valid = valid && ring.read(fd, read, sizeof(read), 0, &continuations[2], &results[2]);
+		complete();
+		std::fclose(file);
+
+		valid = valid && results[0] == sizeof(written) && results[1] == 0 && results[2] == sizeof(read) &&
+			std::string{ read } == written &&
+			completed == std::vector<Task*>{ &continuations[0], &continuations[1], &continuations[2] };
+	}
+
+	if (!valid) {
+		std::cerr << "File I/O results or continuations lost" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Socket readiness is delivered as a continuation, also by a worker parked in the reactor
+int testSockets() {
+#if defined(__linux__)
+	Engine engine{ TEST_WORKERS, 1024 };
+	Worker* worker = engine.threadWorker();
+	int sockets[2];
+	bool valid = socketpair(AF_UNIX, SOCK_STREAM, 0, sockets) == 0;
+
+	for (bool parked : { false, true }) {
+		if (parked) {
+			ScalingOptions scaling;
+			scaling.parkIdleCycles = 64;
+			engine.setScaling(scaling);
+
+			const auto parkDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+			while (engine.activeWorkers() > 1 && std::chrono::steady_clock::now() < parkDeadline) {
+				std::this_thread::sleep_for(std::chrono::milliseconds(1));
+			}
+		}
+
+		std::uint32_t ready = 0;
+		char byte = 'x';
+		Task* continuation = worker->pool().createTask(test);
+		valid = valid && engine.reactor().watch(sockets[0], Reactor::Readable, continuation, &ready) &&
+			write(sockets[1], &byte, 1) == 1;
+
+		// The foreground worker does not run while blocked, only parked workers are left
+		if (parked) {
+			continuation->blockUntilFinished();
+		}
+		else {
+			worker->wait(continuation);
+		}
+
+		byte = 0;
+		valid = valid && (ready & Reactor::Readable) != 0 && read(sockets[0], &byte, 1) == 1 && byte == 'x' &&
+			engine.reactor().watching() == 0;
+	}
+
+	close(sockets[0]);
+	close(sockets[1]);
+
+	if (!valid) {
+		std::cerr << "Socket readiness not delivered" << std::endl;
+		return EXIT_FAILURE;
+	}
+#endif
+
+	return EXIT_SUCCESS;
+}
+
+// Blocking tasks run side by side in threads of their own, spawned and retired on demand
+int testBlockingPool() {
+	using std::chrono::milliseconds;
+
+	Engine engine{ TEST_WORKERS, 1024 };
+	Worker* worker = engine.threadWorker();
+	std::vector<Task*> continuations;
+	const auto start = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < 8; i++) {
+		Task* sleeper = worker->pool().createTask([](Task&) { std::this_thread::sleep_for(milliseconds(20)); });
+		continuations.push_back(worker->pool().createTask(test));
+		engine.submitBlocking(sleeper, continuations.back());
+	}
+
+	worker->waitAll(continuations);
+	bool valid = std::chrono::steady_clock::now() - start < milliseconds(8 * 20) &&
+		engine.blockingPool().threads() > 1;
+
+	// Idle threads retire after the keep alive time, and are joined by the next submission
+	BlockingPool pool{ 4, milliseconds(1) };
+	Task first{ test }, second{ test };
+	pool.submit(&first);
+	first.blockUntilFinished();
+
+	const auto retireDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+	while (pool.threads() != 0 && std::chrono::steady_clock::now() < retireDeadline) {
+		std::this_thread::sleep_for(milliseconds(1));
+	}
+
+	valid = valid && pool.threads() == 0;
+	pool.submit(&second);
+	second.blockUntilFinished();
+
+	// Continuations nobody would collect once the workers are stopped are discarded
+	Task* sleeper = worker->pool().createTask([](Task&) { std::this_thread::sleep_for(milliseconds(20)); });
+	Task* continuation = worker->pool().createTask(test);
+	engine.submitBlocking(sleeper, continuation);
+	engine.shutdown(std::chrono::steady_clock::time_point::min());
+	valid = valid && sleeper->finished() && continuation->finished();
+
+	if (!valid) {
+		std::cerr << "Blocking tasks serialized, threads not retired or continuations left hanging" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Tasks of every size class hold as much data as the class leaves, without touching their neighbours
+int testTaskSizes() {
+	if (!sizeClassValid<TaskSize::Bytes32>() || !sizeClassValid<TaskSize::Bytes64>() ||
+		!sizeClassValid<TaskSize::Bytes128>() || !sizeClassValid<TaskSize::Bytes256>()) {
+		std::cerr << "Task data overlapping a neighbour or misaligned for its size class" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Data written by children before finishing is seen by their parent and by the waiters of their ancestors
+int testCounterHandoff() {
+	Engine engine{ TEST_WORKERS, 1 << 15 };
+	handoffEngine = &engine;
+	Worker* worker = engine.threadWorker();
+
+	// Waiting in the engine, helping until the counter drops
+	for (handoffRound = 1; handoffRound <= HANDOFF_ROUNDS; handoffRound++) {
+		Task* root = worker->pool().createTask(handoffRoot);
+		worker->submit(root);
+		worker->wait(root);
+		checkHandoff();
+	}
+
+	// Waiting outside, parked on the counter. The root is on the stack, its
+	// storage is reused right away by the next round
+	std::thread outsider{ [&] {
+		for (; handoffRound <= 2 * HANDOFF_ROUNDS; handoffRound++) {
+			Task root{ handoffRoot };
+			engine.submit(&root);
+			root.blockUntilFinished();
+			checkHandoff();
+		}
+	} };
+
+	outsider.join();
+
+	if (handoffErrors != 0) {
+		std::cerr << handoffErrors << " reads of children data before it was handed off" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// The last leaf of a deep chain finishes all its ancestors without recursing, finishing a leaf wakes up its waiters
+int testFinishing() {
+	Pool pool{ CHAIN_DEPTH, TaskSize::Bytes32 };
+	std::vector<Task*> chain{ pool.createTask(chainTask) };
+
+	while (chain.size() < CHAIN_DEPTH) {
+		chain.push_back(pool.createTaskAsChild(chainTask, chain.back()));
+	}
+
+	bool valid = true;
+
+	for (Task* task : chain) {
+		valid = valid && !chain.front()->finished();
+		task->run();
+	}
+
+	valid = valid && chain.front()->finished() && chainCompleted == CHAIN_DEPTH;
+
+	// The leaf drops its counter with a plain store, waiters must not miss it
+	for (int round = 0; round < 100; round++) {
+		Task leaf{ test };
+		bool woken = false;
+		std::thread waiter{ [&] { woken = leaf.blockUntilFinishedFor(std::chrono::seconds(10)); } };
+
+		if (round % 2 == 0) {
+			std::this_thread::sleep_for(std::chrono::milliseconds(1));
+		}
+
+		leaf.run();
+		waiter.join();
+		valid = valid && woken;
+	}
+
+	if (!valid) {
+		std::cerr << "Deep chain finished out of order, or a leaf waiter missed its wake up" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Same seed, same schedule; replaying a recording reproduces it
+int testSimulation() {
+	const Schedule first = simulateTree(42, nullptr);
+	const Schedule second = simulateTree(42, nullptr);
+	const Schedule replayed = simulateTree(7, &first);
+
+	if (leaves != (1l << SIMULATION_DEPTH) || first.steps.empty() ||
+		first.steps != second.steps || first.victims != second.victims ||
+		first.steps != replayed.steps || first.victims != replayed.victims) {
+		std::cerr << "Simulated schedules differ" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// A generation is only reused once all its tasks are finished
+int testGenerations() {
+	Pool pool{ 4, TaskSize::Default, 2 };
+	Task* pending = pool.createTask(test);
+
+	if (!pool.beginGeneration() || pool.beginGeneration() || !pending->run() ||
+		!pool.beginGeneration() || pool.currentGeneration() != 0 || pool.tasks() != 0) {
+		std::cerr << "Pool generation reused with unfinished tasks" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Scratch allocations chain bigger blocks and are released on rewind
+int testScratch() {
+	Scratch scratch{ 64 };
+	const Scratch::Marker start = scratch.mark();
+	int* small = scratch.allocate<int>(8);
+	double* big = scratch.allocate<double>(100);
+	big[99] = small[0] = 1;
+	scratch.rewind(start);
+
+	if (scratch.capacity() < 64 + 100 * sizeof(double) || scratch.allocate<int>(8) != small) {
+		std::cerr << "Scratch arena not rewound" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Drain, restart with another worker count, shutdown
+int testLifecycle() {
+	Engine engine{ TEST_WORKERS, 1024 };
+	treeEngine = &engine;
+	treeDepth = SIMULATION_DEPTH;
+
+	for (std::size_t workers : { 2, 3 }) {
+		leaves = 0;
+		Worker* worker = engine.threadWorker();
+		worker->submit(worker->pool().createTask(treeTask, TreeNode{ 0 }));
+		engine.drain();
+
+		if (leaves != (1l << SIMULATION_DEPTH)) {
+			std::cerr << "Drain returned with " << leaves << " leaves run" << std::endl;
+			return EXIT_FAILURE;
+		}
+
+		engine.pause();
+		engine.resume();
+		engine.restart(workers);
+	}
+
+	// Idle background workers whose steals do not fail often enough keep looking for work
+	ScalingOptions scaling;
+	scaling.parkIdleCycles = 64;
+	scaling.parkStealFailureRate = 2;
+	engine.setScaling(scaling);
+	std::this_thread::sleep_for(std::chrono::milliseconds(20));
+	const bool looking = engine.activeWorkers() == 3;
+
+	// The others park, new work wakes them up again
+	scaling.parkStealFailureRate = ScalingOptions{}.parkStealFailureRate;
+	engine.setScaling(scaling);
+
+	const auto parkDeadline = std::chrono::steady_clock::now() + std::chrono::seconds(10);
+
+	while (engine.activeWorkers() > 1 && std::chrono::steady_clock::now() < parkDeadline) {
+		std::this_thread::sleep_for(std::chrono::milliseconds(1));
+	}
+
+	leaves = 0;
+	Worker* worker = engine.threadWorker();
+	Task* root = worker->pool().createTask(treeTask, TreeNode{ 0 });
+	const bool parked = engine.activeWorkers() == 1;
+	worker->submit(root);
+	const bool activated = engine.activeWorkers() > 1;
+	engine.wait(root);
+
+	if (!looking || !parked || !activated || leaves != (1l << SIMULATION_DEPTH)) {
+		std::cerr << "Workers parked too early, not parked or not activated" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	if (!engine.shutdown() || engine.workers().size() != 3) {
+		std::cerr << "Shutdown did not drain" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Engines whose workers never ran must not hang on destruction
+int testIdleEngines() {
+	Engine engine{ TEST_WORKERS, 16 };
+
+	return EXIT_SUCCESS;
+}
+
+// Trees spawned inline give every task back to the pool, only the root is left
+int testInlineSpawns() {
+	Engine engine{ 1, 64 };
+	treeEngine = &engine;
+	treeDepth = SIMULATION_DEPTH;
+	treePolicy = SpawnPolicy::Inline;
+	leaves = 0;
+
+	Worker* worker = engine.threadWorker();
+	Task* root = worker->pool().createTask(treeTask, TreeNode{ 0 });
+	worker->submit(root);
+	engine.wait(root);
+	treePolicy = SpawnPolicy::HelpFirst;
+
+	if (leaves != (1l << SIMULATION_DEPTH) || worker->pool().tasks() != 1) {
+		std::cerr << "Tree spawned inline left " << worker->pool().tasks() << " tasks allocated" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Pinned tasks run on their worker, even if stolen on the way
+int testAffinity() {
+	Engine engine{ TEST_WORKERS, 1024 };
+	treeEngine = &engine;
+
+	Worker* worker = engine.threadWorker();
+	Task* root = worker->pool().createTask([](Task&) {});
+
+	for (int i = 0; i < 256; i++) {
+		const std::uint64_t target = i % 2 == 0 ? 2 : 0;
+		Task* task = worker->pool().createTaskAsChild(pinnedTask, target, root);
+		task->setAffinity(target == 2 ? Affinity::worker(2) : Affinity::local());
+		worker->submit(task);
+	}
+
+	worker->submit(root);
+	engine.wait(root);
+
+	if (misplacedTasks != 0) {
+		std::cerr << misplacedTasks << " pinned tasks ran on the wrong worker" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Serial in order stages see items in input order, whatever the parallel stages do
+int testPipeline() {
+	Engine engine{ TEST_WORKERS, 1024 };
+	const long items = 10000;
+	long input = 0;
+	std::vector<long> buffers(8), output;
+	std::atomic<long> outOfOrder{ 0 };
+
+	Pipeline pipeline{ engine, buffers.size() };
+	pipeline.input([&](Pipeline::Item& item) {
+			buffers[item.token] = input;
+			return input++ < items;
+		})
+		.stage(Pipeline::Mode::Parallel, [&](Pipeline::Item& item) { buffers[item.token] *= 2; })
+		.stage(Pipeline::Mode::SerialOutOfOrder, [&](Pipeline::Item&) { outOfOrder++; })
+		.stage(Pipeline::Mode::SerialInOrder, [&](Pipeline::Item& item) { output.push_back(buffers[item.token]); });
+
+	pipeline.run();
+
+	for (long i = 0; i < items; i++) {
+		if (output.size() != items || output[i] != 2 * i || outOfOrder != items) {
+			std::cerr << "Pipeline output out of order at item " << i << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// A throwing stage stops the input and reaches run(), a throwing body reaches wait()
+int testPipelineExceptions() {
+	Engine engine{ TEST_WORKERS, 1024 };
+	const long items = 1000;
+	long input = 0, output = 0;
+
+	Pipeline pipeline{ engine, 4 };
+	pipeline.input([&](Pipeline::Item&) { return input++ < items; })
+		.stage(Pipeline::Mode::Parallel, [&](Pipeline::Item& item) {
+			if (item.sequence == 100) {
+				throw std::runtime_error{ "stage" };
+			}
+		})
+		.stage(Pipeline::Mode::SerialInOrder, [&](Pipeline::Item&) { output++; });
+
+	bool valid = false;
+
+	try {
+		pipeline.run();
+	}
+	catch (const std::runtime_error& error) {
+		valid = std::string{ error.what() } == "stage";
+	}
+
+	valid = valid && input < items && output >= 100 && output < input;
+
+	FlowGraph graph{ engine };
+	long processed = 0;
+	auto& body = graph.function(1, [&](const FlowGraph::Message& m) {
+		if (std::any_cast<long>(m) % 10 == 0) {
+			throw std::runtime_error{ "body" };
+		}
+
+		processed++;
+		return FlowGraph::Message{};
+	}, 1);
+
+	for (long i = 0; i < 100; i++) {
+		graph.put(body, FlowGraph::Message{ i });
+	}
+
+	try {
+		graph.wait();
+		valid = false;
+	}
+	catch (const std::runtime_error& error) {
+		valid = valid && std::string{ error.what() } == "body";
+	}
+
+	graph.wait();
+
+	if (!valid || processed != 90) {
+		std::cerr << "Pipeline or flow graph exception not rethrown" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Bounded nodes push back on the producer, and nothing is lost on the way
+int testFlowGraph() {
+	Engine engine{ TEST_WORKERS, 1024 };
+	const long items = 10000;
+	long sum = 0, received = 0;
+
+	FlowGraph graph{ engine };
+	auto& input = graph.buffer(16);
+	auto& split = graph.broadcast();
+	auto& doubled = graph.function(2, [](const FlowGraph::Message& m) {
+		return FlowGraph::Message{ 2 * std::any_cast<long>(m) };
+	});
+	auto& squared = graph.function(4, [](const FlowGraph::Message& m) {
+		return FlowGraph::Message{ std::any_cast<long>(m) * std::any_cast<long>(m) };
+	});
+	auto& pairs = graph.join(2);
+	auto& limiter = graph.limiter(4);
+	auto& sink = graph.function(1, [&](const FlowGraph::Message& m) {
+		const auto& pair = std::any_cast<const std::vector<FlowGraph::Message>&>(m);
+		sum += std::any_cast<long>(pair[0]) + std::any_cast<long>(pair[1]);
+		received++;
+		limiter.release();
+		return FlowGraph::Message{};
+	}, 0);
+
+	FlowGraph::connect(input, split);
+	FlowGraph::connect(split, doubled);
+	FlowGraph::connect(split, squared);
+	FlowGraph::connect(doubled, pairs.input(0));
+	FlowGraph::connect(squared, pairs.input(1));
+	FlowGraph::connect(pairs, limiter);
+	FlowGraph::connect(limiter, sink);
+
+	for (long i = 0; i < items; i++) {
+		graph.put(input, FlowGraph::Message{ i });
+	}
+
+	graph.wait();
+
+	const long expected = items * (items - 1) + (items - 1) * items * (2 * items - 1) / 6;
+
+	if (received != items || sum != expected) {
+		std::cerr << "Flow graph delivered " << received << " messages, sum " << sum << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Pipelines and flow graphs driven from outside the engine run on the background workers
+int testOffWorker() {
+	Engine engine{ 4, 1024 };
+	const long items = 1000;
+	long pipelineSum = 0, graphSum = 0;
+
+	std::thread driver{ [&] {
+		long input = 0;
+		std::vector<long> buffers(4);
+
+		Pipeline pipeline{ engine, buffers.size() };
+		pipeline.input([&](Pipeline::Item& item) {
+				buffers[item.token] = input;
+				return input++ < items;
+			})
+			.stage(Pipeline::Mode::Parallel, [&](Pipeline::Item& item) { buffers[item.token] *= 2; })
+			.stage(Pipeline::Mode::SerialInOrder, [&](Pipeline::Item& item) { pipelineSum += buffers[item.token]; });
+		pipeline.run();
+
+		FlowGraph graph{ engine };
+		auto& doubled = graph.function(4, [](const FlowGraph::Message& m) {
+			return FlowGraph::Message{ 2 * std::any_cast<long>(m) };
+		}, 8);
+		auto& sink = graph.function(1, [&](const FlowGraph::Message& m) {
+			graphSum += std::any_cast<long>(m);
+			return FlowGraph::Message{};
+		}, 8);
+		FlowGraph::connect(doubled, sink);
+
+		for (long i = 0; i < items; i++) {
+			graph.put(doubled, FlowGraph::Message{ i });
+		}
+
+		graph.wait();
+	} };
+
+	driver.join();
+
+	if (pipelineSum != items * (items - 1) || graphSum != items * (items - 1)) {
+		std::cerr << "Off-engine pipeline sum " << pipelineSum << ", flow graph sum " << graphSum << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Containers shared by tasks lose no update
+int testContainers() {
+	Engine engine{ TEST_WORKERS, SCAN_TASKS + 1 };
+	PerWorker<long> sums{ engine };
+	ConcurrentHashMap<int, long> counts{ 16 };
+	BoundedQueue<long> queue{ SCAN_TASKS };
+	scanSums = &sums;
+	scanCounts = &counts;
+	scanQueue = &queue;
+
+	Worker* worker = engine.threadWorker();
+	Task* root = worker->pool().createTask([](Task&) {});
+
+	for (long i = 0; i < SCAN_TASKS; i++) {
+		worker->submit(worker->pool().createTaskAsChild(scanTask, i, root));
+	}
+
+	worker->submit(root);
+	engine.wait(root);
+
+	long popped = 0, value = 0, count = 0;
+
+	while (queue.tryPop(value)) {
+		popped += value;
+	}
+
+	const long expected = SCAN_TASKS * (SCAN_TASKS - 1) / 2;
+	bool countsMatch = counts.size() == SCAN_KEYS;
+
+	for (int key = 0; key < SCAN_KEYS; key++) {
+		countsMatch = countsMatch && counts.find(key, count) &&
+			count == SCAN_TASKS / SCAN_KEYS + (key < SCAN_TASKS % SCAN_KEYS ? 1 : 0);
+	}
+
+	if (sums.combine(0l, [](long total, long sum) { return total + sum; }) != expected || popped != expected || !countsMatch) {
+		std::cerr << "Concurrent containers lost updates" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	// Threads outside the engine have no instance
+	bool rejected = false;
+
+	std::thread outsider{ [&] {
+		try {
+			sums.local()++;
+		}
+		catch (const std::logic_error&) {
+			rejected = true;
+		}
+	} };
+
+	outsider.join();
+
+	if (!rejected) {
+		std::cerr << "PerWorker::local() accepted a thread outside the engine" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Partitioned join and group-by agree with a serial hash table, skewed keys included
+int testHashJoin() {
+	Engine engine{ TEST_WORKERS, 4096 };
+	std::vector<Row> build, probe;
+	std::unordered_map<std::uint64_t, Group> expected;
+	std::size_t expectedMatches = 0;
+
+	for (std::uint64_t i = 0; i < 100000; i++) {
+		build.push_back(Row{ (i * 7919) % 100000, i });
+	}
+
+	for (std::uint64_t i = 0; i < 400000; i++) {
+		// A quarter of the rows share key 0, some keys are not in the build table
+		const std::uint64_t key = i % 4 == 0 ? 0 : (i * 104729) % 150000;
+		probe.push_back(Row{ key, i });
+		expectedMatches += key < 100000 ? 1 : 0;
+		expected[key].count++;
+		expected[key].sum += i;
+	}
+
+	// Few partitions per pass, so the join takes two
+	PartitionOptions twoPasses;
+	twoPasses.bitsPerPass = 2;
+
+	std::vector<JoinMatch> matches;
+	std::vector<Group> groups;
+	bool matchesValid = hashJoin(engine, build, probe, matches, twoPasses) == expectedMatches;
+	groupBy(engine, probe, groups);
+	bool groupsValid = groups.size() == expected.size();
+
+	for (const JoinMatch& match : matches) {
+		matchesValid = matchesValid && match.key == (match.buildPayload * 7919) % 100000;
+	}
+
+	for (const Group& group : groups) {
+		groupsValid = groupsValid && expected[group.key].count == group.count && expected[group.key].sum == group.sum;
+	}
+
+	if (!matchesValid || !groupsValid) {
+		std::cerr << "Hash join or group by differ from the serial results" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Vectorized kernels agree with the scalar ones on every instruction set the CPU has
+int testSimd() {
+	Engine engine{ TEST_WORKERS, 4096, TaskSize::Bytes64 };
+	std::mt19937 random{ 7 };
+	std::vector<std::int32_t> integers(100003);
+	std::vector<float> floats(integers.size());
+
+	for (std::size_t i = 0; i < integers.size(); i++) {
+		// Few distinct values, so partitions see many equal keys
+		integers[i] = static_cast<std::int32_t>(random() % 5000) - 2500;
+		floats[i] = static_cast<float>(integers[i]) / 8;
+	}
+
+	std::int64_t expectedSum = 0;
+
+	for (std::int32_t value : integers) {
+		expectedSum += value;
+	}
+
+	std::vector<std::int32_t> sortedIntegers = integers;
+	std::vector<float> sortedFloats = floats;
+	std::sort(sortedIntegers.begin(), sortedIntegers.end());
+	std::sort(sortedFloats.begin(), sortedFloats.end());
+	bool valid = true;
+
+	for (int isa = static_cast<int>(simd::Isa::Scalar); isa <= static_cast<int>(simd::supportedIsa()); isa++) {
+		simd::setIsa(static_cast<simd::Isa>(isa));
+
+		for (std::size_t size = 0; size <= simd::SMALL_SORT_SIZE; size++) {
+			std::vector<std::int32_t> small(integers.begin(), integers.begin() + size);
+			std::vector<float> smallFloats(floats.begin(), floats.begin() + size);
+			simd::sortSmall(small.data(), size);
+			simd::sortSmall(smallFloats.data(), size);
+			std::vector<std::int32_t> expected(integers.begin(), integers.begin() + size);
+			std::sort(expected.begin(), expected.end());
+			valid = valid && small == expected && std::is_sorted(smallFloats.begin(), smallFloats.end());
+		}
+
+		std::vector<std::int32_t> partitioned(integers.begin(), integers.begin() + 1001);
+		const std::size_t less = simd::partition(partitioned.data(), partitioned.size(), 100);
+		valid = valid && less == static_cast<std::size_t>(std::count_if(integers.begin(), integers.begin() + 1001,
+			[](std::int32_t value) { return value < 100; })) &&
+			std::is_partitioned(partitioned.begin(), partitioned.end(), [](std::int32_t value) { return value < 100; });
+
+		std::vector<std::int32_t> sorted = integers;
+		std::vector<float> sortedFloatsCopy = floats;
+		parallelSort(engine, sorted.data(), sorted.size());
+		parallelSort(engine, sortedFloatsCopy.data(), sortedFloatsCopy.size());
+
+		valid = valid && sorted == sortedIntegers && sortedFloatsCopy == sortedFloats &&
+			parallelSum(engine, integers.data(), integers.size()) == expectedSum &&
+			parallelMin(engine, integers.data(), integers.size()) == sortedIntegers.front() &&
+			parallelMax(engine, floats.data(), floats.size()) == sortedFloats.back() &&
+			// Eighths of small integers add up exactly
+			parallelSum(engine, floats.data(), floats.size()) == static_cast<float>(expectedSum) / 8 &&
+			simd::min(integers.data(), 0) == std::numeric_limits<std::int32_t>::max();
+	}
+
+	simd::setIsa(simd::supportedIsa());
+
+	// Other types and orders go through std::partition and std::sort
+	std::vector<std::int32_t> descending = integers;
+	parallelSort(engine, descending.data(), descending.size(), std::greater<std::int32_t>{});
+	valid = valid && std::equal(descending.begin(), descending.end(), sortedIntegers.rbegin());
+
+	if (!valid) {
+		std::cerr << "Vectorized kernels differ from the scalar results" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Stable sort keeps the order of equal keys, selections agree with the std ones
+int testSorting() {
+	Engine engine{ TEST_WORKERS, 4096, TaskSize::Bytes64 };
+	std::mt19937 random{ 11 };
+	// Key, then the original position to check stability
+	std::vector<std::pair<int, int>> rows(50001);
+
+	for (std::size_t i = 0; i < rows.size(); i++) {
+		rows[i] = { static_cast<int>(random() % 300), static_cast<int>(i) };
+	}
+
+	const auto byKey = [](const std::pair<int, int>& first, const std::pair<int, int>& second) {
+		return first.first < second.first;
+	};
+
+	std::vector<std::pair<int, int>> expected = rows, stable = rows, selected = rows, top = rows, few = rows;
+	std::stable_sort(expected.begin(), expected.end(), byKey);
+	parallelStableSort(engine, stable.data(), stable.size(), byKey);
+
+	const std::size_t nth = 31234, k = 5000;
+	parallelNthElement(engine, selected.data(), selected.size(), nth, byKey);
+	parallelPartialSort(engine, top.data(), top.size(), k, byKey);
+	// Few enough to be picked among the smallest of each chunk
+	parallelPartialSort(engine, few.data(), few.size(), 100, byKey);
+
+	bool valid = stable == expected && selected[nth].first == expected[nth].first;
+
+	for (std::size_t i = 0; i < selected.size(); i++) {
+		valid = valid && (i < nth ? selected[i].first <= selected[nth].first : selected[i].first >= selected[nth].first);
+	}
+
+	for (std::size_t i = 0; i < k; i++) {
+		valid = valid && top[i].first == expected[i].first && (i >= 100 || few[i].first == expected[i].first);
+	}
+
+	std::sort(few.begin(), few.end());
+	std::sort(rows.begin(), rows.end());
+	valid = valid && few == rows;
+
+	if (!valid) {
+		std::cerr << "Stable sort or selection differ from the std results" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Blocked ranges cover every cell once, in blocks within the grain
+int testBlockedRanges() {
+	Engine engine{ TEST_WORKERS, 4096, TaskSize::Bytes64 };
+	std::vector<int> cells(37 * 45 * 29, 0);
+	std::atomic<bool> withinGrain{ true };
+
+	parallelFor2d(engine, BlockedRange2d{ { 0, 0 }, { 37 * 29, 45 } }, { 8, 8 }, [&](const BlockedRange2d& block) {
+		withinGrain = withinGrain && block.end[0] - block.begin[0] <= 8 && block.end[1] - block.begin[1] <= 8;
+
+		for (std::size_t row = block.begin[0]; row < block.end[0]; row++) {
+			for (std::size_t column = block.begin[1]; column < block.end[1]; column++) {
+				cells[row * 45 + column]++;
+			}
+		}
+	});
+
+	parallelFor3d(engine, BlockedRange3d{ { 0, 0, 0 }, { 37, 45, 29 } }, [&](const BlockedRange3d& block) {
+		for (std::size_t z = block.begin[0]; z < block.end[0]; z++) {
+			for (std::size_t y = block.begin[1]; y < block.end[1]; y++) {
+				for (std::size_t x = block.begin[2]; x < block.end[2]; x++) {
+					cells[(z * 45 + y) * 29 + x]++;
+				}
+			}
+		}
+	});
+
+	if (!withinGrain || std::count(cells.begin(), cells.end(), 2) != static_cast<long>(cells.size())) {
+		std::cerr << "Blocked ranges missed cells or exceeded their grain" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Pools of tasks too small for the ranges still split them
+int testSmallPools() {
+	Engine engine{ TEST_WORKERS, 4096, TaskSize::Bytes32 };
+	std::vector<int> cells(10000, 0);
+	std::atomic<bool> withinGrain{ true };
+
+	parallelFor(engine, 0, cells.size(), 64, [&](std::size_t begin, std::size_t end) {
+		withinGrain = withinGrain && end - begin <= 64;
+
+		for (std::size_t i = begin; i < end; i++) {
+			cells[i]++;
+		}
+	});
+
+	parallelFor2d(engine, BlockedRange2d{ { 0, 0 }, { 100, 100 } }, { 8, 8 }, [&](const BlockedRange2d& block) {
+		withinGrain = withinGrain && block.end[0] - block.begin[0] <= 8 && block.end[1] - block.begin[1] <= 8;
+
+		for (std::size_t row = block.begin[0]; row < block.end[0]; row++) {
+			for (std::size_t column = block.begin[1]; column < block.end[1]; column++) {
+				cells[row * 100 + column]++;
+			}
+		}
+	});
+
+	std::vector<std::int32_t> values(100000);
+	std::mt19937 random{ 3 };
+
+	for (std::int32_t& value : values) {
+		value = static_cast<std::int32_t>(random());
+	}
+
+	parallelSort(engine, values.data(), values.size());
+
+	if (!withinGrain || std::count(cells.begin(), cells.end(), 2) != static_cast<long>(cells.size()) ||
+		!std::is_sorted(values.begin(), values.end())) {
+		std::cerr << "Small tasks ran ranges serially or missed indices" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Task groups nest inside their own tasks, rethrow the first exception and skip cancelled work
+int testTaskGroups() {
+	Engine engine{ TEST_WORKERS, 4096 };
+	std::atomic<long> leavesRun{ 0 };
+
+	struct Tree {
+		static void count(Engine& engine, int depth, std::atomic<long>& leaves) {
+			if (depth == 0) {
+				leaves++;
+				return;
+			}
+
+			TaskGroup group{ engine };
+			group.run([&engine, depth, &leaves] { count(engine, depth - 1, leaves); });
+			group.run([&engine, depth, &leaves] { count(engine, depth - 1, leaves); });
+			group.wait();
+		}
+	};
+
+	TaskGroup group{ engine };
+	group.run([&] { Tree::count(engine, 10, leavesRun); });
+	bool valid = group.wait() == TaskGroup::Status::Complete && leavesRun == 1 << 10;
+
+	std::atomic<int> started{ 0 };
+	group.run([] { throw std::runtime_error{ "failed" }; });
+
+	for (int i = 0; i < 100; i++) {
+		group.run([&] { started++; });
+	}
+
+	try {
+		group.wait();
+		valid = false;
+	}
+	catch (const std::runtime_error&) {
+	}
+
+	group.cancel();
+	group.run([&] { started = -1000; });
+	valid = valid && group.wait() == TaskGroup::Status::Cancelled && started >= 0 && !group.cancelled();
+
+	// A thread outside the engine parks until the functions the workers run are done
+	std::atomic<int> slowRun{ 0 };
+	std::atomic<bool> joined{ false };
+
+	for (int i = 0; i < 64; i++) {
+		group.run([&] {
+			std::this_thread::sleep_for(std::chrono::microseconds(100));
+			slowRun++;
+		});
+	}
+
+	std::thread outsider{ [&] {
+		valid = valid && group.wait() == TaskGroup::Status::Complete && slowRun == 64;
+		joined = true;
+	} };
+
+	engine.threadWorker()->helpUntil([&] { return joined.load(); });
+	outsider.join();
+
+	if (!valid) {
+		std::cerr << "Task group lost tasks, an exception or a cancellation" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Exceptions thrown by tasks reach the waiters of their ancestors, workers keep running
+int testExceptions() {
+	Engine engine{ TEST_WORKERS, 1024 };
+	Worker* worker = engine.threadWorker();
+	failureEngine = &engine;
+	Task* root = worker->pool().createTask(failingRoot);
+
+	bool valid = false;
+	worker->submit(root);
+
+	try {
+		worker->wait(root);
+	}
+	catch (const std::runtime_error& error) {
+		valid = std::string{ error.what() } == "grandchild";
+	}
+
+	// The failure stays with the task, its exception went to the waiter, healthy
+	// tasks run as before
+	Task* healthy = worker->pool().createTask([](Task&) {});
+	worker->submit(healthy);
+	worker->wait(healthy);
+	valid = valid && root->failed() && root->exception() == nullptr && !healthy->failed();
+
+	// Closures are destroyed even if they throw, in the task data or in the heap
+	auto captured = std::make_shared<int>(0);
+	std::array<char, 512> padding{};
+	Task* closures[] = {
+		worker->pool().createClosureTask([captured](Task&) { throw std::runtime_error{ "inline" }; }),
+		worker->pool().createClosureTask([captured, padding](Task&) { throw std::runtime_error{ padding.data() }; })
+	};
+
+	for (Task* closure : closures) {
+		worker->submit(closure);
+
+		try {
+			worker->wait(closure);
+			valid = false;
+		}
+		catch (const std::runtime_error&) {
+		}
+	}
+
+	valid = valid && captured.use_count() == 1;
+
+	// The exception goes with the wait rethrowing it
+	struct Holding : std::runtime_error {
+		explicit Holding(std::shared_ptr<int> value) : std::runtime_error{ "holding" }, held{ std::move(value) } {}
+		std::shared_ptr<int> held;
+	};
+
+	Task* holding = worker->pool().createClosureTask([captured](Task&) { throw Holding{ captured }; });
+	worker->submit(holding);
+
+	try {
+		worker->wait(holding);
+		valid = false;
+	}
+	catch (const Holding&) {
+	}
+
+	valid = valid && captured.use_count() == 1;
+	holding->rearm([](Task&) {});
+	worker->submit(holding);
+	worker->wait(holding);
+	valid = valid && !holding->failed();
+
+	// A throwing finished callback fails its task rather than escaping the worker,
+	// and a task on the stack leaves no exception behind
+	Task finishing{ [](Task& task) { task.whenFinished([](Task&) { throw std::runtime_error{ "callback" }; }); } };
+	worker->submit(&finishing);
+
+	try {
+		worker->wait(&finishing);
+		valid = false;
+	}
+	catch (const std::runtime_error& error) {
+		valid = valid && std::string{ error.what() } == "callback";
+	}
+
+	valid = valid && finishing.failed() && finishing.exception() == nullptr;
+
+	if (!valid) {
+		std::cerr << "Task exception not rethrown to the waiter" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Full pools and queues follow the overflow policy, no task is lost unless discarding
+int testOverflow() {
+	static std::atomic<int> overflowRuns{ 0 };
+	const auto countRun = [](Task&) { overflowRuns.fetch_add(1, std::memory_order_relaxed); };
+	const int overflowTasks = 64;
+
+	Engine engine{ 1, 8 };
+	Worker* worker = engine.threadWorker();
+	bool valid = engine.overflowPolicy() == OverflowPolicy::Discard;
+
+	for (OverflowPolicy policy : { OverflowPolicy::Spill, OverflowPolicy::HelpUntilSpace }) {
+		engine.setOverflowPolicy(policy);
+		overflowRuns = 0;
+
+		Task* root = worker->pool().createTask([](Task&) {});
+
+		for (int i = 0; i < overflowTasks; ++i) {
+			worker->submit(worker->pool().createTaskAsChild(countRun, root));
+		}
+
+		worker->submit(root);
+		worker->wait(root);
+		valid = valid && overflowRuns == overflowTasks && worker->pool().spilledTasks() > 0;
+		worker->pool().clear();
+	}
+
+	// Functions submitted to a full pool spill, and run inline once the queue is full
+	engine.setOverflowPolicy(OverflowPolicy::RunInline);
+	overflowRuns = 0;
+	Task* root = worker->pool().createTask([](Task&) {});
+
+	for (int i = 0; i < overflowTasks; ++i) {
+		worker->submit(countRun, root);
+	}
+
+	worker->submit(root);
+	worker->wait(root);
+	valid = valid && overflowRuns == overflowTasks && worker->pool().spilledTasks() > 0;
+	worker->pool().clear();
+
+	// Pools cannot help, the engine has them spill instead
+	try {
+		worker->pool().setOverflowPolicy(OverflowPolicy::HelpUntilSpace);
+		valid = false;
+	}
+	catch (const std::invalid_argument&) {
+	}
+
+	const OverflowCounters counters = engine.overflowCounters();
+	valid = valid && counters.poolExhausted > 0 && counters.queueFull > 0 && counters.spilled > 0 &&
+		counters.helped > 0 && counters.ranInline > 0 && counters.discarded == 0 && counters.failed == 0;
+
+	engine.setOverflowPolicy(OverflowPolicy::Fail);
+	bool thrown = false;
+
+	try {
+		for (int i = 0; i < overflowTasks; ++i) {
+			worker->pool().createTask(countRun);
+		}
+	}
+	catch (const OverflowError&) {
+		thrown = true;
+	}
+
+	if (!valid || !thrown || engine.overflowCounters().failed != 1) {
+		std::cerr << "Overflow policy not applied to full pools and queues" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	worker->pool().clear();
+
+	return EXIT_SUCCESS;
+}
+
+// Timers firing into a full queue under the Fail policy spill, nothing escapes the worker loop
+int testOverflowTimers() {
+	static Worker* eventWorker = nullptr;
+	static Task fillers[8];
+	static Task refills[2];
+	static int refillsLeft = 1000;
+	static TaskFunction refill = nullptr;
+
+	// Each refill submits the next one, so the queue is full as the worker polls its timers
+	refill = [](Task& task) {
+		if (--refillsLeft > 0) {
+			Task* next = &refills[&task == &refills[0] ? 1 : 0];
+			new(next) Task{ refill };
+			eventWorker->submit(next);
+		}
+	};
+
+	Engine engine{ 1, 8 };
+	Worker* worker = eventWorker = engine.threadWorker();
+	engine.setOverflowPolicy(OverflowPolicy::Fail);
+
+	Task* fired = worker->pool().createTask([](Task&) {});
+	worker->submitAfter(std::chrono::nanoseconds(0), fired);
+	std::this_thread::sleep_for(std::chrono::milliseconds(2));
+
+	for (Task& filler : fillers) {
+		new(&filler) Task{ [](Task&) {} };
+		worker->submit(&filler);
+	}
+
+	new(&refills[0]) Task{ refill };
+	worker->submit(&refills[0]);
+	bool valid = true;
+
+	try {
+		worker->wait(fired);
+	}
+	catch (const OverflowError&) {
+		valid = false;
+	}
+
+	worker->helpUntil([] {
+		return refillsLeft <= 0 && refills[0].finished() && refills[1].finished() &&
+			std::all_of(std::begin(fillers), std::end(fillers), [](const Task& filler) { return filler.finished(); });
+	});
+
+	if (!valid || engine.overflowCounters().spilled == 0) {
+		std::cerr << "Timer continuation not spilled from a full queue" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Pinned tasks injected into a full queue under the Fail policy spill, nothing escapes the worker loop
+int testOverflowInjected() {
+	Engine engine{ 1, 8 };
+	Worker* worker = engine.threadWorker();
+	engine.setOverflowPolicy(OverflowPolicy::Fail);
+
+	// Every task run from the queue takes a slot for good, until it is full
+	Task filler{ [](Task&) {} };
+	bool full = false;
+
+	for (int i = 0; i < 64 && !full; i++) {
+		new(&filler) Task{ [](Task&) {} };
+
+		try {
+			worker->submit(&filler);
+			worker->wait(&filler);
+		}
+		catch (const OverflowError&) {
+			full = true;
+		}
+	}
+
+	// Pinned to a worker the engine does not have, so it is queued where it is taken
+	static std::atomic<bool> pinnedRan{ false };
+	Task pinned{ [](Task&) { pinnedRan = true; } };
+	pinned.setAffinity(Affinity::worker(7));
+
+	std::thread outsider{ [&] { engine.submit(&pinned); } };
+	outsider.join();
+	bool valid = full;
+
+	try {
+		worker->wait(&pinned);
+	}
+	catch (const OverflowError&) {
+		valid = false;
+	}
+
+	if (!valid || !pinnedRan) {
+		std::cerr << "Injected task not spilled from a full queue" << std::endl;
+		return EXIT_FAILURE;
+	}
+
+	return EXIT_SUCCESS;
+}
+
+// Speed measurements, once every test passed
+int benchmark() {
+	treeDepth = TREE_DEPTH;
+
+	treeEngine = &Engine::Instance();
 	Worker* worker = Engine::Instance().threadWorker();
 	for (int i = 0; i < TEST_COUNT; i++) {
 	
@@ -21,4 +1593,92 @@ int main() {
 		worker->submit(task);
 		worker->wait(task);
 	}
-}
\ No newline at end of file
+
+	const long tasksPerRound = (2l << TREE_DEPTH) - 1;
+	long long elapsed = 0;
+
+	for (int round = 0; round < TREE_ROUNDS; round++) {
+		// Every worker allocated tasks for the previous tree, but all of them are
+		// finished once the root is, so the pools are reset on their next use
+		Engine::Instance().beginFrame();
+
+		leaves = 0;
+		const auto start = std::chrono::steady_clock::now();
+
+		Task* root = worker->pool().createTask(treeTask, TreeNode{ 0 });
+		worker->submit(root);
+		worker->wait(root);
+
+		elapsed += std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now() - start).count();
+
+		if (leaves != (1l << TREE_DEPTH)) {
+			std::cerr << "Round " << round << ": " << leaves << " leaves run, expected "
+				<< (1l << TREE_DEPTH) << std::endl;
+			return EXIT_FAILURE;
+		}
+	}
+
+	const double tasks = static_cast<double>(tasksPerRound) * TREE_ROUNDS;
+	std::cout << "Spawn/complete: " << tasks * 1000.0 / elapsed << " Mtasks/s, "
+		<< elapsed / tasks << " ns/task" << std::endl;
+
+	// Running a task that does not throw, so the cost of catching exceptions shows
+	alignas(64) unsigned char storage[static_cast<std::size_t>(TaskSize::Bytes64)];
+	const auto inlineStart = std::chrono::steady_clock::now();
+
+	for (int i = 0; i < INLINE_RUNS; i++) {
+		new(storage) Task{ [](Task&) {} };
+		reinterpret_cast<Task*>(storage)->runInline();
+	}
+
+	const auto inlineElapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+		std::chrono::steady_clock::now() - inlineStart).count();
+	std::cout << "Run inline: " << static_cast<double>(inlineElapsed) / INLINE_RUNS << " ns/task" << std::endl;
+
+	return EXIT_SUCCESS;
+}
+
+int main() {
+	const auto tests = {
+		testWaits,
+		testTimers,
+		testPeriodicCancel,
+		testFileIo,
+		testSockets,
+		testBlockingPool,
+		testTaskSizes,
+		testCounterHandoff,
+		testFinishing,
+		testSimulation,
+		testGenerations,
+		testScratch,
+		testLifecycle,
+		testIdleEngines,
+		testInlineSpawns,
+		testAffinity,
+		testPipeline,
+		testPipelineExceptions,
+		testFlowGraph,
+		testOffWorker,
+		testContainers,
+		testHashJoin,
+		testSimd,
+		testSorting,
+		testBlockedRanges,
+		testSmallPools,
+		testTaskGroups,
+		testExceptions,
+		testOverflow,
+		testOverflowTimers,
+		testOverflowInjected,
+	};
+
+	for (auto run : tests) {
+		if (run() != EXIT_SUCCESS) {
+			return EXIT_FAILURE;
+		}
+	}
+
+	return benchmark();
+}